@@ -28,6 +28,7 @@
 
 #include "cif++/utilities.hpp"
 #include "cif++/file.hpp"
+#include "cif++/category_writer.hpp"
 #include "cif++/parser.hpp"
 #include "cif++/format.hpp"
 
@@ -36,6 +37,8 @@
 #include "cif++/symmetry.hpp"
 
 #include "cif++/model.hpp"
+#include "cif++/assembly.hpp"
+#include "cif++/ensemble.hpp"
 
 #include "cif++/pdb.hpp"
 #include "cif++/gzio.hpp"
\ No newline at end of file
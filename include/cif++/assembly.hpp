@@ -0,0 +1,123 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 NKI/AVL, Netherlands Cancer Institute
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "cif++/category.hpp"
+#include "cif++/datablock.hpp"
+#include "cif++/symmetry.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @file assembly.hpp
+ *
+ * Support for biological assemblies as described by the categories
+ * pdbx_struct_assembly, pdbx_struct_assembly_gen and pdbx_struct_oper_list.
+ *
+ * An assembly can be generated as a new datablock, or it can be used
+ * as a lightweight view: a list of operations, each consisting of a
+ * transformation and the asym ids it applies to.
+ *
+ * @code {.cpp}
+ * cif::file f("1juh.cif.gz");
+ *
+ * // a new datablock containing the atoms of the assembly
+ * auto db = cif::mm::create_assembly(f.front(), "2");
+ *
+ * // or only the transformations
+ * for (auto &op : cif::mm::get_assembly_operations(f.front(), "2"))
+ *     std::cout << op.m_name << ' ' << op.m_asym_ids.size() << '\n';
+ * @endcode
+ */
+
+namespace cif::mm
+{
+
+/**
+ * @brief Parse the oper_expression of a pdbx_struct_assembly_gen record
+ *
+ * The expression is either a list of operator ids or a series of
+ * parenthesized lists. Lists contain comma separated ids or ranges of
+ * numeric ids, as in `1,2,5-8`. A series of lists denotes the Cartesian
+ * product, so `(1-60)(61-88)` results in 60 x 28 combinations.
+ *
+ * @param expr The expression to parse
+ * @return The combinations of operator ids. Each combination is to be
+ * applied from right to left, i.e. the last operator first.
+ */
+std::vector<std::vector<std::string>> parse_oper_expression(std::string_view expr);
+
+/**
+ * @brief A single operation in an assembly, the transformation applied
+ * to a set of asyms.
+ */
+struct assembly_operation
+{
+	std::string m_name;                 ///< The operator ids joined with 'x', e.g. "1" or "1x61"
+	transformation m_transformation;    ///< The combined transformation for the operators
+	std::vector<std::string> m_asym_ids; ///< The asym ids this operation applies to
+	bool m_identity;                    ///< True if the transformation does not move the atoms
+};
+
+/**
+ * @brief Return the operations for assembly @a assembly_id in datablock
+ * @a db, in the order of pdbx_struct_assembly_gen and the oper_expression.
+ *
+ * Throws std::runtime_error if the assembly does not exist or an operator
+ * cannot be found in pdbx_struct_oper_list.
+ */
+std::vector<assembly_operation> get_assembly_operations(const datablock &db, std::string_view assembly_id);
+
+/**
+ * @brief Create a new datablock containing assembly @a assembly_id from @a db
+ *
+ * Atoms are copied for each operation and transformed. Copies made by
+ * an operation that is not the identity get new asym ids consisting of
+ * the original asym id, a dash and the operation name, e.g. `A-2`. Atom
+ * ids are renumbered.
+ *
+ * The categories struct_asym, pdbx_poly_seq_scheme, pdbx_nonpoly_scheme,
+ * pdbx_branch_scheme and struct_conn are updated accordingly. Connections
+ * between asyms that are not copied by the same operation are left out.
+ * The rows in atom_site_anisotrop follow the new atom ids and their
+ * tensors are rotated, the standard uncertainties of rotated tensors are
+ * set to unknown. All other categories are copied unchanged, so those
+ * referring to atoms or asyms, like struct_site_gen, still refer to the
+ * original ones.
+ */
+datablock create_assembly(const datablock &db, std::string_view assembly_id);
+
+/**
+ * @brief Create a new datablock containing assembly @a assembly_id from @a db,
+ * the atom copies are created using multiple threads, one operation at a time
+ * per thread.
+ */
+datablock create_assembly(const datablock &db, std::string_view assembly_id, const parallel_policy &policy);
+
+} // namespace cif::mm
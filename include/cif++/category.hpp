@@ -35,6 +35,9 @@
 #include "cif++/text.hpp"
 
 #include <array>
+#include <atomic>
+#include <mutex>
+#include <unordered_set>
 
 /** \file category.hpp
   * Documentation for the cif::category class
@@ -96,6 +99,73 @@ inline constexpr bool is_optional_v<std::optional<_Tp>> = true;
 
 // --------------------------------------------------------------------
 
+/// @brief Policy type to select the multi-threaded versions of
+/// category::find, category::count and category::exists.
+///
+/// @code{.cpp}
+/// auto rows = atom_site.find(cif::parallel, cif::key("type_symbol") == "ZN");
+/// @endcode
+
+struct parallel_policy
+{
+	/// The number of threads to use, zero means use std::thread::hardware_concurrency()
+	size_t m_nr_of_threads = 0;
+};
+
+/// @brief Pass cif::parallel as first argument to select the multi-threaded
+/// versions of category::find, category::count and category::exists
+inline constexpr parallel_policy parallel{};
+
+/// @brief Tag type to select the incremental versions of category::is_valid
+/// and category::validate_links, those that only check what was changed
+/// since the previous validation.
+struct incremental_type
+{
+};
+
+/// @brief Pass cif::incremental to is_valid or validate_links to validate
+/// only the rows that were added or modified since the previous validation
+///
+/// @code{.cpp}
+/// atom_site.front()["occupancy"] = 0.5;
+/// assert(atom_site.is_valid(cif::incremental));
+/// @endcode
+inline constexpr incremental_type incremental{};
+
+/// @brief Tag type to select the versions of the write functions that do
+/// not align values in columns.
+struct unaligned_type
+{
+};
+
+/// @brief Pass cif::unaligned to category::write, datablock::write or
+/// file::save to skip aligning the values in columns. The output is
+/// intended for programs, not for humans, and is written much faster.
+///
+/// @code{.cpp}
+/// file.save("out.cif.gz", cif::unaligned);
+/// @endcode
+inline constexpr unaligned_type unaligned{};
+
+/// @brief Tag type to select the versions of category::find that return
+/// rows in the order of the index on the category keys.
+struct order_by_key_type
+{
+};
+
+/// @brief Pass cif::order_by_key as first argument to category::find to
+/// get the rows sorted by key. Conditions constraining the leading key
+/// columns are resolved using the index.
+///
+/// @code{.cpp}
+/// auto rows = pdbx_poly_seq_scheme.find(cif::order_by_key,
+///     cif::key("asym_id") == "A" and cif::key("entity_id") == 1 and
+///     cif::key("seq_id") >= 10 and cif::key("seq_id") < 50);
+/// @endcode
+inline constexpr order_by_key_type order_by_key{};
+
+// --------------------------------------------------------------------
+
 /// The class category is a sequence container for rows of data values.
 /// You could think of it as a std::vector<cif::row_handle> like class.
 ///
@@ -113,6 +183,9 @@ class category
 	template <typename, typename...>
 	friend class iterator_impl;
 
+	template <typename, typename...>
+	friend class conditional_iterator_proxy;
+
 	using value_type = row_handle;
 	using reference = value_type;
 	using const_reference = const value_type;
@@ -160,6 +233,19 @@ class category
 	/// @return Returns true is all validations pass
 	bool is_valid() const;
 
+	/// @brief Validate the data using multiple threads, the rows are divided
+	/// over the threads. Errors are reported in the same order as is_valid()
+	/// would.
+	/// @param policy The parallel_policy, use cif::parallel for the defaults
+	/// @return Returns true is all validations pass
+	bool is_valid(const parallel_policy &policy) const;
+
+	/// @brief Validate only the rows and columns that were changed since
+	/// the previous validation. Rows that fail validation will be
+	/// checked again the next time.
+	/// @return Returns true if all validations pass
+	bool is_valid(incremental_type) const;
+
 	/// @brief Validate links, that means, values in this category should have an
 	/// accompanying value in parent categories.
 	/// 
@@ -173,11 +259,49 @@ class category
 	/// @return Returns true is all validations pass
 	bool validate_links() const;
 
+	/// @brief Validate the links for only those rows that were added or
+	/// modified since the previous link validation, or whose parent key
+	/// was changed.
+	/// @return Returns true is all validations pass
+	bool validate_links(incremental_type) const;
+
 	/// @brief Equality operator, returns true if @a rhs is equal to this
 	/// @param rhs The object to compare with
 	/// @return True if the data contained is equal
 	bool operator==(const category &rhs) const;
 
+	/// @brief Return a number that changes each time rows are removed from
+	/// this category. A row obtained before is still valid as long as the
+	/// value returned is the same.
+	uint64_t erase_serial() const
+	{
+		return m_erase_serial;
+	}
+
+	/// @brief Return a number that changes each time a value in this
+	/// category is changed. Can be used to check whether information
+	/// derived from the values is still up to date.
+	uint64_t update_serial() const
+	{
+		return m_update_serial;
+	}
+
+	/// @brief Return a hash of the contents of this category
+	///
+	/// The hash is calculated over the category name and the column names
+	/// and values of all rows. It does not depend on the order of the rows
+	/// or columns. The first call takes time linear in the size of the
+	/// category, after that the hash is updated with each modification
+	/// and this call is O(1).
+	///
+	/// Equal hashes mean the text of the values is equal. Note that
+	/// operator== may still consider categories equal when the hashes
+	/// differ, e.g. when numbers are formatted differently.
+	///
+	/// This method may be called from multiple threads at the same time,
+	/// as long as the category is not modified.
+	uint64_t hash() const;
+
 	/// @brief Unequality operator, returns true if @a rhs is not equal to this
 	/// @param rhs The object to compare with
 	/// @return True if the data contained is not equal
@@ -304,13 +428,13 @@ class category
 	/// @endcode 
 	///
 	/// @tparam Ts The types for the columns requested
-	/// @param names The names for the columns requested
+	/// @param names The names for the columns requested, either as string or as @ref column_ref
 
 	template <typename... Ts, typename... Ns>
-	iterator_proxy<const category, Ts...> rows(Ns... names) const
+	iterator_proxy<const category, Ts...> rows(const Ns &...names) const
 	{
 		static_assert(sizeof...(Ts) == sizeof...(Ns), "The number of column titles should be equal to the number of types to return");
-		return iterator_proxy<const category, Ts...>(*this, begin(), { names... });
+		return iterator_proxy<const category, Ts...>(*this, begin(), std::array<uint16_t, sizeof...(Ts)>{ get_column_ix(names)... });
 	}
 
 	/// @brief Return a special iterator for all rows in this category.
@@ -330,10 +454,10 @@ class category
 	/// @param names The names for the columns requested
 
 	template <typename... Ts, typename... Ns>
-	iterator_proxy<category, Ts...> rows(Ns... names)
+	iterator_proxy<category, Ts...> rows(const Ns &...names)
 	{
 		static_assert(sizeof...(Ts) == sizeof...(Ns), "The number of column titles should be equal to the number of types to return");
-		return iterator_proxy<category, Ts...>(*this, begin(), { names... });
+		return iterator_proxy<category, Ts...>(*this, begin(), std::array<uint16_t, sizeof...(Ts)>{ get_column_ix(names)... });
 	}
 
 	// --------------------------------------------------------------------
@@ -345,6 +469,11 @@ class category
 	///    .. // do something with rh
 	/// @endcode 
 	///
+	/// If @a cond constrains the leading key columns, equality on any type and
+	/// ranges on integer values, only the matching part of the index is visited
+	/// and the rows are returned in index order instead of the order in this
+	/// category.
+	///
 	/// @param cond The condition for the query
 	/// @return A special iterator that loops over all elements that match. The iterator can be dereferenced
 	/// to a @ref row_handle
@@ -458,6 +587,89 @@ class category
 		return { *this, pos, std::move(cond), std::forward<Ns>(names)... };
 	}
 
+	/// @brief Return the rows that conform to @a cond, the rows are tested
+	/// using multiple threads. The result is in the same order as the rows in
+	/// this category.
+	///
+	/// @param policy The parallel_policy, use cif::parallel for the defaults
+	/// @param cond The condition for the query
+	/// @return The row handles for the rows that match
+
+	std::vector<row_handle> find(const parallel_policy &policy, condition &&cond) const
+	{
+		std::vector<row_handle> result;
+
+		if (cond)
+		{
+			cond.prepare(*this);
+
+			auto sh = cond.single();
+
+			if (sh.has_value() and *sh)
+				result.emplace_back(*sh);
+			else
+				result = find_parallel(policy, cond, false);
+		}
+
+		return result;
+	}
+
+	/// @brief Return the values for the columns @a names in the rows that conform
+	/// to @a cond, the rows are tested using multiple threads. The result is in the
+	/// same order as the rows in this category.
+	///
+	/// @code{.cpp}
+	/// for (const auto &[x, y, z] : atom_site.find<float,float,float>(cif::parallel, cif::key("label_asym_id") == "A", "cartn_x", "cartn_y", "cartn_z"))
+	///    ...
+	/// @endcode
+	///
+	/// @param policy The parallel_policy, use cif::parallel for the defaults
+	/// @param cond The condition for the query
+	/// @tparam Ts The types for the columns requested
+	/// @param names The names for the columns requested
+	/// @return A std::vector with the values, a std::tuple<Ts...> for each row
+	/// or a single value in case one column was requested.
+
+	template <typename... Ts, typename... Ns>
+	auto find(const parallel_policy &policy, condition &&cond, const Ns &...names) const
+	{
+		static_assert(sizeof...(Ts) == sizeof...(Ns), "The number of column titles should be equal to the number of types to return");
+
+		std::array<uint16_t, sizeof...(Ts)> cix{ get_column_ix(names)... };
+		return get_values<Ts...>(find(policy, std::move(cond)), cix);
+	}
+
+	/// @brief Return a special iterator to loop over the rows that conform
+	/// to @a cond sorted by key, i.e. in the order of the index. Constraints
+	/// in @a cond on the leading key columns, equality on any type and ranges
+	/// on integer values, are resolved using the index. Throws std::logic_error
+	/// if there is no index.
+	///
+	/// @param cond The condition for the query
+	/// @return A special iterator that loops over all elements that match. The iterator can be dereferenced
+	/// to a const @ref row_handle
+
+	conditional_iterator_proxy<const category> find(order_by_key_type, condition &&cond) const
+	{
+		return { *this, order_by_key, std::move(cond) };
+	}
+
+	/// @brief Return a special iterator to loop over the values for the columns
+	/// @a names in the rows that conform to @a cond sorted by key, i.e. in the
+	/// order of the index.
+	///
+	/// @param cond The condition for the query
+	/// @tparam Ts The types for the columns requested
+	/// @param names The names for the columns requested
+	/// @return A special iterator that loops over all elements that match.
+
+	template <typename... Ts, typename... Ns>
+	conditional_iterator_proxy<const category, Ts...> find(order_by_key_type, condition &&cond, Ns... names) const
+	{
+		static_assert(sizeof...(Ts) == sizeof...(Ns), "The number of column titles should be equal to the number of types to return");
+		return { *this, order_by_key, std::move(cond), std::forward<Ns>(names)... };
+	}
+
 	// --------------------------------------------------------------------
 	// if you only expect a single row
 
@@ -766,8 +978,21 @@ class category
 
 			auto sh = cond.single();
 
+			std::vector<row *> candidates;
+
 			if (sh.has_value() and *sh)
 				result = true;
+			else if (get_index_candidates(cond, candidates))
+			{
+				for (auto r : candidates)
+				{
+					if (cond({ *this, *r }))
+					{
+						result = true;
+						break;
+					}
+				}
+			}
 			else
 			{
 				for (auto r : *this)
@@ -784,6 +1009,30 @@ class category
 		return result;
 	}
 
+	/// @brief Return whether a row exists that matches condition @a cond,
+	/// the rows are tested using multiple threads.
+	/// @param policy The parallel_policy, use cif::parallel for the defaults
+	/// @param cond The condition to match
+	/// @return True if a row exists
+	bool exists(const parallel_policy &policy, condition &&cond) const
+	{
+		bool result = false;
+
+		if (cond)
+		{
+			cond.prepare(*this);
+
+			auto sh = cond.single();
+
+			if (sh.has_value() and *sh)
+				result = true;
+			else
+				result = not find_parallel(policy, cond, true).empty();
+		}
+
+		return result;
+	}
+
 	/// @brief Return the total number of rows that match condition @a cond
 	/// @param cond The condition to match
 	/// @return The count
@@ -797,8 +1046,18 @@ class category
 
 			auto sh = cond.single();
 
+			std::vector<row *> candidates;
+
 			if (sh.has_value() and *sh)
 				result = 1;
+			else if (get_index_candidates(cond, candidates))
+			{
+				for (auto r : candidates)
+				{
+					if (cond({ *this, *r }))
+						++result;
+				}
+			}
 			else
 			{
 				for (auto r : *this)
@@ -812,6 +1071,30 @@ class category
 		return result;
 	}
 
+	/// @brief Return the total number of rows that match condition @a cond,
+	/// the rows are tested using multiple threads.
+	/// @param policy The parallel_policy, use cif::parallel for the defaults
+	/// @param cond The condition to match
+	/// @return The count
+	size_t count(const parallel_policy &policy, condition &&cond) const
+	{
+		size_t result = 0;
+
+		if (cond)
+		{
+			cond.prepare(*this);
+
+			auto sh = cond.single();
+
+			if (sh.has_value() and *sh)
+				result = 1;
+			else
+				result = find_parallel(policy, cond, false).size();
+		}
+
+		return result;
+	}
+
 	// --------------------------------------------------------------------
 
 	/// Using the relations defined in the validator, return whether the row
@@ -967,6 +1250,13 @@ class category
 		return result;
 	}
 
+	/// \brief Return the index number for the column referenced by \a column
+	/// The index is cached in \a column, so subsequent calls are O(1)
+	uint16_t get_column_ix(const column_ref &column) const
+	{
+		return column.index(*this);
+	}
+
 	/// @brief Return the name for column with index @a ix
 	/// @param ix The index number
 	/// @return The name of the column
@@ -999,11 +1289,20 @@ class category
 			}
 
 			m_columns.emplace_back(column_name, item_validator);
+			m_dirty_columns = true;
 		}
 
 		return result;
 	}
 
+	/// @brief Make sure the column referenced by @a column is known and return its index number
+	/// @param column The reference to the column
+	/// @return The index number of the column
+	uint16_t add_column(const column_ref &column)
+	{
+		return column.add_to(*this);
+	}
+
 	/// @brief Return whether a column with name @a name exists in this category
 	/// @param name The name of the column
 	/// @return True if the column exists
@@ -1044,8 +1343,21 @@ class category
 	/// @param addMissingColumns When false, empty columns are suppressed from the output
 	void write(std::ostream &os, const std::vector<std::string> &order, bool addMissingColumns = true);
 
+	/// @brief Write the contents of the category to the std::ostream @a os
+	/// without aligning the values in columns
+	void write(std::ostream &os, unaligned_type) const;
+
+	/// @brief Write the contents of the category to the std::ostream @a os
+	/// using multiple threads to format large categories. The output is the
+	/// same as that of the single threaded version.
+	void write(std::ostream &os, const parallel_policy &policy) const;
+
+	/// @brief Write the contents of the category to the std::ostream @a os
+	/// using multiple threads and without aligning the values in columns
+	void write(std::ostream &os, const parallel_policy &policy, unaligned_type) const;
+
   private:
-	void write(std::ostream &os, const std::vector<uint16_t> &order, bool includeEmptyColumns) const;
+	void write(std::ostream &os, const std::vector<uint16_t> &order, bool includeEmptyColumns, bool aligned, size_t nr_of_threads = 1) const;
 
   public:
 
@@ -1121,6 +1433,55 @@ class category
 		const link_validator *v;
 	};
 
+	// Collect the rows that might match the prepared condition @a cond using the
+	// index, in index order. Returns false if the index cannot be used, or if
+	// @a constrained_only is true and @a cond does not constrain the leading key.
+	bool get_index_candidates(const condition &cond, std::vector<row *> &rows, bool constrained_only = true) const;
+
+	// Return the rows that may match the prepared condition @a cond, in index
+	// order. Throws if there is no index.
+	std::vector<row *> find_ordered(const condition &cond) const;
+
+	// Return the values for columns @a cix in @a rows as returned by the typed find
+	template <typename... Ts>
+	static auto get_values(const std::vector<row_handle> &rows, const std::array<uint16_t, sizeof...(Ts)> &cix)
+	{
+		constexpr size_t N = sizeof...(Ts);
+		using value_type = std::conditional_t<N == 1, std::tuple_element_t<0, std::tuple<Ts...>>, std::tuple<Ts...>>;
+
+		std::vector<value_type> result;
+		result.reserve(rows.size());
+
+		for (auto &rh : rows)
+		{
+			if constexpr (N == 1)
+				result.emplace_back(rh[cix[0]].template as<value_type>());
+			else
+				result.emplace_back(detail::get_row_result<Ts...>(rh, std::array<uint16_t, N>(cix)));
+		}
+
+		return result;
+	}
+
+	// Test the prepared condition @a cond for all rows using multiple threads,
+	// returns the matching rows in order. If @a first_only is true, the search
+	// stops as soon as a match is found.
+	std::vector<row_handle> find_parallel(const parallel_policy &policy, const condition &cond, bool first_only) const;
+
+	// Validation helpers, per column a memo of values found valid
+	using validated_values = std::vector<std::unordered_set<std::string_view>>;
+
+	bool validate_columns() const;
+	bool validate_row(const row *r, validated_values &validated) const;
+	bool validate_links(const std::vector<const row *> &rows) const;
+
+	// Mark row @a r as changed, for incremental validation
+	void mark_dirty(const row *r);
+
+	// Reset the incremental validation state, if @a dirty is true
+	// everything needs to be validated again
+	void reset_validation_state(bool dirty = false) const;
+
 	// proxy methods for every insertion
 	iterator insert_impl(const_iterator pos, row *n);
 	iterator erase_impl(const_iterator pos);
@@ -1136,8 +1497,16 @@ class category
 
 	// --------------------------------------------------------------------
 
+	friend class column_ref;
+
+	// Each category gets a unique serial number for its column list. The
+	// serial number is renewed whenever the list of columns is replaced,
+	// so a column_ref can use it to validate its cached index.
+	static uint64_t next_column_serial();
+
 	std::string m_name;
 	std::vector<item_column> m_columns;
+	uint64_t m_column_serial = next_column_serial();
 	const validator *m_validator = nullptr;
 	const category_validator *m_cat_validator = nullptr;
 	std::vector<link> m_parent_links, m_child_links;
@@ -1145,6 +1514,32 @@ class category
 	uint32_t m_last_unique_num = 0;
 	class category_index *m_index = nullptr;
 	row *m_head = nullptr, *m_tail = nullptr;
+	uint64_t m_erase_serial = 0, m_update_serial = 0;
+
+	// The rows that were changed since the last validation. If one of the
+	// m_dirty_* flags is set, everything in that respect needs validating.
+	mutable bool m_dirty_all = true, m_dirty_columns = true, m_dirty_links_all = true;
+	mutable std::unordered_set<const row *> m_dirty_rows, m_dirty_link_rows;
+
+	// Set once validate_links(incremental) was called, before that there
+	// is no need to track child rows affected by changes in a parent.
+	mutable bool m_incremental_links = false;
+
+	// The erase serials of the parent categories at the time of the last
+	// complete link validation. Rows removed from a parent may orphan any
+	// row in this category, a change means all links need validating.
+	mutable std::vector<uint64_t> m_parent_erase_serials;
+
+	// The sum of the hashes of all rows, only maintained after hash() was called.
+	// The first calculation is done holding m_hash_mutex, so concurrent calls
+	// to hash() on a const category are safe.
+	uint64_t row_hash(const row *r) const;
+	void invalidate_hash() const;
+
+	mutable std::mutex m_hash_mutex;
+	mutable std::atomic<bool> m_hash_valid = false;
+	mutable uint64_t m_hash = 0;
+	mutable std::vector<uint64_t> m_column_hashes;
 };
 
 } // namespace cif
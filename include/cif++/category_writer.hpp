@@ -0,0 +1,213 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 NKI/AVL, Netherlands Cancer Institute
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "cif++/exports.hpp"
+
+#include <charconv>
+#include <iosfwd>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @file category_writer.hpp
+ *
+ * This file contains the class cif::category_writer, it writes rows of a
+ * category directly to a std::ostream without storing them in a category
+ * first. This is useful when writing very large categories, e.g. the
+ * atom_site category of a simulation with millions of atoms.
+ *
+ * @code {.cpp}
+ * cif::category_writer w(std::cout, "atom_site", {
+ *     { "id", 6 }, { "type_symbol", 3 }, { "Cartn_x", 9, true } });
+ *
+ * w.write_row(1, "C", 1.5);
+ * w.write_row(2, "N", -12.25);
+ * w.finish();
+ * @endcode
+ */
+
+namespace cif
+{
+
+namespace detail
+{
+	class output_buffer;
+}
+
+/**
+ * @brief Write the rows of a category directly to a std::ostream
+ *
+ * Rows are formatted and written immediately, only the first row is kept
+ * in memory until it is known whether a loop_ is needed. The output is the
+ * same as what category::write produces for a category containing the same
+ * rows, provided the column widths passed in are the same as the ones
+ * category::write calculates. That width is the length of the longest value
+ * in a column plus one, with a minimum of two. Columns without a width are
+ * not aligned, which results in the same output as category::write with
+ * cif::unaligned. A category containing a single row is written without a
+ * loop_, aligned if any of the columns has a width.
+ */
+
+class category_writer
+{
+  public:
+	/// @brief The description of a column
+	struct column
+	{
+		column(std::string_view name, size_t width = 0, bool right_aligned = false)
+			: m_name(name)
+			, m_width(width)
+			, m_right_aligned(right_aligned)
+		{
+		}
+
+		/// @cond
+		column(const char *name, size_t width = 0, bool right_aligned = false)
+			: column(std::string_view{ name }, width, right_aligned)
+		{
+		}
+		/// @endcond
+
+		std::string m_name;         ///< The name of the column
+		size_t m_width;             ///< The width of the column, zero means not aligned
+		bool m_right_aligned;       ///< Right align the values, category::write does this for numbers
+	};
+
+	/**
+	 * @brief Construct a new category writer object
+	 *
+	 * @param os The std::ostream to write to
+	 * @param name The name of the category
+	 * @param columns The columns in the category, use only names for unaligned output
+	 */
+	category_writer(std::ostream &os, std::string_view name, std::vector<column> columns);
+
+	/** @cond */
+	category_writer(const category_writer &) = delete;
+	category_writer &operator=(const category_writer &) = delete;
+	/** @endcond */
+
+	/// @brief The destructor calls finish(), errors are reported on std::cerr
+	~category_writer();
+
+	/**
+	 * @brief Write a row containing @a values, the number of values must be
+	 * equal to the number of columns. Values are formatted the same way as
+	 * they would be when stored in a category using emplace. Throws
+	 * std::runtime_error when called after finish().
+	 */
+	template <typename... Ts>
+	void write_row(const Ts &...values)
+	{
+		if (sizeof...(values) != m_columns.size())
+			throw std::runtime_error("Number of values does not match the number of columns in category_writer");
+
+		(add(values), ...);
+	}
+
+	/**
+	 * @brief Write the final line of the category and flush the output.
+	 * Nothing is written if no rows were written.
+	 */
+	void finish();
+
+	/// @brief Return the number of rows written
+	size_t size() const { return m_rows; }
+
+  private:
+	void add_text(std::string_view value);
+
+	void write_loop_header();
+	void write_loop_value(std::string_view value, size_t column);
+	void write_single_row();
+
+	void add(std::string_view value)
+	{
+		add_text(value);
+	}
+
+	void add(const char *value)
+	{
+		add_text(value);
+	}
+
+	void add(const std::string &value)
+	{
+		add_text(value);
+	}
+
+	void add(char value)
+	{
+		add_text({ &value, 1 });
+	}
+
+	template <typename T>
+	void add(const std::optional<T> &value)
+	{
+		if (value.has_value())
+			add(*value);
+		else
+			add_text("?");
+	}
+
+	template <typename T, std::enable_if_t<std::is_arithmetic_v<T>, int> = 0>
+	void add(const T &value)
+	{
+		if constexpr (std::is_same_v<T, bool>)
+			add_text(value ? "y" : "n");
+		else
+		{
+			char buffer[32];
+
+			std::to_chars_result r;
+			if constexpr (std::is_floating_point_v<T>)
+				r = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::general);
+			else
+				r = std::to_chars(buffer, buffer + sizeof(buffer), value);
+
+			if (r.ec != std::errc())
+				throw std::runtime_error("Could not format number");
+
+			add_text({ buffer, static_cast<size_t>(r.ptr - buffer) });
+		}
+	}
+
+	std::string m_name;
+	std::vector<column> m_columns;
+	std::unique_ptr<detail::output_buffer> m_out;
+	std::vector<std::string> m_first_row;
+	size_t m_column = 0, m_offset = 0, m_rows = 0;
+	bool m_finished = false;
+};
+
+} // namespace cif
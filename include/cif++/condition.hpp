@@ -26,8 +26,10 @@
 
 #pragma once
 
+#include "cif++/pattern.hpp"
 #include "cif++/row.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <functional>
 #include <iostream>
@@ -135,6 +137,28 @@ bool is_column_type_uchar(const category &cat, std::string_view col);
 
 namespace detail
 {
+	/// A constraint on the value of a single column that can be used
+	/// to limit a search using the index of a category. Bounds are
+	/// inclusive and only used for numeric values.
+	struct index_constraint
+	{
+		uint16_t m_item_ix;
+		std::optional<std::string> m_equals;
+		std::optional<std::string> m_lower, m_upper;
+	};
+
+	/// Return the text representation of @a v if it can be used as bound
+	/// in an index_constraint, i.e. if it compares exactly the same way
+	/// as the item values do. This is only the case for integral values.
+	template <typename T>
+	std::optional<std::string> index_bound(const T &v)
+	{
+		if constexpr (std::is_integral_v<T> and not std::is_same_v<T, bool>)
+			return std::to_string(v);
+		else
+			return {};
+	}
+
 	struct condition_impl
 	{
 		virtual ~condition_impl() {}
@@ -145,6 +169,10 @@ namespace detail
 		virtual std::optional<row_handle> single() const { return {}; };
 
 		virtual bool equals([[maybe_unused]] const condition_impl *rhs) const { return false; }
+
+		/// Add the constraints a row has to satisfy to match this condition
+		/// and which can be resolved using an index to @a constraints.
+		virtual void get_index_constraints([[maybe_unused]] std::vector<index_constraint> &constraints) const {}
 	};
 
 	struct all_condition_impl : public condition_impl
@@ -262,6 +290,21 @@ class condition
 		return m_impl ? m_impl->single() : std::optional<row_handle>();
 	}
 
+	/**
+	 * @brief Return the constraints on single columns that a row must satisfy
+	 * to match this prepared condition. These can be used to limit the number of
+	 * rows to test using an index.
+	 */
+	std::vector<detail::index_constraint> get_index_constraints() const
+	{
+		assert(this->m_prepared);
+
+		std::vector<detail::index_constraint> result;
+		if (m_impl)
+			m_impl->get_index_constraints(result);
+		return result;
+	}
+
 	friend condition operator||(condition &&a, condition &&b); /**< Return a condition which is the logical OR or condition @a and @b */
 	friend condition operator&&(condition &&a, condition &&b); /**< Return a condition which is the logical AND or condition @a and @b */
 
@@ -382,6 +425,11 @@ namespace detail
 			return m_single_hit;
 		}
 
+		void get_index_constraints(std::vector<index_constraint> &constraints) const override
+		{
+			constraints.push_back({ m_item_ix, m_value, {}, {} });
+		}
+
 		virtual bool equals(const condition_impl *rhs) const override
 		{
 			if (typeid(*rhs) == typeid(key_equals_condition_impl))
@@ -464,10 +512,13 @@ namespace detail
 	struct key_compare_condition_impl : public condition_impl
 	{
 		template <typename COMP>
-		key_compare_condition_impl(const std::string &item_tag, COMP &&comp, const std::string &s)
+		key_compare_condition_impl(const std::string &item_tag, COMP &&comp, const std::string &s,
+			std::optional<std::string> lower = {}, std::optional<std::string> upper = {})
 			: m_item_tag(item_tag)
 			, m_compare(std::move(comp))
 			, m_str(s)
+			, m_lower(std::move(lower))
+			, m_upper(std::move(upper))
 		{
 		}
 
@@ -480,7 +531,7 @@ namespace detail
 
 		bool test(row_handle r) const override
 		{
-			return m_compare(r, m_icase);
+			return m_compare(r[m_item_ix], m_icase);
 		}
 
 		void str(std::ostream &os) const override
@@ -488,16 +539,23 @@ namespace detail
 			os << m_item_tag << (m_icase ? "^ " : " ") << m_str;
 		}
 
+		void get_index_constraints(std::vector<index_constraint> &constraints) const override
+		{
+			if (m_lower.has_value() or m_upper.has_value())
+				constraints.push_back({ m_item_ix, {}, m_lower, m_upper });
+		}
+
 		std::string m_item_tag;
 		uint16_t m_item_ix = 0;
 		bool m_icase = false;
-		std::function<bool(row_handle, bool)> m_compare;
+		std::function<bool(const item_handle &, bool)> m_compare;
 		std::string m_str;
+		std::optional<std::string> m_lower, m_upper;
 	};
 
 	struct key_matches_condition_impl : public condition_impl
 	{
-		key_matches_condition_impl(const std::string &item_tag, const std::regex &rx)
+		key_matches_condition_impl(const std::string &item_tag, const pattern &rx)
 			: m_item_tag(item_tag)
 			, m_item_ix(0)
 			, mRx(rx)
@@ -512,8 +570,7 @@ namespace detail
 
 		bool test(row_handle r) const override
 		{
-			std::string_view txt = r[m_item_ix].text();
-			return std::regex_match(txt.begin(), txt.end(), mRx);
+			return mRx.match(r[m_item_ix].text());
 		}
 
 		void str(std::ostream &os) const override
@@ -523,7 +580,7 @@ namespace detail
 
 		std::string m_item_tag;
 		uint16_t m_item_ix;
-		std::regex mRx;
+		pattern mRx;
 	};
 
 	template <typename T>
@@ -569,13 +626,47 @@ namespace detail
 
 	struct any_matches_condition_impl : public condition_impl
 	{
-		any_matches_condition_impl(const std::regex &rx)
+		any_matches_condition_impl(const pattern &rx)
 			: mRx(rx)
 		{
 		}
 
+		condition_impl *prepare(const category &c) override
+		{
+			// Resolve the column indices once, instead of for each row
+			try
+			{
+				m_item_ix.clear();
+				m_prepared = true;
+
+				for (auto &f : get_category_fields(c))
+				{
+					auto ix = get_column_ix(c, f);
+					if (std::find(m_item_ix.begin(), m_item_ix.end(), ix) == m_item_ix.end())
+						m_item_ix.push_back(ix);
+				}
+			}
+			catch (...)
+			{
+				m_prepared = false;
+			}
+
+			return this;
+		}
+
 		bool test(row_handle r) const override
 		{
+			if (m_prepared)
+			{
+				for (auto ix : m_item_ix)
+				{
+					if (mRx.match(r[ix].text()))
+						return true;
+				}
+
+				return false;
+			}
+
 			auto &c = r.get_category();
 
 			bool result = false;
@@ -583,8 +674,7 @@ namespace detail
 			{
 				try
 				{
-					std::string_view txt = r[f].text();
-					if (std::regex_match(txt.begin(), txt.end(), mRx))
+					if (mRx.match(r[f].text()))
 					{
 						result = true;
 						break;
@@ -603,7 +693,9 @@ namespace detail
 			os << "<any> =~ expression";
 		}
 
-		std::regex mRx;
+		pattern mRx;
+		std::vector<uint16_t> m_item_ix;
+		bool m_prepared = false;
 	};
 
 	// TODO: Optimize and_condition by having a list of sub items.
@@ -707,6 +799,12 @@ namespace detail
 			return result;
 		}
 
+		void get_index_constraints(std::vector<index_constraint> &constraints) const override
+		{
+			for (auto sub : m_sub)
+				sub->get_index_constraints(constraints);
+		}
+
 		static condition_impl *combine_equal(std::vector<and_condition_impl *> &subs, or_condition_impl *oc);
 
 		std::vector<condition_impl *> m_sub;
@@ -987,9 +1085,9 @@ condition operator>(const key &key, const T &v)
 	s << " > " << v;
 
 	return condition(new detail::key_compare_condition_impl(
-		key.m_item_tag, [tag = key.m_item_tag, v](row_handle r, bool icase)
-		{ return r[tag].template compare<T>(v, icase) > 0; },
-		s.str()));
+		key.m_item_tag, [v](const item_handle &i, bool icase)
+		{ return i.template compare<T>(v, icase) > 0; },
+		s.str(), detail::index_bound(v), {}));
 }
 
 /**
@@ -1002,9 +1100,9 @@ condition operator>=(const key &key, const T &v)
 	s << " >= " << v;
 
 	return condition(new detail::key_compare_condition_impl(
-		key.m_item_tag, [tag = key.m_item_tag, v](row_handle r, bool icase)
-		{ return r[tag].template compare<T>(v, icase) >= 0; },
-		s.str()));
+		key.m_item_tag, [v](const item_handle &i, bool icase)
+		{ return i.template compare<T>(v, icase) >= 0; },
+		s.str(), detail::index_bound(v), {}));
 }
 
 /**
@@ -1017,9 +1115,9 @@ condition operator<(const key &key, const T &v)
 	s << " < " << v;
 
 	return condition(new detail::key_compare_condition_impl(
-		key.m_item_tag, [tag = key.m_item_tag, v](row_handle r, bool icase)
-		{ return r[tag].template compare<T>(v, icase) < 0; },
-		s.str()));
+		key.m_item_tag, [v](const item_handle &i, bool icase)
+		{ return i.template compare<T>(v, icase) < 0; },
+		s.str(), {}, detail::index_bound(v)));
 }
 
 /**
@@ -1032,9 +1130,9 @@ condition operator<=(const key &key, const T &v)
 	s << " <= " << v;
 
 	return condition(new detail::key_compare_condition_impl(
-		key.m_item_tag, [tag = key.m_item_tag, v](row_handle r, bool icase)
-		{ return r[tag].template compare<T>(v, icase) <= 0; },
-		s.str()));
+		key.m_item_tag, [v](const item_handle &i, bool icase)
+		{ return i.template compare<T>(v, icase) <= 0; },
+		s.str(), {}, detail::index_bound(v)));
 }
 
 /**
@@ -1045,6 +1143,16 @@ inline condition operator==(const key &key, const std::regex &rx)
 	return condition(new detail::key_matches_condition_impl(key.m_item_tag, rx));
 }
 
+/**
+ * @brief Operator to create a condition based on a key @a key and a pattern @a rx
+ *
+ * Using a cif::pattern instead of a std::regex is often much faster.
+ */
+inline condition operator==(const key &key, const pattern &rx)
+{
+	return condition(new detail::key_matches_condition_impl(key.m_item_tag, rx));
+}
+
 /**
  * @brief Operator to create a condition based on a key @a key which should be empty/null
  */
@@ -1110,6 +1218,14 @@ inline condition operator==(const any_type &, const std::regex &rx)
 	return condition(new detail::any_matches_condition_impl(rx));
 }
 
+/**
+ * @brief Create a condition to search any column for a pattern @a rx
+ */
+inline condition operator==(const any_type &, const pattern &rx)
+{
+	return condition(new detail::any_matches_condition_impl(rx));
+}
+
 /**
  * @brief Create a condition to return all rows
  */
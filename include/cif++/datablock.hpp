@@ -29,6 +29,9 @@
 #include "cif++/category.hpp"
 #include "cif++/forward_decl.hpp"
 
+#include <type_traits>
+#include <unordered_map>
+
 /** \file datablock.hpp
  * Each valid mmCIF file contains at least one @ref cif::datablock.
  * A datablock has a name and can contain one or more @ref cif::category "categories"
@@ -42,6 +45,11 @@ namespace cif
 /**
  * @brief A datablock is a list of category objects with some additional features
  * 
+ * Looking up a category by name is done using a case-insensitive hash
+ * directory that is kept in sync with the list. References and pointers
+ * to categories returned by operator[], get and emplace remain valid
+ * for as long as the category is part of the datablock, so callers can
+ * safely cache them instead of looking up a category over and over again.
  */
 
 class datablock : public std::list<category>
@@ -106,6 +114,24 @@ class datablock : public std::list<category>
 	 */
 	bool is_valid() const;
 
+	/**
+	 * @brief Validates the content of this datablock using multiple threads.
+	 *
+	 * Categories are divided over the threads, large categories are
+	 * validated using all threads each. Errors are reported in the same
+	 * order as is_valid() would.
+	 *
+	 * @param policy The parallel_policy, use cif::parallel for the defaults
+	 * @return true If the content is valid
+	 */
+	bool is_valid(const parallel_policy &policy) const;
+
+	/**
+	 * @brief Validates only the content that was changed since the previous
+	 * validation, see category::is_valid(incremental_type)
+	 */
+	bool is_valid(incremental_type) const;
+
 	/**
 	 * @brief Validates all contained data for valid links between parents and children
 	 * as defined in the validator
@@ -115,6 +141,12 @@ class datablock : public std::list<category>
 	 */
 	bool validate_links() const;
 
+	/**
+	 * @brief Validates only the links for data that was changed since the
+	 * previous link validation, see category::validate_links(incremental_type)
+	 */
+	bool validate_links(incremental_type) const;
+
 	// --------------------------------------------------------------------
 
 	/**
@@ -176,6 +208,25 @@ class datablock : public std::list<category>
 	 */
 	void write(std::ostream &os) const;
 
+	/**
+	 * @brief Write out the contents to @a os without aligning the values
+	 * in columns. The result is smaller and faster to write.
+	 */
+	void write(std::ostream &os, unaligned_type) const;
+
+	/**
+	 * @brief Write out the contents to @a os, formatting the categories
+	 * using multiple threads. The output is the same as that of the
+	 * single threaded version.
+	 */
+	void write(std::ostream &os, const parallel_policy &policy) const;
+
+	/**
+	 * @brief Write out the contents to @a os using multiple threads
+	 * and without aligning the values in columns.
+	 */
+	void write(std::ostream &os, const parallel_policy &policy, unaligned_type) const;
+
 	/**
 	 * @brief Write out the contents to @a os using the order defined in @a tag_order
 	 */
@@ -192,14 +243,141 @@ class datablock : public std::list<category>
 
 	// --------------------------------------------------------------------
 
+	/**
+	 * @brief Return a hash of the contents of this datablock, combining
+	 * the category::hash values of all categories that are not empty.
+	 * The result does not depend on the order of the categories.
+	 */
+	uint64_t hash() const;
+
 	/**
 	 * @brief Comparison operator to compare two datablock for equal content
 	 */
 	bool operator==(const datablock &rhs) const;
 
+	// --------------------------------------------------------------------
+	// The list modifiers that remove categories need to keep the
+	// directory in sync.
+
+	/** @cond */
+	iterator erase(const_iterator pos)
+	{
+		invalidate_directory();
+		return std::list<category>::erase(pos);
+	}
+
+	iterator erase(const_iterator first, const_iterator last)
+	{
+		invalidate_directory();
+		return std::list<category>::erase(first, last);
+	}
+
+	void clear() noexcept
+	{
+		invalidate_directory();
+		std::list<category>::clear();
+	}
+
+	void pop_front()
+	{
+		invalidate_directory();
+		std::list<category>::pop_front();
+	}
+
+	void pop_back()
+	{
+		invalidate_directory();
+		std::list<category>::pop_back();
+	}
+
+	template <typename UnaryPredicate>
+	size_type remove_if(UnaryPredicate p)
+	{
+		invalidate_directory();
+		return std::list<category>::remove_if(p);
+	}
+
+	template <typename T>
+	size_type remove(const T &value)
+	{
+		invalidate_directory();
+		return std::list<category>::remove(value);
+	}
+
+	template <typename... Args>
+	size_type unique(Args &&...args)
+	{
+		invalidate_directory();
+		return std::list<category>::unique(std::forward<Args>(args)...);
+	}
+
+	template <typename... Args>
+	void resize(Args &&...args)
+	{
+		invalidate_directory();
+		std::list<category>::resize(std::forward<Args>(args)...);
+	}
+
+	template <typename... Args>
+	void assign(Args &&...args)
+	{
+		invalidate_directory();
+		std::list<category>::assign(std::forward<Args>(args)...);
+	}
+
+	// splice and merge take categories away from the other list,
+	// so its directory is invalidated as well when it is a datablock
+
+	template <typename List, typename... Args>
+	void splice(const_iterator pos, List &&other, Args &&...args)
+	{
+		invalidate_directory();
+		if constexpr (std::is_same_v<std::remove_cvref_t<List>, datablock>)
+			other.invalidate_directory();
+		std::list<category>::splice(pos, static_cast<std::list<category> &>(other), std::forward<Args>(args)...);
+	}
+
+	template <typename List, typename... Args>
+	void merge(List &&other, Args &&...args)
+	{
+		invalidate_directory();
+		if constexpr (std::is_same_v<std::remove_cvref_t<List>, datablock>)
+			other.invalidate_directory();
+		std::list<category>::merge(static_cast<std::list<category> &>(other), std::forward<Args>(args)...);
+	}
+
+	void swap(datablock &rhs) noexcept
+	{
+		std::list<category>::swap(rhs);
+		std::swap(m_name, rhs.m_name);
+		std::swap(m_validator, rhs.m_validator);
+		m_directory.swap(rhs.m_directory);
+		std::swap(m_directory_size, rhs.m_directory_size);
+	}
+	/** @endcond */
+
   private:
+	void write(std::ostream &os, bool aligned, size_t nr_of_threads) const;
+
+	iterator lookup(std::string_view name);
+	const_iterator lookup(std::string_view name) const;
+	void rebuild_directory();
+
+	void invalidate_directory() noexcept
+	{
+		m_directory.clear();
+		m_directory_size = kInvalidDirectory;
+	}
+
+	static constexpr size_t kInvalidDirectory = ~size_t(0);
+
+	using directory_type = std::unordered_map<std::string, iterator, ihash, iequal_to>;
+
 	std::string m_name;
 	const validator *m_validator = nullptr;
+
+	directory_type m_directory;
+	size_t m_directory_size = kInvalidDirectory;
 };
 
 } // namespace cif
\ No newline at end of file
@@ -0,0 +1,134 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 NKI/AVL, Netherlands Cancer Institute
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "cif++/model.hpp"
+
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @file ensemble.hpp
+ *
+ * Support for files containing multiple models, like NMR ensembles or
+ * the output of molecular dynamics runs.
+ *
+ * An ensemble loads the topology, the residues, polymers and branches, only
+ * once as a cif::mm::structure for the first model, the model with the lowest
+ * pdbx_PDB_model_num. The coordinates of all models are read in a single pass
+ * over atom_site and stored as frames, a contiguous array of locations per
+ * model in the order of structure::atoms().
+ *
+ * @code {.cpp}
+ * cif::file f("2k5j.cif.gz");
+ * cif::mm::ensemble e(f);
+ *
+ * for (size_t i = 1; i < e.size(); ++i)
+ *     std::cout << e.get_model_numbers()[i] << ' ' << e.rmsd(0, i) << '\n';
+ * @endcode
+ */
+
+namespace cif::mm
+{
+
+/**
+ * @brief A set of models sharing one topology, each model stored as a
+ * frame of atom locations.
+ *
+ * All models should contain the same atoms. Atoms are matched on
+ * label_asym_id, label_seq_id, label_comp_id, auth_seq_id,
+ * pdbx_PDB_ins_code, label_atom_id and label_alt_id.
+ * A model lacking one of the atoms of the first model results in a
+ * std::runtime_error, atoms that are not part of the first model are ignored.
+ */
+class ensemble
+{
+  public:
+	/// @brief Load all models in the first datablock of file @a f
+	ensemble(file &f, StructureOpenOptions options = {});
+
+	/// @brief Load all models in datablock @a db
+	ensemble(datablock &db, StructureOpenOptions options = {});
+
+	ensemble(const ensemble &) = delete;
+	ensemble &operator=(const ensemble &) = delete;
+
+	/// @brief The structure for the first model, providing the topology.
+	/// Only const access is provided since the frames depend on the atoms
+	/// in this structure.
+	const structure &get_structure() const { return m_structure; }
+
+	/// @brief The number of models, or frames
+	size_t size() const { return m_model_numbers.size(); }
+
+	/// @brief The model numbers, in the order of the frames
+	const std::vector<size_t> &get_model_numbers() const { return m_model_numbers; }
+
+	/// @brief The locations of the atoms in frame @a frame, in the same
+	/// order as get_structure().atoms() returns the atoms
+	std::span<const point> get_frame(size_t frame) const;
+
+	/// @brief The index of atom @a a in the frames
+	size_t get_atom_index(const atom &a) const;
+
+	/**
+	 * @brief Return the RMSd between frames @a a and @a b without superposition
+	 *
+	 * @param a The first frame
+	 * @param b The second frame
+	 * @param filter If set, only atoms for which @a filter returns true are used,
+	 * e.g. to calculate the RMSd for C-alpha atoms only.
+	 */
+	double rmsd(size_t a, size_t b, const structure::atom_filter &filter = {}) const;
+
+	/// @brief The average location of each atom over all frames
+	const std::vector<point> &get_average_frame() const { return m_average; }
+
+	/// @brief The root mean square fluctuation of each atom around its
+	/// average location, in the order of get_structure().atoms()
+	std::vector<float> get_fluctuations() const;
+
+	/// @brief The root mean square fluctuation of the atoms in residue @a res
+	float get_fluctuation(const residue &res) const;
+
+	/// @brief The root mean square fluctuation of the atoms in each of the
+	/// residues in @a residues, in the same order
+	std::vector<float> get_fluctuations(const std::vector<const residue *> &residues) const;
+
+  private:
+	structure m_structure;
+	std::vector<size_t> m_model_numbers;
+	size_t m_atom_count = 0;
+	std::vector<point> m_frames;
+	std::vector<point> m_average;
+	std::vector<double> m_mean_square_fluctuation;
+	std::unordered_map<std::string, size_t> m_atom_index;
+};
+
+} // namespace cif::mm
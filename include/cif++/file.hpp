@@ -143,6 +143,29 @@ class file : public std::list<datablock>
 	 */
 	bool is_valid();
 
+	/**
+	 * @brief Validate the content using multiple threads, see
+	 * datablock::is_valid(const parallel_policy &)
+	 *
+	 * Will throw an exception if there is no validator defined.
+	 *
+	 * If each category was valid, validate_links will also be called.
+	 *
+	 * @param policy The parallel_policy, use cif::parallel for the defaults
+	 * @return true If the content is valid
+	 */
+	bool is_valid(const parallel_policy &policy) const;
+
+	/**
+	 * @brief Validate only the content that was changed since the previous
+	 * validation. Links are validated incrementally as well.
+	 *
+	 * Will throw an exception if there is no validator defined.
+	 *
+	 * @return true If the changed content is valid
+	 */
+	bool is_valid(incremental_type) const;
+
 	/**
 	 * @brief Validate the links for all datablocks contained.
 	 * 
@@ -153,6 +176,12 @@ class file : public std::list<datablock>
 	 */
 	bool validate_links() const;
 
+	/**
+	 * @brief Validate the links for only the data that was changed since
+	 * the previous link validation.
+	 */
+	bool validate_links(incremental_type) const;
+
 	/**
 	 * @brief Attempt to load a dictionary (validator) based on
 	 * the contents of the *audit_conform* category, if available.
@@ -226,6 +255,24 @@ class file : public std::list<datablock>
 	/** Save the data to @a is */
 	void save(std::ostream &os) const;
 
+	/** Save the data to the file specified by @a p without aligning values in columns */
+	void save(const std::filesystem::path &p, unaligned_type) const;
+
+	/** Save the data to @a os without aligning values in columns */
+	void save(std::ostream &os, unaligned_type) const;
+
+	/** Save the data to the file specified by @a p, formatting using multiple threads */
+	void save(const std::filesystem::path &p, const parallel_policy &policy) const;
+
+	/** Save the data to @a os, formatting using multiple threads */
+	void save(std::ostream &os, const parallel_policy &policy) const;
+
+	/** Save the data to the file specified by @a p using multiple threads and without aligning values in columns */
+	void save(const std::filesystem::path &p, const parallel_policy &policy, unaligned_type) const;
+
+	/** Save the data to @a os using multiple threads and without aligning values in columns */
+	void save(std::ostream &os, const parallel_policy &policy, unaligned_type) const;
+
 	/**
 	 * @brief Friend operator<< to write file @a f to std::ostream @a os
 	 */
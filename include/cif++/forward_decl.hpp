@@ -50,4 +50,6 @@ class row_handle;
 class item;
 struct item_handle;
 
+struct order_by_key_type;
+
 } // namespace cif
\ No newline at end of file
@@ -116,7 +116,12 @@ class item
 
 		char buffer[32];
 
-		auto r = to_chars(buffer, buffer + sizeof(buffer) - 1, value, chars_format::fixed, precision);
+		std::to_chars_result r;
+		if constexpr (std::is_same_v<T, long double>)
+			r = to_chars(buffer, buffer + sizeof(buffer) - 1, value, chars_format::fixed, precision);
+		else
+			r = to_chars_fixed(buffer, buffer + sizeof(buffer) - 1, value, precision);
+
 		if (r.ec != std::errc())
 			throw std::runtime_error("Could not format number");
 
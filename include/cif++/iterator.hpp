@@ -29,6 +29,7 @@
 #include "cif++/row.hpp"
 
 #include <array>
+#include <vector>
 
 /**
  * @file iterator.hpp
@@ -484,6 +485,7 @@ class iterator_proxy
 
 	iterator_proxy(category_type &cat, row_iterator pos, char const *const columns[N]);
 	iterator_proxy(category_type &cat, row_iterator pos, std::initializer_list<char const *> columns);
+	iterator_proxy(category_type &cat, row_iterator pos, const std::array<uint16_t, N> &column_ix);
 
 	iterator_proxy(iterator_proxy &&p);
 	iterator_proxy &operator=(iterator_proxy &&p);
@@ -528,6 +530,10 @@ class iterator_proxy
  * In the case of an conditional_iterator_proxy a cif::condition is used
  * to filter out only those rows that match the condition.
  *
+ * If the condition constrains the leading key columns of a category
+ * that has an index, only the rows in the matching part of the index
+ * are tested and the rows are returned in index order.
+ *
  * @tparam CategoryType The category the iterators belong to
  * @tparam Ts The types to which the iterators can be dereferenced
  */
@@ -555,6 +561,7 @@ class conditional_iterator_proxy
 		using reference = value_type;
 
 		conditional_iterator_impl(CategoryType &cat, row_iterator pos, const condition &cond, const std::array<uint16_t, N> &cix);
+		conditional_iterator_impl(CategoryType &cat, const std::vector<row *> &rows, size_t ix, const condition &cond, const std::array<uint16_t, N> &cix);
 		conditional_iterator_impl(const conditional_iterator_impl &i) = default;
 		conditional_iterator_impl &operator=(const conditional_iterator_impl &i) = default;
 
@@ -572,6 +579,17 @@ class conditional_iterator_proxy
 
 		conditional_iterator_impl &operator++()
 		{
+			if (m_rows != nullptr)
+			{
+				if (m_row_ix < m_rows->size())
+				{
+					++m_row_ix;
+					seek();
+				}
+
+				return *this;
+			}
+
 			while (mBegin != mEnd)
 			{
 				if (++mBegin == mEnd)
@@ -601,9 +619,24 @@ class conditional_iterator_proxy
 		bool operator!=(const iterator_impl<IRowType, ITs...> &rhs) const { return mBegin != rhs; }
 
 	  private:
+		// Move to the first row in m_rows starting at m_row_ix that matches
+		void seek()
+		{
+			while (m_row_ix < m_rows->size() and not m_condition->operator()({ *mCat, *(*m_rows)[m_row_ix] }))
+				++m_row_ix;
+
+			row *r = m_row_ix < m_rows->size() ? (*m_rows)[m_row_ix] : nullptr;
+			mBegin = base_iterator(row_iterator(*mCat, r), m_cix);
+		}
+
 		CategoryType *mCat;
 		base_iterator mBegin, mEnd;
 		const condition *m_condition;
+
+		// The candidate rows found using the index, if any
+		const std::vector<row *> *m_rows = nullptr;
+		size_t m_row_ix = 0;
+		std::array<uint16_t, N> m_cix;
 	};
 
 	using iterator = conditional_iterator_impl;
@@ -612,6 +645,9 @@ class conditional_iterator_proxy
 	template <typename... Ns>
 	conditional_iterator_proxy(CategoryType &cat, row_iterator pos, condition &&cond, Ns... names);
 
+	template <typename... Ns>
+	conditional_iterator_proxy(CategoryType &cat, const order_by_key_type &, condition &&cond, Ns... names);
+
 	conditional_iterator_proxy(conditional_iterator_proxy &&p);
 	conditional_iterator_proxy &operator=(conditional_iterator_proxy &&p);
 
@@ -640,6 +676,10 @@ class conditional_iterator_proxy
 	condition m_condition;
 	row_iterator mCBegin, mCEnd;
 	std::array<uint16_t, N> mCix;
+
+	// Set when the rows to test were collected from the index
+	bool m_indexed = false;
+	std::vector<row *> m_rows;
 };
 
 // --------------------------------------------------------------------
@@ -668,6 +708,15 @@ iterator_proxy<Category, Ts...>::iterator_proxy(Category &cat, row_iterator pos,
 		m_column_ix[i++] = m_category->get_column_ix(column);
 }
 
+template <typename Category, typename... Ts>
+iterator_proxy<Category, Ts...>::iterator_proxy(Category &cat, row_iterator pos, const std::array<uint16_t, N> &column_ix)
+	: m_category(&cat)
+	, m_begin(pos)
+	, m_end(cat.end())
+	, m_column_ix(column_ix)
+{
+}
+
 // --------------------------------------------------------------------
 
 template <typename Category, typename... Ts>
@@ -682,12 +731,30 @@ conditional_iterator_proxy<Category, Ts...>::conditional_iterator_impl::conditio
 		mBegin = mEnd;
 }
 
+template <typename Category, typename... Ts>
+conditional_iterator_proxy<Category, Ts...>::conditional_iterator_impl::conditional_iterator_impl(
+	Category &cat, const std::vector<row *> &rows, size_t ix, const condition &cond, const std::array<uint16_t, N> &cix)
+	: mCat(&cat)
+	, mEnd(cat.end(), cix)
+	, m_condition(&cond)
+	, m_rows(&rows)
+	, m_row_ix(ix)
+	, m_cix(cix)
+{
+	if (m_condition->empty())
+		m_row_ix = rows.size();
+
+	seek();
+}
+
 template <typename Category, typename... Ts>
 conditional_iterator_proxy<Category, Ts...>::conditional_iterator_proxy(conditional_iterator_proxy &&p)
 	: m_cat(nullptr)
 	, mCBegin(p.mCBegin)
 	, mCEnd(p.mCEnd)
 	, mCix(p.mCix)
+	, m_indexed(p.m_indexed)
+	, m_rows(std::move(p.m_rows))
 {
 	std::swap(m_cat, p.m_cat);
 	std::swap(mCix, p.mCix);
@@ -708,8 +775,14 @@ conditional_iterator_proxy<Category, Ts...>::conditional_iterator_proxy(Category
 	{
 		m_condition.prepare(cat);
 
-		while (mCBegin != mCEnd and not m_condition(*mCBegin))
-			++mCBegin;
+		// Searching all rows can use the index on the category key
+		if (mCBegin == cat.begin() and cat.get_index_candidates(m_condition, m_rows))
+			m_indexed = true;
+		else
+		{
+			while (mCBegin != mCEnd and not m_condition(*mCBegin))
+				++mCBegin;
+		}
 	}
 	else
 		mCBegin = mCEnd;
@@ -718,6 +791,27 @@ conditional_iterator_proxy<Category, Ts...>::conditional_iterator_proxy(Category
 	((mCix[i++] = m_cat->get_column_ix(names)), ...);
 }
 
+template <typename Category, typename... Ts>
+template <typename... Ns>
+conditional_iterator_proxy<Category, Ts...>::conditional_iterator_proxy(Category &cat, const order_by_key_type &, condition &&cond, Ns... names)
+	: m_cat(&cat)
+	, m_condition(std::move(cond))
+	, mCBegin(cat.end())
+	, mCEnd(cat.end())
+	, m_indexed(true)
+{
+	static_assert(sizeof...(Ts) == sizeof...(Ns), "Number of column names should be equal to number of requested value types");
+
+	if (m_condition)
+	{
+		m_condition.prepare(cat);
+		m_rows = cat.find_ordered(m_condition);
+	}
+
+	uint16_t i = 0;
+	((mCix[i++] = m_cat->get_column_ix(names)), ...);
+}
+
 template <typename Category, typename... Ts>
 conditional_iterator_proxy<Category, Ts...> &conditional_iterator_proxy<Category, Ts...>::operator=(conditional_iterator_proxy &&p)
 {
@@ -728,18 +822,24 @@ conditional_iterator_proxy<Category, Ts...> &conditional_iterator_proxy<Category
 template <typename Category, typename... Ts>
 typename conditional_iterator_proxy<Category, Ts...>::iterator conditional_iterator_proxy<Category, Ts...>::begin() const
 {
+	if (m_indexed)
+		return iterator(*m_cat, m_rows, 0, m_condition, mCix);
 	return iterator(*m_cat, mCBegin, m_condition, mCix);
 }
 
 template <typename Category, typename... Ts>
 typename conditional_iterator_proxy<Category, Ts...>::iterator conditional_iterator_proxy<Category, Ts...>::end() const
 {
+	if (m_indexed)
+		return iterator(*m_cat, m_rows, m_rows.size(), m_condition, mCix);
 	return iterator(*m_cat, mCEnd, m_condition, mCix);
 }
 
 template <typename Category, typename... Ts>
 bool conditional_iterator_proxy<Category, Ts...>::empty() const
 {
+	if (m_indexed)
+		return begin() == end();
 	return mCBegin == mCEnd;
 }
 
@@ -751,6 +851,8 @@ void conditional_iterator_proxy<Category, Ts...>::swap(conditional_iterator_prox
 	std::swap(mCBegin, rhs.mCBegin);
 	std::swap(mCEnd, rhs.mCEnd);
 	std::swap(mCix, rhs.mCix);
+	std::swap(m_indexed, rhs.m_indexed);
+	m_rows.swap(rhs.m_rows);
 }
 
 /** @endcond */
@@ -29,9 +29,12 @@
 #include "cif++/atom_type.hpp"
 #include "cif++/datablock.hpp"
 #include "cif++/point.hpp"
+#include "cif++/symmetry.hpp"
 
+#include <functional>
 #include <memory>
 #include <numeric>
+#include <span>
 
 #if __cpp_lib_format
 #include <format>
@@ -84,6 +87,21 @@ class atom
 {
   private:
 	/** @cond */
+
+	// The often used columns in atom_site. Each structure shares one set
+	// of these between its atoms, so the cached column indices are those
+	// of the structure's own atom_site category.
+	struct atom_columns
+	{
+		column_ref kTypeSymbol{ "type_symbol" }, kOccupancy{ "occupancy" },
+			kLabelAsymID{ "label_asym_id" }, kLabelSeqID{ "label_seq_id" }, kLabelAtomID{ "label_atom_id" },
+			kLabelAltID{ "label_alt_id" }, kLabelCompID{ "label_comp_id" }, kLabelEntityID{ "label_entity_id" },
+			kAuthAsymID{ "auth_asym_id" }, kAuthSeqID{ "auth_seq_id" }, kAuthAtomID{ "auth_atom_id" },
+			kAuthAltID{ "auth_alt_id" }, kAuthCompID{ "auth_comp_id" }, kPDBInsCode{ "pdbx_PDB_ins_code" };
+	};
+
+	using atom_column = column_ref atom_columns::*;
+
 	struct atom_impl : public std::enable_shared_from_this<atom_impl>
 	{
 		atom_impl(const datablock &db, std::string_view id)
@@ -96,6 +114,17 @@ class atom
 				tie(m_location.m_x, m_location.m_y, m_location.m_z) = r.get("Cartn_x", "Cartn_y", "Cartn_z");
 		}
 
+		// constructor for an atom whose row is already known
+		atom_impl(const datablock &db, const row_handle &r)
+			: m_db(db)
+			, m_cat(db["atom_site"])
+			, m_id(r["id"].as<std::string>())
+			, m_row(r.get_row())
+			, m_erase_serial(m_cat.erase_serial())
+		{
+			tie(m_location.m_x, m_location.m_y, m_location.m_z) = r.get("Cartn_x", "Cartn_y", "Cartn_z");
+		}
+
 		// constructor for a symmetry copy of an atom
 		atom_impl(const atom_impl &impl, const point &loc, const std::string &sym_op)
 			: atom_impl(impl)
@@ -116,41 +145,98 @@ class atom
 
 		void moveTo(const point &p);
 
+		// Move to @a p using the column indices of Cartn_x, Cartn_y and Cartn_z
+		void moveTo(const point &p, uint16_t x_ix, uint16_t y_ix, uint16_t z_ix);
+
 		// const compound *compound() const;
 
 		std::string get_property(std::string_view name) const;
 		int get_property_int(std::string_view name) const;
 		float get_property_float(std::string_view name) const;
 
+		std::string get_property(const column_ref &column) const;
+		int get_property_int(const column_ref &column) const;
+		float get_property_float(const column_ref &column) const;
+
+		// Atoms not owned by a structure have no column cache, for
+		// these the columns are looked up by name.
+		std::string get_property(atom_column column) const
+		{
+			return m_columns ? get_property(m_columns.get()->*column) : get_property(std::string_view{ (column_names().*column).name() });
+		}
+
+		int get_property_int(atom_column column) const
+		{
+			return m_columns ? get_property_int(m_columns.get()->*column) : get_property_int(std::string_view{ (column_names().*column).name() });
+		}
+
+		float get_property_float(atom_column column) const
+		{
+			return m_columns ? get_property_float(m_columns.get()->*column) : get_property_float(std::string_view{ (column_names().*column).name() });
+		}
+
+		// Only used for the names of the columns
+		static const atom_columns &column_names()
+		{
+			static const atom_columns s_column_names;
+			return s_column_names;
+		}
+
 		void set_property(const std::string_view name, const std::string &value);
 
 		row_handle row()
 		{
-			return m_cat[{ { "id", m_id } }];
+			return static_cast<const atom_impl *>(this)->row();
 		}
 
+		// The row is looked up once and cached, the cached row is
+		// valid as long as no rows were erased from the category.
 		const row_handle row() const
 		{
-			return m_cat[{ { "id", m_id } }];
+			if (m_row == nullptr or m_erase_serial != m_cat.erase_serial())
+			{
+				auto r = m_cat[{ { "id", m_id } }];
+				if (not r)
+					return {};
+
+				m_row = r.get_row();
+				m_erase_serial = m_cat.erase_serial();
+			}
+
+			return { m_cat, *m_row };
 		}
 
 		row_handle row_aniso()
 		{
-			auto cat = m_db.get("atom_site_anisotrop");
+			auto cat = cat_aniso();
 			return cat ? cat->operator[]({ { "id", m_id } }) : row_handle{};
 		}
 
 		const row_handle row_aniso() const
 		{
-			auto cat = m_db.get("atom_site_anisotrop");
+			auto cat = cat_aniso();
 			return cat ? cat->operator[]({ { "id", m_id } }) : row_handle{};
 		}
 
+		// Categories are stable in a datablock, so cache the pointer once found
+		const category *cat_aniso() const
+		{
+			if (m_cat_aniso == nullptr)
+				m_cat_aniso = m_db.get("atom_site_anisotrop");
+			return m_cat_aniso;
+		}
+
 		const datablock &m_db;
 		const category &m_cat;
+		mutable const category *m_cat_aniso = nullptr;
 		std::string m_id;
 		point m_location;
 		std::string m_symop = "1_555";
+
+		mutable const cif::row *m_row = nullptr;
+		mutable uint64_t m_erase_serial = 0;
+
+		std::shared_ptr<const atom_columns> m_columns;
 	};
 	/** @endcond */
 
@@ -185,7 +271,7 @@ class atom
 	 * @param row The row containing the data for this atom
 	 */
 	atom(const datablock &db, const row_handle &row)
-		: atom(std::make_shared<atom_impl>(db, row["id"].as<std::string>()))
+		: atom(std::make_shared<atom_impl>(db, row))
 	{
 	}
 
@@ -231,6 +317,30 @@ class atom
 		return m_impl->get_property_float(name);
 	}
 
+	/// \brief Return the field referenced by @a column in the _atom_site category for this atom
+	std::string get_property(const column_ref &column) const
+	{
+		if (not m_impl)
+			throw std::logic_error("Error trying to fetch a property from an uninitialized atom");
+		return m_impl->get_property(column);
+	}
+
+	/// \brief Return the field referenced by @a column in the _atom_site category for this atom cast to an int
+	int get_property_int(const column_ref &column) const
+	{
+		if (not m_impl)
+			throw std::logic_error("Error trying to fetch a property from an uninitialized atom");
+		return m_impl->get_property_int(column);
+	}
+
+	/// \brief Return the field referenced by @a column in the _atom_site category for this atom cast to a float
+	float get_property_float(const column_ref &column) const
+	{
+		if (not m_impl)
+			throw std::logic_error("Error trying to fetch a property from an uninitialized atom");
+		return m_impl->get_property_float(column);
+	}
+
 	/// \brief Set value for the field named @a name in the _atom_site category to @a value
 	void set_property(const std::string_view name, const std::string &value)
 	{
@@ -254,7 +364,7 @@ class atom
 	const std::string &id() const { return impl().m_id; }
 
 	/// \brief Return the type of the atom
-	cif::atom_type get_type() const { return atom_type_traits(get_property("type_symbol")).type(); }
+	cif::atom_type get_type() const { return atom_type_traits(get_property(&atom_columns::kTypeSymbol)).type(); }
 
 	/// \brief Return the cached location of this atom
 	point get_location() const { return impl().m_location; }
@@ -331,23 +441,23 @@ class atom
 	int get_charge() const { return impl().get_charge(); }
 
 	/// Return the occupancy
-	float get_occupancy() const { return get_property_float("occupancy"); }
+	float get_occupancy() const { return get_property_float(&atom_columns::kOccupancy); }
 
 	// specifications
 
-	std::string get_label_asym_id() const { return get_property("label_asym_id"); }     ///< Return the label_asym_id property
-	int get_label_seq_id() const { return get_property_int("label_seq_id"); }           ///< Return the label_seq_id property
-	std::string get_label_atom_id() const { return get_property("label_atom_id"); }     ///< Return the label_atom_id property
-	std::string get_label_alt_id() const { return get_property("label_alt_id"); }       ///< Return the label_alt_id property
-	std::string get_label_comp_id() const { return get_property("label_comp_id"); }     ///< Return the label_comp_id property
-	std::string get_label_entity_id() const { return get_property("label_entity_id"); } ///< Return the label_entity_id property
+	std::string get_label_asym_id() const { return get_property(&atom_columns::kLabelAsymID); }     ///< Return the label_asym_id property
+	int get_label_seq_id() const { return get_property_int(&atom_columns::kLabelSeqID); }           ///< Return the label_seq_id property
+	std::string get_label_atom_id() const { return get_property(&atom_columns::kLabelAtomID); }     ///< Return the label_atom_id property
+	std::string get_label_alt_id() const { return get_property(&atom_columns::kLabelAltID); }       ///< Return the label_alt_id property
+	std::string get_label_comp_id() const { return get_property(&atom_columns::kLabelCompID); }     ///< Return the label_comp_id property
+	std::string get_label_entity_id() const { return get_property(&atom_columns::kLabelEntityID); } ///< Return the label_entity_id property
 
-	std::string get_auth_asym_id() const { return get_property("auth_asym_id"); }      ///< Return the auth_asym_id property
-	std::string get_auth_seq_id() const { return get_property("auth_seq_id"); }        ///< Return the auth_seq_id property
-	std::string get_auth_atom_id() const { return get_property("auth_atom_id"); }      ///< Return the auth_atom_id property
-	std::string get_auth_alt_id() const { return get_property("auth_alt_id"); }        ///< Return the auth_alt_id property
-	std::string get_auth_comp_id() const { return get_property("auth_comp_id"); }      ///< Return the auth_comp_id property
-	std::string get_pdb_ins_code() const { return get_property("pdbx_PDB_ins_code"); } ///< Return the pdb_ins_code property
+	std::string get_auth_asym_id() const { return get_property(&atom_columns::kAuthAsymID); }   ///< Return the auth_asym_id property
+	std::string get_auth_seq_id() const { return get_property(&atom_columns::kAuthSeqID); }     ///< Return the auth_seq_id property
+	std::string get_auth_atom_id() const { return get_property(&atom_columns::kAuthAtomID); }   ///< Return the auth_atom_id property
+	std::string get_auth_alt_id() const { return get_property(&atom_columns::kAuthAltID); }     ///< Return the auth_alt_id property
+	std::string get_auth_comp_id() const { return get_property(&atom_columns::kAuthCompID); }   ///< Return the auth_comp_id property
+	std::string get_pdb_ins_code() const { return get_property(&atom_columns::kPDBInsCode); }   ///< Return the pdb_ins_code property
 
 	/// Return true if this atom is an alternate
 	bool is_alternate() const { return not get_label_alt_id().empty(); }
@@ -404,6 +514,21 @@ class atom
   private:
 	friend class structure;
 
+	std::string get_property(atom_column column) const
+	{
+		return impl().get_property(column);
+	}
+
+	int get_property_int(atom_column column) const
+	{
+		return impl().get_property_int(column);
+	}
+
+	float get_property_float(atom_column column) const
+	{
+		return impl().get_property_float(column);
+	}
+
 	const atom_impl &impl() const
 	{
 		if (not m_impl)
@@ -689,6 +814,10 @@ class polymer : public std::vector<monomer>
 	/// \brief Constructor
 	polymer(structure &s, const std::string &entityID, const std::string &asymID, const std::string &auth_asym_id);
 
+	/// \brief Constructor taking the already selected pdbx_poly_seq_scheme rows for this polymer
+	polymer(structure &s, const std::string &entityID, const std::string &asymID, const std::string &auth_asym_id,
+		const std::vector<row_handle> &poly_seq_scheme_rows);
+
 	polymer(const polymer &) = delete;
 	polymer &operator=(const polymer &) = delete;
 
@@ -786,6 +915,10 @@ class branch : public std::vector<sugar>
 	/// \brief constructor
 	branch(structure &structure, const std::string &asym_id, const std::string &entity_id);
 
+	/// \brief constructor taking the already selected pdbx_branch_scheme rows for this branch
+	branch(structure &structure, const std::string &asym_id, const std::string &entity_id,
+		const std::vector<row_handle> &branch_scheme_rows);
+
 	branch(const branch &) = delete;
 	branch &operator=(const branch &) = delete;
 
@@ -871,14 +1004,14 @@ class structure
 	structure(datablock &db, size_t modelNr = 1, StructureOpenOptions options = {});
 
 	/** @cond */
-	structure(structure &&s) = default;
+	structure(structure &&s);
 	/** @endcond */
 
 	// structures cannot be copied.
 
 	structure(const structure &) = delete;
 	structure &operator=(const structure &) = delete;
-	~structure() = default;
+	~structure();
 
 	/// \brief Return the model number
 	size_t get_model_nr() const { return m_model_nr; }
@@ -890,7 +1023,11 @@ class structure
 	EntityType get_entity_type_for_asym_id(const std::string asymID) const;     ///< Return the entity type for the asym with id @a asym_id
 
 	const std::list<polymer> &polymers() const { return m_polymers; } ///< Return the list of polymers
-	std::list<polymer> &polymers() { return m_polymers; }             ///< Return the list of polymers
+
+	/// \brief Return the list of polymers. Residues added or removed through
+	/// this reference are noticed by the residue lookups, residues changed in
+	/// place are not.
+	std::list<polymer> &polymers() { return m_polymers; }
 
 	polymer &get_polymer_by_asym_id(const std::string &asymID);            ///< Return the polymer having asym ID @a asymID
 	const polymer &get_polymer_by_asym_id(const std::string &asymID) const ///< Return the polymer having asym ID @a asymID
@@ -899,7 +1036,10 @@ class structure
 	}
 
 	const std::list<branch> &branches() const { return m_branches; } ///< Return the list of all branches
-	std::list<branch> &branches() { return m_branches; }             ///< Return the list of all branches
+
+	/// \brief Return the list of all branches, see polymers() for the effect
+	/// this has on the residue lookups
+	std::list<branch> &branches() { return m_branches; }
 
 	branch &get_branch_by_asym_id(const std::string &asymID);             ///< Return the branch having asym ID @a asymID
 	const branch &get_branch_by_asym_id(const std::string &asymID) const; ///< Return the branch having asym ID @a asymID
@@ -909,7 +1049,10 @@ class structure
 	bool has_atom_id(const std::string &id) const;    ///< Return true if an atom with ID @a id exists in this structure
 	atom get_atom_by_id(const std::string &id) const; ///< Return the atom with ID @a id
 
-	/// \brief Return the atom identified by the label_ values specified
+	/// \brief Return the atom identified by the label_ values specified.
+	/// Throws std::out_of_range if there is no such atom. Atoms relabeled
+	/// directly with atom::set_property may not be found by their new label,
+	/// use swap_atoms or change_residue instead.
 	atom get_atom_by_label(const std::string &atomID, const std::string &asymID,
 		const std::string &compID, int seqID, const std::string &altID = "");
 
@@ -919,6 +1062,33 @@ class structure
 	/// \brief Return the atom closest to point \a p with atom type \a type in a residue of type \a res_type
 	atom get_atom_by_position_and_type(point p, std::string_view type, std::string_view res_type) const;
 
+	/// \brief Predicate used to select atoms in the spatial queries below
+	using atom_filter = std::function<bool(const atom &)>;
+
+	/**
+	 * @brief Return the atoms within distance \a radius of point \a p,
+	 * sorted by distance. If \a filter is specified only the atoms for
+	 * which it returns true are considered, e.g. to select on element
+	 * or residue type.
+	 *
+	 * These queries use a spatial index that is built on first use. The
+	 * index is rebuilt when atoms were moved since, move_atom updates it
+	 * in place.
+	 */
+	std::vector<atom> get_atoms_near(point p, float radius, const atom_filter &filter = {}) const;
+
+	/// \brief Return at most \a k atoms closest to point \a p sorted by distance,
+	/// optionally only those for which \a filter returns true
+	std::vector<atom> get_nearest_atoms(point p, size_t k, const atom_filter &filter = {}) const;
+
+	/**
+	 * @brief Return the crystal contacts in this structure for crystal \a c,
+	 * i.e. all pairs of an atom and a symmetry copy of an atom within
+	 * \a max_distance of each other. The second atom in each pair is the
+	 * symmetry copy. See crystal::find_symmetry_contacts for details.
+	 */
+	std::vector<std::pair<atom, atom>> get_symmetry_contacts(const crystal &c, float max_distance) const;
+
 	/// \brief Create a non-poly residue based on atoms already present in this structure.
 	residue &create_residue(const std::vector<atom> &atoms);
 
@@ -1063,6 +1233,23 @@ class structure
 	/// \brief Translate, rotate and translate again the coordinates of all atoms in the structure by \a t1 , \a q and \a t2
 	void translate_rotate_and_translate(point t1, quaternion q, point t2);
 
+	/**
+	 * \brief Return the locations of all atoms as one contiguous array, in the
+	 * same order as atoms() returns them.
+	 *
+	 * Use this together with set_locations in code that moves atoms many
+	 * times, e.g. in refinement: change the locations in the array and write
+	 * them back once. That avoids formatting the Cartn_x/y/z fields in
+	 * atom_site on every step.
+	 */
+	std::vector<point> get_locations() const;
+
+	/// \brief Set the locations of all atoms at once, \a locations should
+	/// contain a location for each atom in the same order as atoms() returns them.
+	/// This is faster than setting the location of each atom separately, only
+	/// atoms that actually moved are updated.
+	void set_locations(std::span<const point> locations);
+
 	/// \brief Remove all categories that have no rows left
 	void cleanup_empty_categories();
 
@@ -1094,6 +1281,7 @@ class structure
   private:
 	friend polymer;
 	friend residue;
+	friend branch;
 
 	void load_atoms_for_model(StructureOpenOptions options);
 
@@ -1106,6 +1294,39 @@ class structure
 	void remove_atom(atom &a, bool removeFromResidue);
 	void remove_sugar(sugar &sugar);
 
+	// Hash indexes for the residue, polymer and branch lookups and for the
+	// atom label lookups. They are built on first use and updated by the
+	// methods that add, remove or rename residues and atoms: call unindex_
+	// before such a change and index_ after it.
+	struct residue_index;
+	struct atom_label_index;
+
+	residue_index &get_residue_index() const;
+	residue_index *validate_residue_index() const;
+	void residue_index_updated();
+	void unindex_residue(const residue &res);
+	void index_residue(residue &res);
+	void unindex_polymer(const polymer &poly);
+	void index_polymer(polymer &poly);
+	void unindex_branch(const branch &branch);
+	void index_branch(branch &branch);
+	void unindex_non_polymers(size_t from);
+	void index_non_polymers(size_t from);
+
+	atom_label_index &get_atom_label_index() const;
+	void unindex_atom(const atom &a);
+	void index_atom(const atom &a);
+
+	void invalidate_indexes();
+
+	// Uniform grid over the atom locations, for the position based queries
+	struct spatial_index;
+
+	spatial_index &get_spatial_index() const;
+	uint64_t get_location_serial() const;
+	bool has_valid_spatial_index() const;
+	std::vector<std::pair<float, size_t>> find_atoms_near(point p, float radius, const atom_filter &filter) const;
+
 	datablock &m_db;
 	size_t m_model_nr;
 	std::vector<atom> m_atoms;
@@ -1113,6 +1334,12 @@ class structure
 	std::list<polymer> m_polymers;
 	std::list<branch> m_branches;
 	std::vector<residue> m_non_polymers;
+	mutable std::unique_ptr<residue_index> m_residue_index;
+	mutable std::unique_ptr<atom_label_index> m_atom_label_index;
+	mutable std::unique_ptr<spatial_index> m_spatial_index;
+
+	// The column index cache shared by all atoms in this structure
+	std::shared_ptr<const atom::atom_columns> m_atom_columns = std::make_shared<atom::atom_columns>();
 };
 
 // --------------------------------------------------------------------
@@ -0,0 +1,115 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 NKI/AVL, Netherlands Cancer Institute
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "cif++/exports.hpp"
+
+#include <memory>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+
+/**
+ * @file pattern.hpp
+ *
+ * This file contains the class cif::pattern, a regular expression that
+ * is matched against complete strings. Simple expressions, those
+ * consisting of characters, character classes and quantifiers only,
+ * are compiled into a bit parallel automaton that is much faster than
+ * std::regex. Other expressions are handled by std::regex.
+ *
+ * @code {.cpp}
+ * cif::pattern p("[A-Z]{3}[0-9]+");
+ *
+ * assert(p.match("ALA12"));
+ * @endcode
+ */
+
+namespace cif
+{
+
+/**
+ * @brief A regular expression that always matches the complete text,
+ * like std::regex_match does.
+ *
+ * Objects of this class are immutable and cheap to copy, they can be
+ * used concurrently from multiple threads.
+ */
+
+class pattern
+{
+  public:
+	/// @brief The syntax used in the expression
+	enum class syntax
+	{
+		ecmascript, ///< The default syntax for std::regex
+		extended    ///< The POSIX extended syntax, as used in mmCIF dictionaries
+	};
+
+	/**
+	 * @brief Construct a new pattern object for expression @a rx
+	 *
+	 * @param rx The regular expression
+	 * @param icase If true, the match is case insensitive
+	 * @param s The syntax of the expression in @a rx
+	 */
+	explicit pattern(std::string_view rx, bool icase = false, syntax s = syntax::ecmascript);
+
+	/**
+	 * @brief Construct a new pattern object using an already compiled
+	 * std::regex. Matching is done by std::regex_match in this case.
+	 */
+	pattern(const std::regex &rx);
+
+	/**
+	 * @brief Return a pattern for expression @a rx only if it can be
+	 * compiled into the fast matcher, std::nullopt otherwise. No std::regex
+	 * is constructed in either case.
+	 */
+	static std::optional<pattern> simple(std::string_view rx, bool icase = false, syntax s = syntax::ecmascript);
+
+	/// @brief Return true if the complete @a text matches this pattern
+	bool match(std::string_view text) const;
+
+	/// @brief Return true if the expression could be compiled into the fast matcher
+	bool is_simple() const;
+
+	/// @brief Return the expression this pattern was created from, empty if
+	/// it was constructed from a std::regex
+	const std::string &str() const { return m_str; }
+
+  private:
+	struct pattern_impl;
+
+	pattern(std::string_view rx, std::shared_ptr<const pattern_impl> impl);
+
+	std::string m_str;
+	std::shared_ptr<const pattern_impl> m_impl;
+};
+
+} // namespace cif
@@ -29,6 +29,7 @@
 #include "cif++/item.hpp"
 
 #include <array>
+#include <atomic>
 
 /**
  * @file row.hpp
@@ -71,6 +72,17 @@
  * const auto &[name, x, y, z] = rh.get<std::string,float,float,float>("label_atom_id", "cartn_x", "cartn_y", "cartn_z");
  * @endcode
  * 
+ * In tight loops, the lookup of the column index by name can be avoided
+ * by using a cif::column_ref instead of a name. A column_ref caches the
+ * index of the column for the category it was last used with:
+ * 
+ * @code {.cpp}
+ * const cif::column_ref kX("cartn_x"), kY("cartn_y"), kZ("cartn_z");
+ * 
+ * for (auto rh : atom_site)
+ *   const auto &[x, y, z] = rh.get<float,float,float>(kX, kY, kZ);
+ * @endcode
+ * 
  * 
  * 
  */
@@ -197,6 +209,75 @@ class row : public std::vector<item_value>
 	row *m_next = nullptr;
 };
 
+// --------------------------------------------------------------------
+/**
+ * @brief A column_ref is a reference to a column by name that caches the
+ * index of that column in the category it was last resolved against.
+ * 
+ * Accessing a column by name requires a case-insensitive search through
+ * the list of columns of a category. Using a column_ref, this search is
+ * done only once per category. A column_ref can be used everywhere a
+ * column name is accepted in row_handle::operator[], row_handle::get,
+ * category::rows and category::find.
+ * 
+ * The cache is updated atomically, so a single column_ref can be shared
+ * between threads.
+ */
+
+class column_ref
+{
+  public:
+	/// \brief constructor taking the name of the column @a name
+	explicit column_ref(std::string_view name)
+		: m_name(name)
+	{
+	}
+
+	/// \brief constructor taking the name of the column @a name
+	explicit column_ref(const char *name)
+		: m_name(name)
+	{
+	}
+
+	/** @cond */
+	column_ref(const column_ref &rhs)
+		: m_name(rhs.m_name)
+		, m_cache(rhs.m_cache.load(std::memory_order_relaxed))
+	{
+	}
+
+	column_ref &operator=(const column_ref &rhs)
+	{
+		if (this != &rhs)
+		{
+			m_name = rhs.m_name;
+			m_cache.store(rhs.m_cache.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+		return *this;
+	}
+	/** @endcond */
+
+	/// \brief return the name of the column
+	const std::string &name() const { return m_name; }
+
+	/// \brief return the index of this column in category @a cat, the
+	/// result is equal to the number of columns in @a cat if the column
+	/// does not exist (yet).
+	uint16_t index(const category &cat) const;
+
+	/// \brief return the index of this column in category @a cat,
+	/// adding the column if it does not exist yet.
+	uint16_t add_to(category &cat) const;
+
+  private:
+	// The cache contains the column serial of the category in the
+	// upper 48 bits and the column index in the lower 16 bits.
+	static constexpr uint64_t kNoCache = 0;
+
+	std::string m_name;
+	mutable std::atomic<uint64_t> m_cache = kNoCache;
+};
+
 // --------------------------------------------------------------------
 /// \brief row_handle is the way to access data stored in rows
 
@@ -268,17 +349,29 @@ class row_handle
 		return empty() ? item_handle::s_null_item : item_handle(get_column_ix(column_name), const_cast<row_handle &>(*this));
 	}
 
+	/// \brief return a cif::item_handle to the item in the column referenced by @a column
+	item_handle operator[](const column_ref &column)
+	{
+		return empty() ? item_handle::s_null_item : item_handle(column.add_to(*m_category), *this);
+	}
+
+	/// \brief return a const cif::item_handle to the item in the column referenced by @a column
+	const item_handle operator[](const column_ref &column) const
+	{
+		return empty() ? item_handle::s_null_item : item_handle(column.index(*m_category), const_cast<row_handle &>(*this));
+	}
+
 	/// \brief Return an object that can be used in combination with cif::tie
 	/// to assign the values for the columns @a columns
 	template <typename... C>
-	auto get(C... columns) const
+	auto get(const C &...columns) const
 	{
 		return detail::get_row_result<C...>(*this, { get_column_ix(columns)... });
 	}
 
 	/// \brief Return a tuple of values of types @a Ts for the columns @a columns
 	template <typename... Ts, typename... C, std::enable_if_t<sizeof...(Ts) == sizeof...(C) and sizeof...(C) != 1, int> = 0>
-	std::tuple<Ts...> get(C... columns) const
+	std::tuple<Ts...> get(const C &...columns) const
 	{
 		return detail::get_row_result<Ts...>(*this, { get_column_ix(columns)... });
 	}
@@ -290,6 +383,13 @@ class row_handle
 		return operator[](get_column_ix(column)).template as<T>();
 	}
 
+	/// \brief Get the value of column @a column cast to type @a T
+	template <typename T>
+	T get(const column_ref &column) const
+	{
+		return operator[](get_column_ix(column)).template as<T>();
+	}
+
 	/// \brief assign each of the columns named in @a values to their respective value
 	void assign(const std::vector<item> &values)
 	{
@@ -332,22 +432,33 @@ class row_handle
 	/// \brief compare two rows
 	bool operator!=(const row_handle &rhs) const { return m_category != rhs.m_category or m_row != rhs.m_row; }
 
-  private:
-	uint16_t get_column_ix(std::string_view name) const;
-	std::string_view get_column_name(uint16_t ix) const;
-
-	uint16_t add_column(std::string_view name);
-
+	/// \brief Return the row this handle refers to. A row stays valid
+	/// as long as category::erase_serial of its category does not change.
 	row *get_row()
 	{
 		return m_row;
 	}
 
+	/// \brief Return the row this handle refers to
 	const row *get_row() const
 	{
 		return m_row;
 	}
 
+  private:
+	uint16_t get_column_ix(std::string_view name) const;
+	std::string_view get_column_name(uint16_t ix) const;
+
+	uint16_t get_column_ix(const column_ref &column) const
+	{
+		if (not m_category)
+			throw std::runtime_error("uninitialized row");
+
+		return column.index(*m_category);
+	}
+
+	uint16_t add_column(std::string_view name);
+
 	void assign(const item &i, bool updateLinked)
 	{
 		assign(i.name(), i.value(), updateLinked);
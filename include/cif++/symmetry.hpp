@@ -32,7 +32,9 @@
 
 #include <array>
 #include <cstdint>
+#include <span>
 #include <string>
+#include <vector>
 
 #if defined(__cpp_impl_three_way_comparison)
 #include <compare>
@@ -457,6 +459,21 @@ class spacegroup : public std::vector<transformation>
 
 	point operator()(const point &pt, const cell &c, sym_op symop) const;
 
+	/** \brief perform a spacegroup operation in place on all points in @a pts
+	 * using cell @a c and sym_op @a symop
+	 *
+	 * The result is the same as calling the single point version for each
+	 * point, but the cell matrices and the transformation are combined into
+	 * a single affine transformation first.
+	 */
+	void operator()(std::span<point> pts, const cell &c, sym_op symop) const;
+
+	/** \brief perform a spacegroup operation in place on the points stored
+	 * as separate coordinate arrays @a x, @a y and @a z using cell @a c and
+	 * sym_op @a symop. The arrays should be of equal length.
+	 */
+	void operator()(std::span<float> x, std::span<float> y, std::span<float> z, const cell &c, sym_op symop) const;
+
 	/** \brief perform an inverse spacegroup operation on point @a pt using
 	 * cell @a c and sym_op @a symop
 	 */
@@ -467,6 +484,20 @@ class spacegroup : public std::vector<transformation>
 	size_t m_index;
 };
 
+// --------------------------------------------------------------------
+/**
+ * @brief A contact between point a and the symmetry copy of point b,
+ * as found by crystal::find_symmetry_contacts
+ */
+struct symmetry_contact
+{
+	size_t m_a;       ///< The index of the first point
+	size_t m_b;       ///< The index of the point that was copied
+	sym_op m_symop;   ///< The symmetry operator applied to point b
+	point m_location; ///< The location of the symmetry copy of point b
+	float m_distance; ///< The distance between point a and the copy of point b
+};
+
 // --------------------------------------------------------------------
 /**
  * @brief A crystal combines a cell and a spacegroup.
@@ -508,6 +539,14 @@ class crystal
 		return m_spacegroup(pt, m_cell, symop);
 	}
 
+	/// \brief Return the symmetry copies of the points in @a pts using symmetry operation @a symop
+	std::vector<point> symmetry_copy(std::span<const point> pts, sym_op symop) const
+	{
+		std::vector<point> result(pts.begin(), pts.end());
+		m_spacegroup(std::span<point>(result), m_cell, symop);
+		return result;
+	}
+
 	/// \brief Return the symmetry copy of point @a pt using the inverse of symmetry operation @a symop
 	point inverse_symmetry_copy(const point &pt, sym_op symop) const
 	{
@@ -518,6 +557,24 @@ class crystal
 	/// for the point @a b with respect to point @a a.
 	std::tuple<float, point, sym_op> closest_symmetry_copy(point a, point b) const;
 
+	/**
+	 * @brief Find all contacts between the points in @a locations and the
+	 * symmetry copies of these points in the crystal lattice.
+	 *
+	 * A contact is reported when the symmetry copy of point b is within
+	 * @a max_distance of point a. All operators of the spacegroup combined
+	 * with the translations to neighbouring cells are tried, except the
+	 * identity 1_555. Since each contact is found from both sides, each
+	 * will be reported twice with different symmetry operators.
+	 *
+	 * The candidates are pruned using a cell list in fractional space.
+	 *
+	 * @param locations The points, usually the atom locations of a structure
+	 * @param max_distance The cutoff distance
+	 * @return The contacts sorted by a, b and symmetry operator
+	 */
+	std::vector<symmetry_contact> find_symmetry_contacts(const std::vector<point> &locations, float max_distance) const;
+
   private:
 	cell m_cell;
 	spacegroup m_spacegroup;
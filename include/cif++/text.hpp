@@ -34,7 +34,9 @@
 #include <limits>
 #include <set>
 #include <sstream>
+#include <string_view>
 #include <tuple>
+#include <unordered_set>
 #include <vector>
 
 #if __has_include(<experimental/type_traits>)
@@ -315,6 +317,44 @@ inline char tolower(int ch)
 	return static_cast<char>(kCharToLowerMap[static_cast<uint8_t>(ch)]);
 }
 
+/// \brief a hash function object for strings that ignores character case,
+/// to be used together with iequal_to in unordered containers.
+/// Supports heterogeneous lookup with std::string_view.
+struct ihash
+{
+	/// \brief mark this as a transparent hash
+	using is_transparent = void;
+
+	/// \brief return a FNV-1a hash of the lower case version of @a s
+	size_t operator()(std::string_view s) const noexcept
+	{
+		uint64_t h = 14695981039346656037ULL;
+		for (char ch : s)
+		{
+			h ^= static_cast<uint8_t>(tolower(ch));
+			h *= 1099511628211ULL;
+		}
+		return static_cast<size_t>(h);
+	}
+};
+
+/// \brief an equality operator object that ignores character case
+struct iequal_to
+{
+	/// \brief mark this as a transparent comparator
+	using is_transparent = void;
+
+	/// \brief return the result of iequals for @a a and @a b
+	bool operator()(std::string_view a, std::string_view b) const
+	{
+		return iequals(a, b);
+	}
+};
+
+/// ihash_set is a std::unordered_set of std::string ignoring character
+/// case. Lookups can be done using std::string_view without allocation.
+using ihash_set = std::unordered_set<std::string, ihash, iequal_to>;
+
 // --------------------------------------------------------------------
 
 /** \brief return a tuple consisting of the category and item name for @a tag
@@ -608,4 +648,21 @@ using from_chars_function = decltype(std::from_chars(std::declval<const char *>(
 template <typename T>
 using selected_charconv = typename std::conditional_t<std_experimental::is_detected_v<from_chars_function, T>, std_charconv<T>, my_charconv<T>>;
 
+/**
+ * @brief Format @a value in fixed notation with @a precision digits after
+ * the decimal point, like printf("%.*f") does.
+ *
+ * This is a lot faster than std::to_chars for the typical values found in
+ * mmCIF files, like coordinates and B-factors. Values that cannot be
+ * handled quickly are passed on to std::to_chars, the result is always the
+ * same.
+ *
+ * @param first Start of the output buffer
+ * @param last End of the output buffer
+ * @param value The value to format
+ * @param precision The number of digits after the decimal point
+ * @return std::to_chars_result The result, like std::to_chars
+ */
+std::to_chars_result to_chars_fixed(char *first, char *last, double value, int precision);
+
 } // namespace cif
\ No newline at end of file
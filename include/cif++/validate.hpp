@@ -28,9 +28,14 @@
 
 #include "cif++/text.hpp"
 
+#include <atomic>
 #include <filesystem>
+#include <future>
 #include <list>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <unordered_map>
 #include <utility>
 
 /**
@@ -101,6 +106,7 @@ struct type_validator
 {
 	std::string m_name;                 ///< The name of the type
 	DDL_PrimitiveType m_primitive_type; ///< The primitive_type of the type
+	std::string m_expression;           ///< The regular expression for the type, as text
 	regex_impl *m_rx;                   ///< The regular expression for the type
 
 	type_validator() = delete;
@@ -114,6 +120,7 @@ struct type_validator
 	type_validator(type_validator &&rhs)
 		: m_name(std::move(rhs.m_name))
 		, m_primitive_type(rhs.m_primitive_type)
+		, m_expression(std::move(rhs.m_expression))
 	{
 		m_rx = std::exchange(rhs.m_rx, nullptr);
 	}
@@ -125,7 +132,8 @@ struct type_validator
 	{
 		m_name = std::move(rhs.m_name);
 		m_primitive_type = rhs.m_primitive_type;
-		m_rx = std::exchange(rhs.m_rx, nullptr);
+		m_expression = std::move(rhs.m_expression);
+		std::swap(m_rx, rhs.m_rx);
 
 		return *this;
 	}
@@ -139,6 +147,9 @@ struct type_validator
 		return icompare(m_name, rhs.m_name) < 0;
 	}
 
+	/// @brief Return true if @a value conforms to the expression of this type
+	bool match(std::string_view value) const;
+
 	/// @brief Compare the contents of @a a and @a b based on the
 	/// primitive type of this type. A value of zero indicates the
 	/// values are equal. Less than zero means @a a sorts before @a b
@@ -160,7 +171,7 @@ struct item_validator
 	std::string m_tag;                        ///< The item name
 	bool m_mandatory;                         ///< Flag indicating this item is mandatory
 	const type_validator *m_type;             ///< The type for this item
-	cif::iset m_enums;                        ///< If filled, the set of allowed values
+	cif::ihash_set m_enums;                   ///< If filled, the set of allowed values
 	std::string m_default;                    ///< If filled, a default value for this item
 	category_validator *m_category = nullptr; ///< The category_validator this item_validator belongs to
 
@@ -292,6 +303,15 @@ class validator
 	const std::string &version() const { return m_version; }              ///< Get the version of this validator
 	void set_version(const std::string &version) { m_version = version; } ///< Set the version of this validator
 
+	/// @brief Write this validator in a compact binary format to @a os,
+	/// the result can be read back using load_binary.
+	void save_binary(std::ostream &os) const;
+
+	/// @brief Read a validator written by save_binary from @a is. Throws
+	/// a std::runtime_error if the data is invalid or was written using
+	/// a different format version.
+	static validator load_binary(std::istream &is);
+
   private:
 	// name is fully qualified here:
 	item_validator *get_validator_for_item(std::string_view name) const;
@@ -306,6 +326,33 @@ class validator
 
 // --------------------------------------------------------------------
 
+/// @cond
+namespace detail
+{
+	/**
+	 * @brief While an object of this class exists, the messages passed
+	 * to validator::report_error in the current thread are collected in
+	 * m_reports instead of being reported. This is used by the parallel
+	 * validation code to report errors in a deterministic order.
+	 */
+	struct report_collector
+	{
+		report_collector();
+		~report_collector();
+
+		report_collector(const report_collector &) = delete;
+		report_collector &operator=(const report_collector &) = delete;
+
+		/// The collected messages along with their fatal flag
+		std::vector<std::pair<std::string, bool>> m_reports;
+
+		report_collector *m_previous;
+	};
+} // namespace detail
+/// @endcond
+
+// --------------------------------------------------------------------
+
 /**
  * @brief Validators are globally unique objects, use the validator_factory
  * class to construct them. This class is a singleton.
@@ -318,18 +365,49 @@ class validator_factory
 	static validator_factory &instance();
 
 	/// @brief Return the validator with name @a dictionary_name
+	///
+	/// Looking up a validator that was loaded before does not take a lock.
+	/// If the dictionary still needs to be loaded, concurrent requests for
+	/// the same dictionary wait for a single thread doing the parsing.
 	const validator &operator[](std::string_view dictionary_name);
 
 	/// @brief Construct a new validator with name @a name from the data in @a is
+	///
+	/// If a cache directory is set, a binary copy of the parsed dictionary is
+	/// stored there and used instead of parsing the same dictionary again.
 	const validator &construct_validator(std::string_view name, std::istream &is);
 
+	/// @brief Set the directory used to cache parsed dictionaries to @a dir.
+	/// The default is the value of the LIBCIFPP_DICT_CACHE_DIR environment
+	/// variable, if set. An empty path disables caching.
+	void set_cache_directory(const std::filesystem::path &dir);
+
   private:
 	// --------------------------------------------------------------------
 
-	validator_factory() = default;
+	validator_factory();
+
+	using validator_map = std::unordered_map<std::string, const validator *, ihash, iequal_to>;
+
+	// Lookup without taking a lock, returns nullptr if not loaded yet
+	const validator *find(std::string_view dictionary_name) const;
+
+	// Locate the dictionary named @a dictionary_name and parse it
+	validator load(std::string_view dictionary_name);
+
+	// Parse the dictionary in @a is, using the cache if possible
+	validator parse(std::string_view name, std::istream &is);
+
+	// Store @a v and publish a new validator_map containing it, also under
+	// the name @a alias if that is not empty. Must be called with m_mutex locked.
+	const validator &add(validator &&v, std::string_view alias);
 
 	std::mutex m_mutex;
 	std::list<validator> m_validators;
+	std::atomic<const validator_map *> m_validator_map = nullptr;
+	std::vector<std::unique_ptr<validator_map>> m_validator_maps;
+	std::map<std::string, std::shared_future<const validator *>, iless> m_loading;
+	std::filesystem::path m_cache_dir;
 };
 
 } // namespace cif
@@ -0,0 +1,561 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 NKI/AVL, Netherlands Cancer Institute
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "cif++/assembly.hpp"
+#include "cif++/text.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <map>
+#include <optional>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace cif::mm
+{
+
+// --------------------------------------------------------------------
+
+namespace
+{
+	std::vector<std::string> parse_oper_list(std::string_view list)
+	{
+		std::vector<std::string> result;
+
+		for (auto item : cif::split<std::string_view>(list, ","))
+		{
+			if (item.empty())
+				throw std::runtime_error("Empty operator in oper_expression");
+
+			auto dash = item.find('-');
+			if (dash == std::string_view::npos)
+			{
+				result.emplace_back(item);
+				continue;
+			}
+
+			auto a = item.substr(0, dash), b = item.substr(dash + 1);
+
+			int first, last;
+			auto ra = std::from_chars(a.data(), a.data() + a.length(), first);
+			auto rb = std::from_chars(b.data(), b.data() + b.length(), last);
+
+			if (ra.ec != std::errc() or ra.ptr != a.data() + a.length() or
+				rb.ec != std::errc() or rb.ptr != b.data() + b.length() or first > last)
+			{
+				throw std::runtime_error("Invalid range " + std::string{ item } + " in oper_expression");
+			}
+
+			for (int i = first; i <= last; ++i)
+				result.emplace_back(std::to_string(i));
+		}
+
+		return result;
+	}
+} // namespace
+
+std::vector<std::vector<std::string>> parse_oper_expression(std::string_view expr)
+{
+	std::string s;
+	for (char ch : expr)
+	{
+		if (not std::isspace(static_cast<unsigned char>(ch)))
+			s += ch;
+	}
+
+	if (s.empty())
+		throw std::runtime_error("Empty oper_expression");
+
+	std::vector<std::vector<std::string>> groups;
+
+	if (s.front() == '(')
+	{
+		for (std::string::size_type pos = 0; pos < s.length();)
+		{
+			auto close = s.find(')', pos);
+			if (s[pos] != '(' or close == std::string::npos)
+				throw std::runtime_error("Invalid oper_expression " + std::string{ expr });
+
+			groups.emplace_back(parse_oper_list(std::string_view(s).substr(pos + 1, close - pos - 1)));
+			pos = close + 1;
+		}
+	}
+	else
+		groups.emplace_back(parse_oper_list(s));
+
+	// The Cartesian product of the groups
+	std::vector<std::vector<std::string>> result{ {} };
+	for (auto &group : groups)
+	{
+		std::vector<std::vector<std::string>> next;
+		next.reserve(result.size() * group.size());
+
+		for (auto &r : result)
+		{
+			for (auto &id : group)
+			{
+				auto &c = next.emplace_back(r);
+				c.emplace_back(id);
+			}
+		}
+
+		std::swap(result, next);
+	}
+
+	return result;
+}
+
+// --------------------------------------------------------------------
+
+std::vector<assembly_operation> get_assembly_operations(const datablock &db, std::string_view assembly_id)
+{
+	using namespace literals;
+
+	struct oper
+	{
+		transformation m_transformation;
+		bool m_identity;
+	};
+
+	std::map<std::string, oper> opers;
+
+	for (auto r : db["pdbx_struct_oper_list"])
+	{
+		matrix3x3<float> m;
+		point v;
+		bool identity = true;
+
+		for (size_t i = 0; i < 3; ++i)
+		{
+			for (size_t j = 0; j < 3; ++j)
+			{
+				m(i, j) = r["matrix[" + std::to_string(i + 1) + "][" + std::to_string(j + 1) + "]"].as<float>();
+				if (std::abs(m(i, j) - (i == j ? 1 : 0)) > 1e-6f)
+					identity = false;
+			}
+		}
+
+		v.m_x = r["vector[1]"].as<float>();
+		v.m_y = r["vector[2]"].as<float>();
+		v.m_z = r["vector[3]"].as<float>();
+
+		if (std::abs(v.m_x) > 1e-6f or std::abs(v.m_y) > 1e-6f or std::abs(v.m_z) > 1e-6f)
+			identity = false;
+
+		opers.emplace(r["id"].as<std::string>(), oper{ transformation(m, v), identity });
+	}
+
+	std::vector<assembly_operation> result;
+
+	for (const auto &[expression, asym_id_list] : db["pdbx_struct_assembly_gen"].find<std::string, std::string>(
+			 "assembly_id"_key == std::string{ assembly_id }, "oper_expression", "asym_id_list"))
+	{
+		std::vector<std::string> asym_ids;
+		for (auto asym_id : cif::split<std::string>(asym_id_list, ",", true))
+		{
+			trim(asym_id);
+			asym_ids.emplace_back(std::move(asym_id));
+		}
+
+		for (auto &combination : parse_oper_expression(expression))
+		{
+			std::string name;
+			std::optional<transformation> t;
+			bool identity = true;
+
+			for (auto &id : combination)
+			{
+				auto i = opers.find(id);
+				if (i == opers.end())
+					throw std::runtime_error("Operator " + id + " not found in pdbx_struct_oper_list");
+
+				if (not name.empty())
+					name += 'x';
+				name += id;
+
+				t = t ? *t * i->second.m_transformation : i->second.m_transformation;
+				identity = identity and i->second.m_identity;
+			}
+
+			result.push_back({ name, *t, asym_ids, identity });
+		}
+	}
+
+	if (result.empty())
+		throw std::runtime_error("Assembly " + std::string{ assembly_id } + " not found");
+
+	return result;
+}
+
+// --------------------------------------------------------------------
+
+namespace
+{
+	// A category that is rebuilt for the assembly
+	struct asym_category
+	{
+		// The columns containing asym ids, a row is copied by an operation
+		// only if all of these refer to asyms the operation applies to
+		std::vector<std::string> m_keys;
+
+		// The columns that are renamed for copies
+		std::vector<std::string> m_renamed;
+
+		// A column that should remain unique, it gets the same suffix
+		std::string m_id = {};
+	};
+
+	const std::map<std::string, asym_category, std::less<>> kAsymCategories{
+		{ "atom_site", { { "label_asym_id" }, { "label_asym_id", "auth_asym_id" } } },
+		{ "atom_site_anisotrop", { { "pdbx_label_asym_id" }, { "pdbx_label_asym_id", "pdbx_auth_asym_id" } } },
+		{ "struct_asym", { { "id" }, { "id" } } },
+		{ "pdbx_poly_seq_scheme", { { "asym_id" }, { "asym_id", "pdb_strand_id" } } },
+		{ "pdbx_nonpoly_scheme", { { "asym_id" }, { "asym_id", "pdb_strand_id" } } },
+		{ "pdbx_branch_scheme", { { "asym_id" }, { "asym_id", "pdb_asym_id", "auth_asym_id" } } },
+		{ "struct_conn", { { "ptnr1_label_asym_id", "ptnr2_label_asym_id" },
+							 { "ptnr1_label_asym_id", "ptnr1_auth_asym_id", "ptnr2_label_asym_id", "ptnr2_auth_asym_id" }, "id" } }
+	};
+
+	// The atom_site and atom_site_anisotrop rows are built together
+	bool is_atom_category(std::string_view name)
+	{
+		return name == "atom_site" or name == "atom_site_anisotrop";
+	}
+
+	// Coordinates are written with three digits after the decimal point
+	void set_coordinate(row_initializer &ri, std::string_view name, float v)
+	{
+		char buffer[32];
+		auto [ptr, ec] = cif::to_chars_fixed(buffer, buffer + sizeof(buffer), v, 3);
+		if (ec != std::errc())
+			throw std::runtime_error("Could not format coordinate");
+		ri.set_value(name, { buffer, static_cast<size_t>(ptr - buffer) });
+	}
+
+	// Copy row r for operation op, renaming the asym ids
+	row_initializer copy_row(row_handle r, const assembly_operation &op, const asym_category &ac)
+	{
+		row_initializer ri(r);
+
+		if (not op.m_identity)
+		{
+			for (auto &column : ac.m_renamed)
+			{
+				auto value = r[column].text();
+				if (not value.empty())
+					ri.set_value(column, std::string{ value } + '-' + op.m_name);
+			}
+
+			if (not ac.m_id.empty())
+				ri.set_value(ac.m_id, r[ac.m_id].as<std::string>() + '-' + op.m_name);
+		}
+
+		return ri;
+	}
+
+	// The Cartesian rotation part of transformation t, as rows
+	std::array<point, 3> rotation_of(const transformation &t)
+	{
+		point o = t({ 0, 0, 0 });
+		point c[3] = { t({ 1, 0, 0 }) - o, t({ 0, 1, 0 }) - o, t({ 0, 0, 1 }) - o };
+
+		return { point{ c[0].m_x, c[1].m_x, c[2].m_x },
+			point{ c[0].m_y, c[1].m_y, c[2].m_y },
+			point{ c[0].m_z, c[1].m_z, c[2].m_z } };
+	}
+
+	// The number of digits after the decimal point in s
+	int decimals(std::string_view s)
+	{
+		auto dp = s.find('.');
+		if (dp == std::string_view::npos)
+			return 0;
+
+		int result = 0;
+		for (auto ch : s.substr(dp + 1))
+		{
+			if (not std::isdigit(static_cast<unsigned char>(ch)))
+				break;
+			++result;
+		}
+		return result;
+	}
+
+	// Rotate the anisotropic displacement tensors in ri by R, i.e. U' = R U R^T.
+	// The standard uncertainties cannot be transformed and are set to unknown.
+	void rotate_tensor(row_initializer &ri, row_handle r, const std::array<point, 3> &R, std::string_view prefix)
+	{
+		const std::string_view kElements[6] = { "[1][1]", "[2][2]", "[3][3]", "[1][2]", "[1][3]", "[2][3]" };
+		const int kRow[6] = { 0, 1, 2, 0, 0, 1 }, kCol[6] = { 0, 1, 2, 1, 2, 2 };
+
+		std::string name[6];
+		double u[3][3];
+		int digits = 0;
+
+		for (int e = 0; e < 6; ++e)
+		{
+			name[e] = std::string{ prefix } + std::string{ kElements[e] };
+
+			auto item = r[name[e]];
+			if (item.empty())
+				return;
+
+			digits = std::max(digits, decimals(item.text()));
+			u[kRow[e]][kCol[e]] = u[kCol[e]][kRow[e]] = item.as<double>();
+		}
+
+		auto m = [&R](int i, int j)
+		{
+			const point &p = R[i];
+			return static_cast<double>(j == 0 ? p.m_x : j == 1 ? p.m_y : p.m_z);
+		};
+
+		for (int e = 0; e < 6; ++e)
+		{
+			int i = kRow[e], j = kCol[e];
+
+			double v = 0;
+			for (int k = 0; k < 3; ++k)
+			{
+				for (int l = 0; l < 3; ++l)
+					v += m(i, k) * u[k][l] * m(j, l);
+			}
+
+			char buffer[32];
+			auto [ptr, ec] = cif::to_chars_fixed(buffer, buffer + sizeof(buffer), v, digits);
+			if (ec != std::errc())
+				throw std::runtime_error("Could not format displacement parameter");
+			ri.set_value(name[e], { buffer, static_cast<size_t>(ptr - buffer) });
+
+			if (not r[name[e] + "_esd"].empty())
+				ri.set_value(name[e] + "_esd", "?");
+		}
+	}
+} // namespace
+
+datablock create_assembly(const datablock &db, std::string_view assembly_id)
+{
+	return create_assembly(db, assembly_id, parallel_policy{ 1 });
+}
+
+datablock create_assembly(const datablock &db, std::string_view assembly_id, const parallel_policy &policy)
+{
+	auto operations = get_assembly_operations(db, assembly_id);
+
+	size_t nr_of_threads = policy.m_nr_of_threads;
+	if (nr_of_threads == 0)
+		nr_of_threads = std::thread::hardware_concurrency();
+	nr_of_threads = std::max<size_t>(nr_of_threads, 1);
+
+	datablock result(db.name());
+
+	for (auto &cat : db)
+	{
+		if (kAsymCategories.count(cat.name()))
+			result.emplace_back(cat.name());
+		else
+			result.emplace_back(cat);
+	}
+
+	// The small categories first, these are simply copied per operation
+
+	for (auto &[name, ac] : kAsymCategories)
+	{
+		if (is_atom_category(name) or not db.get(name))
+			continue;
+
+		auto &src = db[name];
+		auto &dst = result[name];
+
+		std::unordered_map<std::string, std::vector<row_handle>> rows_per_asym;
+		for (auto r : src)
+			rows_per_asym[r[ac.m_keys.front()].as<std::string>()].push_back(r);
+
+		for (auto &op : operations)
+		{
+			std::unordered_set<std::string> asyms(op.m_asym_ids.begin(), op.m_asym_ids.end());
+
+			for (auto &asym_id : op.m_asym_ids)
+			{
+				for (auto r : rows_per_asym[asym_id])
+				{
+					// rows linking asyms that are not copied together are left out
+					if (std::all_of(ac.m_keys.begin() + 1, ac.m_keys.end(), [&](const std::string &key)
+							{ return asyms.count(r[key].as<std::string>()) > 0; }))
+					{
+						dst.emplace(copy_row(r, op, ac));
+					}
+				}
+			}
+		}
+	}
+
+	// And then the atoms, in the original order for each operation
+
+	auto &atom_site = db["atom_site"];
+	auto &columns = kAsymCategories.at("atom_site");
+	auto &aniso_columns = kAsymCategories.at("atom_site_anisotrop");
+
+	// The anisotropic displacement parameters, if any, by atom id
+	std::unordered_map<std::string, row_handle> aniso;
+	if (auto cat = db.get("atom_site_anisotrop"); cat != nullptr)
+	{
+		for (auto r : *cat)
+			aniso.emplace(r["id"].as<std::string>(), r);
+	}
+
+	std::vector<row_handle> atoms(atom_site.begin(), atom_site.end());
+	std::unordered_map<std::string, std::vector<size_t>> atoms_per_asym;
+	for (size_t i = 0; i < atoms.size(); ++i)
+		atoms_per_asym[atoms[i]["label_asym_id"].as<std::string>()].push_back(i);
+
+	struct job
+	{
+		const assembly_operation *op;
+		std::vector<row_initializer> rows;
+		std::vector<std::optional<row_initializer>> aniso_rows;
+		std::exception_ptr error;
+	};
+
+	auto build = [&](job &j)
+	{
+		std::vector<size_t> ix;
+		for (auto &asym_id : j.op->m_asym_ids)
+		{
+			auto i = atoms_per_asym.find(asym_id);
+			if (i != atoms_per_asym.end())
+				ix.insert(ix.end(), i->second.begin(), i->second.end());
+		}
+		std::sort(ix.begin(), ix.end());
+
+		auto R = rotation_of(j.op->m_transformation);
+
+		j.rows.reserve(ix.size());
+		j.aniso_rows.resize(ix.size());
+
+		for (size_t k = 0; k < ix.size(); ++k)
+		{
+			auto r = atoms[ix[k]];
+			auto &ri = j.rows.emplace_back(copy_row(r, *j.op, columns));
+
+			if (auto a = aniso.find(r["id"].as<std::string>()); a != aniso.end())
+			{
+				auto &ra = j.aniso_rows[k].emplace(copy_row(a->second, *j.op, aniso_columns));
+				if (not j.op->m_identity)
+				{
+					rotate_tensor(ra, a->second, R, "U");
+					rotate_tensor(ra, a->second, R, "B");
+				}
+			}
+
+			if (not j.op->m_identity)
+			{
+				point p;
+				cif::tie(p.m_x, p.m_y, p.m_z) = r.get("Cartn_x", "Cartn_y", "Cartn_z");
+				p = j.op->m_transformation(p);
+
+				set_coordinate(ri, "Cartn_x", p.m_x);
+				set_coordinate(ri, "Cartn_y", p.m_y);
+				set_coordinate(ri, "Cartn_z", p.m_z);
+			}
+		}
+	};
+
+	auto &dst = result["atom_site"];
+	auto dst_aniso = aniso.empty() ? nullptr : &result["atom_site_anisotrop"];
+	size_t atom_id = 0;
+
+	// The operations are processed in batches of one per thread, which
+	// limits the memory needed to one copy per thread.
+	for (size_t b = 0; b < operations.size(); b += nr_of_threads)
+	{
+		std::vector<job> jobs;
+		for (size_t i = b; i < operations.size() and i < b + nr_of_threads; ++i)
+			jobs.push_back({ &operations[i] });
+
+		std::atomic<size_t> next = 0;
+
+		auto run = [&]()
+		{
+			for (;;)
+			{
+				size_t i = next++;
+				if (i >= jobs.size())
+					break;
+
+				try
+				{
+					build(jobs[i]);
+				}
+				catch (...)
+				{
+					jobs[i].error = std::current_exception();
+				}
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (size_t i = 1; i < jobs.size(); ++i)
+			threads.emplace_back(run);
+
+		run();
+
+		for (auto &t : threads)
+			t.join();
+
+		for (auto &j : jobs)
+		{
+			if (j.error)
+				std::rethrow_exception(j.error);
+
+			for (size_t k = 0; k < j.rows.size(); ++k)
+			{
+				auto id = std::to_string(++atom_id);
+
+				j.rows[k].set_value("id", id);
+				dst.emplace(std::move(j.rows[k]));
+
+				if (j.aniso_rows[k])
+				{
+					j.aniso_rows[k]->set_value("id", id);
+					dst_aniso->emplace(std::move(*j.aniso_rows[k]));
+				}
+			}
+		}
+	}
+
+	if (auto v = db.get_validator(); v != nullptr)
+		result.set_validator(v);
+
+	return result;
+}
+
+} // namespace cif::mm
@@ -25,12 +25,18 @@
  */
 
 #include "cif++/category.hpp"
+#include "cif++/category_writer.hpp"
 #include "cif++/datablock.hpp"
 #include "cif++/parser.hpp"
 #include "cif++/utilities.hpp"
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <numeric>
 #include <stack>
+#include <thread>
+#include <unordered_set>
 
 // TODO: Find out what the rules are exactly for linked items, the current implementation
 // is inconsistent. It all depends whether a link is satified if a field taking part in the
@@ -169,6 +175,16 @@ class category_index
 	size_t size() const;
 	//	bool isValid() const;
 
+	// Visit the rows in index order for which @a pred returns zero. The
+	// predicate should return a negative value for rows sorting before the
+	// requested range and a positive value for rows sorting after it.
+	// Visiting stops as soon as @a f returns false.
+	template <typename P, typename F>
+	void visit_range(P &&pred, F &&f) const
+	{
+		visit_range(m_root, pred, f);
+	}
+
   private:
 	struct entry
 	{
@@ -195,6 +211,26 @@ class category_index
 	entry *insert(entry *h, row *v);
 	entry *erase(entry *h, row *k);
 
+	template <typename P, typename F>
+	bool visit_range(const entry *h, P &pred, F &f) const
+	{
+		if (h == nullptr)
+			return true;
+
+		int d = pred(h->m_row);
+
+		if (d >= 0 and not visit_range(h->m_left, pred, f))
+			return false;
+
+		if (d == 0 and not f(h->m_row))
+			return false;
+
+		if (d <= 0 and not visit_range(h->m_right, pred, f))
+			return false;
+
+		return true;
+	}
+
 	//	void validate(entry* h, bool isParentRed, uint32_t blackDepth, uint32_t& minBlack, uint32_t& maxBlack) const;
 
 	entry *rotateLeft(entry *h)
@@ -504,6 +540,13 @@ size_t category_index::size() const
 
 // --------------------------------------------------------------------
 
+uint64_t category::next_column_serial()
+{
+	// Serial number zero is reserved for column_ref's that have no cached index
+	static std::atomic<uint64_t> s_next_serial{ 1 };
+	return s_next_serial.fetch_add(1, std::memory_order_relaxed);
+}
+
 category::category(std::string_view name)
 	: m_name(name)
 {
@@ -538,6 +581,11 @@ category::category(category &&rhs)
 	rhs.m_head = nullptr;
 	rhs.m_tail = nullptr;
 	rhs.m_index = nullptr;
+	rhs.m_column_serial = next_column_serial();
+	rhs.reset_validation_state(true);
+	rhs.invalidate_hash();
+	++rhs.m_erase_serial;
+	++rhs.m_update_serial;
 }
 
 category &category::operator=(const category &rhs)
@@ -549,6 +597,7 @@ category &category::operator=(const category &rhs)
 
 		m_name = rhs.m_name;
 		m_columns = rhs.m_columns;
+		m_column_serial = next_column_serial();
 		m_cascade = rhs.m_cascade;
 
 		m_validator = nullptr;
@@ -557,6 +606,11 @@ category &category::operator=(const category &rhs)
 		delete m_index;
 		m_index = nullptr;
 
+		reset_validation_state(true);
+		invalidate_hash();
+		++m_erase_serial;
+		++m_update_serial;
+
 		for (auto r = rhs.m_head; r != nullptr; r = r->m_next)
 			insert_impl(cend(), clone_row(*r));
 
@@ -576,6 +630,8 @@ category &category::operator=(category &&rhs)
 	{
 		m_name = std::move(rhs.m_name);
 		m_columns = std::move(rhs.m_columns);
+		m_column_serial = next_column_serial();
+		rhs.m_column_serial = next_column_serial();
 		m_cascade = rhs.m_cascade;
 		m_validator = rhs.m_validator;
 		m_cat_validator = rhs.m_cat_validator;
@@ -585,6 +641,17 @@ category &category::operator=(category &&rhs)
 		std::swap(m_index, rhs.m_index);
 		std::swap(m_head, rhs.m_head);
 		std::swap(m_tail, rhs.m_tail);
+
+		reset_validation_state(true);
+		rhs.reset_validation_state(true);
+
+		invalidate_hash();
+		rhs.invalidate_hash();
+
+		++m_erase_serial;
+		++rhs.m_erase_serial;
+		++m_update_serial;
+		++rhs.m_update_serial;
 	}
 
 	return *this;
@@ -592,6 +659,9 @@ category &category::operator=(category &&rhs)
 
 category::~category()
 {
+	// linked categories may have been destroyed already
+	m_child_links.clear();
+
 	clear();
 }
 
@@ -643,6 +713,8 @@ void category::set_validator(const validator *v, datablock &db)
 {
 	m_validator = v;
 
+	reset_validation_state(true);
+
 	if (m_index != nullptr)
 	{
 		delete m_index;
@@ -713,7 +785,130 @@ void category::update_links(datablock &db)
 	}
 }
 
+void category::reset_validation_state(bool dirty) const
+{
+	m_dirty_all = m_dirty_columns = m_dirty_links_all = dirty;
+	m_dirty_rows.clear();
+	m_dirty_link_rows.clear();
+}
+
+void category::mark_dirty(const row *r)
+{
+	// no need to track individual rows if everything is dirty already
+	if (not m_dirty_all)
+		m_dirty_rows.insert(r);
+	if (not m_dirty_links_all)
+		m_dirty_link_rows.insert(r);
+}
+
+// --------------------------------------------------------------------
+
+uint16_t column_ref::index(const category &cat) const
+{
+	auto cached = m_cache.load(std::memory_order_relaxed);
+	if (cached != kNoCache and (cached >> 16) == cat.m_column_serial)
+		return static_cast<uint16_t>(cached & 0x0ffff);
+
+	auto result = cat.get_column_ix(m_name);
+
+	// Only cache indices of existing columns, columns are never removed
+	if (result < cat.m_columns.size())
+		m_cache.store((cat.m_column_serial << 16) | result, std::memory_order_relaxed);
+
+	return result;
+}
+
+uint16_t column_ref::add_to(category &cat) const
+{
+	auto result = index(cat);
+	if (result == cat.m_columns.size())
+	{
+		result = cat.add_column(m_name);
+		m_cache.store((cat.m_column_serial << 16) | result, std::memory_order_relaxed);
+	}
+	return result;
+}
+
+// --------------------------------------------------------------------
+
+namespace
+{
+	// The finalizer of splitmix64, to get a good distribution of bits
+	uint64_t mix_hash(uint64_t h)
+	{
+		h ^= h >> 30;
+		h *= 0xbf58476d1ce4e5b9ULL;
+		h ^= h >> 27;
+		h *= 0x94d049bb133111ebULL;
+		h ^= h >> 31;
+		return h;
+	}
+
+	// FNV-1a, optionally case insensitive
+	uint64_t hash_text(std::string_view text, bool icase = false)
+	{
+		uint64_t h = 0xcbf29ce484222325ULL;
+		for (unsigned char ch : text)
+		{
+			h ^= icase ? static_cast<unsigned char>(cif::tolower(ch)) : ch;
+			h *= 0x100000001b3ULL;
+		}
+		return h;
+	}
+} // namespace
+
+uint64_t category::row_hash(const row *r) const
+{
+	// column names are hashed only once, columns are never removed
+	while (m_column_hashes.size() < m_columns.size())
+		m_column_hashes.push_back(hash_text(m_columns[m_column_hashes.size()].m_name, true));
+
+	// the sum makes the result independent of the order of the columns
+	uint64_t result = 0;
+
+	for (uint16_t ix = 0; ix < r->size(); ++ix)
+	{
+		auto iv = r->get(ix);
+		if (iv != nullptr)
+			result += mix_hash(m_column_hashes[ix] ^ mix_hash(hash_text(iv->text())));
+	}
+
+	return mix_hash(result + 0x9e3779b97f4a7c15ULL);
+}
+
+void category::invalidate_hash() const
+{
+	m_hash_valid = false;
+	m_hash = 0;
+	m_column_hashes.clear();
+}
+
+uint64_t category::hash() const
+{
+	if (not m_hash_valid.load(std::memory_order_acquire))
+	{
+		std::lock_guard lock(m_hash_mutex);
+
+		if (not m_hash_valid.load(std::memory_order_relaxed))
+		{
+			uint64_t sum = 0;
+			for (auto r = m_head; r != nullptr; r = r->m_next)
+				sum += row_hash(r);
+
+			m_hash = sum;
+			m_hash_valid.store(true, std::memory_order_release);
+		}
+	}
+
+	return mix_hash(hash_text(m_name, true) ^ m_hash);
+}
+
 bool category::is_valid() const
+{
+	return is_valid(parallel_policy{ 1 });
+}
+
+bool category::is_valid(const parallel_policy &policy) const
 {
 	bool result = true;
 
@@ -724,6 +919,8 @@ bool category::is_valid() const
 	{
 		if (VERBOSE > 2)
 			std::cerr << "Skipping validation of empty category " << m_name << '\n';
+
+		reset_validation_state();
 		return true;
 	}
 
@@ -733,6 +930,154 @@ bool category::is_valid() const
 		return false;
 	}
 
+	m_dirty_columns = not validate_columns();
+	result = not m_dirty_columns;
+
+#if not defined(NDEBUG)
+	// check index?
+	if (m_index)
+	{
+		if (m_index->size() != size())
+			m_validator->report_error("size of index is not equal to size of category " + m_name, true);
+
+		// m_index->validate();
+		for (auto r : *this)
+		{
+			auto p = r.get_row();
+			if (m_index->find(p) != p)
+				m_validator->report_error("Key not found in index for category " + m_name, true);
+		}
+	}
+#endif
+
+	// validate all values, rows that fail remain dirty
+
+	// Below this number of rows per thread, starting threads costs more than it gains
+	const size_t kMinRowsPerThread = 4096;
+
+	std::vector<const row *> rows;
+	for (auto r = m_head; r != nullptr; r = r->m_next)
+		rows.push_back(r);
+
+	size_t nr_of_threads = policy.m_nr_of_threads;
+	if (nr_of_threads == 0)
+		nr_of_threads = std::thread::hardware_concurrency();
+	nr_of_threads = std::min(nr_of_threads, rows.size() / kMinRowsPerThread);
+
+	m_dirty_rows.clear();
+
+	if (nr_of_threads <= 1)
+	{
+		validated_values validated(m_columns.size());
+
+		for (auto r : rows)
+		{
+			if (not validate_row(r, validated))
+			{
+				m_dirty_rows.insert(r);
+				result = false;
+			}
+		}
+	}
+	else
+	{
+		std::vector<std::vector<const row *>> failed(nr_of_threads);
+		std::vector<std::vector<std::pair<std::string, bool>>> reports(nr_of_threads);
+		std::vector<std::exception_ptr> errors(nr_of_threads);
+
+		std::vector<std::thread> threads;
+		threads.reserve(nr_of_threads);
+
+		for (size_t i = 0; i < nr_of_threads; ++i)
+		{
+			threads.emplace_back([&, i]()
+			{
+				detail::report_collector collector;
+
+				try
+				{
+					auto b = rows.begin() + (i * rows.size()) / nr_of_threads;
+					auto e = rows.begin() + ((i + 1) * rows.size()) / nr_of_threads;
+
+					validated_values validated(m_columns.size());
+
+					for (auto ri = b; ri != e; ++ri)
+					{
+						if (not validate_row(*ri, validated))
+							failed[i].push_back(*ri);
+					}
+				}
+				catch (...)
+				{
+					errors[i] = std::current_exception();
+				}
+
+				reports[i] = std::move(collector.m_reports);
+			});
+		}
+
+		for (auto &t : threads)
+			t.join();
+
+		// report in row order, partitions are consecutive
+		for (size_t i = 0; i < nr_of_threads; ++i)
+		{
+			for (auto &[msg, fatal] : reports[i])
+				m_validator->report_error(msg, fatal);
+
+			if (errors[i])
+				std::rethrow_exception(errors[i]);
+
+			if (not failed[i].empty())
+			{
+				m_dirty_rows.insert(failed[i].begin(), failed[i].end());
+				result = false;
+			}
+		}
+	}
+
+	m_dirty_all = false;
+
+	return result;
+}
+
+bool category::is_valid(incremental_type) const
+{
+	if (m_validator == nullptr)
+		throw std::runtime_error("no Validator specified");
+
+	if (m_dirty_all or m_cat_validator == nullptr or empty())
+		return is_valid();
+
+	bool result = true;
+
+	if (m_dirty_columns)
+	{
+		m_dirty_columns = not validate_columns();
+		result = not m_dirty_columns;
+	}
+
+	if (not m_dirty_rows.empty())
+	{
+		std::vector<const row *> rows(m_dirty_rows.begin(), m_dirty_rows.end());
+		validated_values validated(m_columns.size());
+
+		for (auto r : rows)
+		{
+			if (validate_row(r, validated))
+				m_dirty_rows.erase(r);
+			else
+				result = false;
+		}
+	}
+
+	return result;
+}
+
+bool category::validate_columns() const
+{
+	bool result = true;
+
 	auto mandatory = m_cat_validator->m_mandatory_fields;
 
 	for (auto &col : m_columns)
@@ -771,65 +1116,64 @@ bool category::is_valid() const
 		result = false;
 	}
 
-#if not defined(NDEBUG)
-	// check index?
-	if (m_index)
+	return result;
+}
+
+bool category::validate_row(const row *r, validated_values &validated) const
+{
+	// Values are often repeated in a column, remember the ones that were
+	// found valid already. The memo is bounded to keep memory use in check
+	// for columns with many unique values.
+	const size_t kMaxValidatedValues = 1024;
+
+	bool result = true;
+
+	for (uint16_t cix = 0; cix < m_columns.size(); ++cix)
 	{
-		if (m_index->size() != size())
-			m_validator->report_error("size of index is not equal to size of category " + m_name, true);
+		bool seen = false;
+		auto iv = m_columns[cix].m_validator;
 
-		// m_index->validate();
-		for (auto r : *this)
+		if (iv == nullptr)
 		{
-			auto p = r.get_row();
-			if (m_index->find(p) != p)
-				m_validator->report_error("Key not found in index for category " + m_name, true);
+			m_validator->report_error("invalid field " + m_columns[cix].m_name + " for category " + m_name, false);
+			result = false;
+			continue;
 		}
-	}
-#endif
-
-	// validate all values
-	mandatory = m_cat_validator->m_mandatory_fields;
 
-	for (auto ri = m_head; ri != nullptr; ri = ri->m_next)
-	{
-		for (uint16_t cix = 0; cix < m_columns.size(); ++cix)
+		auto vi = r->get(cix);
+		if (vi != nullptr)
 		{
-			bool seen = false;
-			auto iv = m_columns[cix].m_validator;
+			seen = true;
 
-			if (iv == nullptr)
-			{
-				m_validator->report_error("invalid field " + m_columns[cix].m_name + " for category " + m_name, false);
-				result = false;
+			auto text = vi->text();
+			auto &memo = validated[cix];
+
+			if (memo.contains(text))
 				continue;
-			}
 
-			auto vi = ri->get(cix);
-			if (vi != nullptr)
+			try
 			{
-				seen = true;
-				try
-				{
-					(*iv)(vi->text());
-				}
-				catch (const std::exception &e)
-				{
-					result = false;
-					m_validator->report_error("Error validating " + m_columns[cix].m_name + ": " + e.what(), false);
-					continue;
-				}
-			}
-
-			if (seen or ri != m_head)
-				continue;
+				(*iv)(text);
 
-			if (iv != nullptr and iv->m_mandatory)
+				if (memo.size() < kMaxValidatedValues)
+					memo.insert(text);
+			}
+			catch (const std::exception &e)
 			{
-				m_validator->report_error("missing mandatory field " + m_columns[cix].m_name + " for category " + m_name, false);
 				result = false;
+				m_validator->report_error("Error validating " + m_columns[cix].m_name + ": " + e.what(), false);
+				continue;
 			}
 		}
+
+		if (seen or r != m_head)
+			continue;
+
+		if (iv != nullptr and iv->m_mandatory)
+		{
+			m_validator->report_error("missing mandatory field " + m_columns[cix].m_name + " for category " + m_name, false);
+			result = false;
+		}
 	}
 
 	return result;
@@ -840,6 +1184,45 @@ bool category::validate_links() const
 	if (not m_validator)
 		return false;
 
+	std::vector<const row *> rows;
+	for (auto r = m_head; r != nullptr; r = r->m_next)
+		rows.push_back(r);
+
+	m_dirty_link_rows.clear();
+	m_dirty_links_all = false;
+
+	m_parent_erase_serials.clear();
+	for (auto &link : m_parent_links)
+		m_parent_erase_serials.push_back(link.linked ? link.linked->erase_serial() : 0);
+
+	return validate_links(rows);
+}
+
+bool category::validate_links(incremental_type) const
+{
+	if (not m_validator)
+		return false;
+
+	m_incremental_links = true;
+
+	bool parents_changed = m_parent_erase_serials.size() != m_parent_links.size();
+	for (size_t i = 0; not parents_changed and i < m_parent_links.size(); ++i)
+	{
+		auto parent = m_parent_links[i].linked;
+		parents_changed = parent != nullptr and parent->erase_serial() != m_parent_erase_serials[i];
+	}
+
+	if (m_dirty_links_all or parents_changed)
+		return validate_links();
+
+	std::vector<const row *> rows(m_dirty_link_rows.begin(), m_dirty_link_rows.end());
+	m_dirty_link_rows.clear();
+
+	return validate_links(rows);
+}
+
+bool category::validate_links(const std::vector<const row *> &rows) const
+{
 	bool result = true;
 
 	for (auto &link : m_parent_links)
@@ -858,13 +1241,18 @@ bool category::validate_links() const
 		size_t missing = 0;
 		category first_missing_rows(name());
 
-		for (auto r : *this)
+		for (auto p : rows)
 		{
+			row_handle r(*this, *p);
+
 			auto cond = get_parents_condition(r, *parent);
 			if (not cond)
 				continue;
 			if (not parent->exists(std::move(cond)))
 			{
+				// rows with missing parents remain dirty
+				m_dirty_link_rows.insert(p);
+
 				++missing;
 				if (VERBOSE and first_missing_rows.size() < 5)
 					first_missing_rows.emplace(r);
@@ -914,23 +1302,247 @@ row_handle category::operator[](const key_type &key)
 
 // --------------------------------------------------------------------
 
-condition category::get_parents_condition(row_handle rh, const category &parentCat) const
+bool category::get_index_candidates(const condition &cond, std::vector<row *> &rows, bool constrained_only) const
 {
-	if (m_validator == nullptr or m_cat_validator == nullptr)
-		throw std::runtime_error("No validator known for category " + m_name);
+	if (m_index == nullptr or m_cat_validator == nullptr)
+		return false;
 
-	condition result;
+	auto constraints = cond.get_index_constraints();
 
-	auto links = m_validator->get_links_for_child(m_name);
-	links.erase(remove_if(links.begin(), links.end(), [n=parentCat.m_name](auto &l) { return l->m_parent_category != n; }), links.end());
+	struct key_bound
+	{
+		uint16_t m_ix;
+		const type_validator *m_type;
+		const std::string *m_equals, *m_lower, *m_upper;
+	};
 
-	if (not links.empty())
+	std::vector<key_bound> bounds;
+
+	// The index is sorted on the key columns in order, we can use a prefix of
+	// key columns with an equality constraint, optionally followed by a column
+	// with a range constraint.
+	for (auto &key : m_cat_validator->m_keys)
 	{
-		for (auto &link : links)
-		{
-			condition cond;
+		auto iv = m_cat_validator->get_validator_for_item(key);
+		if (iv == nullptr or iv->m_type == nullptr)
+			break;
 
-			for (size_t ix = 0; ix < link->m_child_keys.size(); ++ix)
+		auto tv = iv->m_type;
+		bool numeric = tv->m_primitive_type == DDL_PrimitiveType::Numb;
+		uint16_t ix = get_column_ix(key);
+
+		auto eq = std::find_if(constraints.begin(), constraints.end(), [ix, numeric](const detail::index_constraint &c)
+			{
+				if (c.m_item_ix != ix or not c.m_equals.has_value())
+					return false;
+
+				// non-numeric values do not sort consistently in a numeric index
+				double v;
+				auto &s = *c.m_equals;
+				return not numeric or selected_charconv<double>::from_chars(s.data(), s.data() + s.length(), v).ec == std::errc();
+			});
+
+		if (eq != constraints.end())
+		{
+			bounds.push_back({ ix, tv, &*eq->m_equals, nullptr, nullptr });
+			continue;
+		}
+
+		// Ranges are only used for numeric columns and only when an upper
+		// bound is specified since values that are not a number compare
+		// larger than any number in a condition while they sort before
+		// all numbers in the index.
+		if (numeric)
+		{
+			const std::string *lower = nullptr, *upper = nullptr;
+
+			for (auto &c : constraints)
+			{
+				if (c.m_item_ix != ix)
+					continue;
+
+				if (c.m_lower.has_value() and (lower == nullptr or tv->compare(*c.m_lower, *lower) > 0))
+					lower = &*c.m_lower;
+
+				if (c.m_upper.has_value() and (upper == nullptr or tv->compare(*c.m_upper, *upper) < 0))
+					upper = &*c.m_upper;
+			}
+
+			if (upper != nullptr)
+				bounds.push_back({ ix, tv, nullptr, lower, upper });
+		}
+
+		break;
+	}
+
+	if (bounds.empty() and constrained_only)
+		return false;
+
+	m_index->visit_range([this, &bounds](const row *r)
+		{
+			row_handle rh(*this, *r);
+
+			for (auto &b : bounds)
+			{
+				auto text = rh[b.m_ix].text();
+
+				if (b.m_equals != nullptr)
+				{
+					int d = b.m_type->compare(text, *b.m_equals);
+					if (d != 0)
+						return d;
+				}
+				else
+				{
+					if (b.m_lower != nullptr and b.m_type->compare(text, *b.m_lower) < 0)
+						return -1;
+					if (b.m_upper != nullptr and b.m_type->compare(text, *b.m_upper) > 0)
+						return 1;
+				}
+			}
+
+			return 0;
+		},
+		[&rows](row *r)
+		{
+			rows.push_back(r);
+			return true;
+		});
+
+	return true;
+}
+
+std::vector<row *> category::find_ordered(const condition &cond) const
+{
+	std::vector<row *> result;
+
+	if (not empty())
+	{
+		if (m_index == nullptr)
+			throw std::logic_error("Category " + m_name + " does not have an index");
+
+		get_index_candidates(cond, result, false);
+	}
+
+	return result;
+}
+
+// --------------------------------------------------------------------
+
+std::vector<row_handle> category::find_parallel(const parallel_policy &policy, const condition &cond, bool first_only) const
+{
+	// Below this number of rows per thread, starting threads costs more than it gains
+	const size_t kMinRowsPerThread = 4096;
+
+	// rows are stored in a linked list, collect them first so we can partition
+	std::vector<row *> rows;
+	for (auto r = m_head; r != nullptr; r = r->m_next)
+		rows.push_back(r);
+
+	size_t nr_of_threads = policy.m_nr_of_threads;
+	if (nr_of_threads == 0)
+		nr_of_threads = std::thread::hardware_concurrency();
+	nr_of_threads = std::min(nr_of_threads, rows.size() / kMinRowsPerThread);
+
+	std::vector<row_handle> result;
+
+	if (nr_of_threads <= 1)
+	{
+		for (auto r : rows)
+		{
+			row_handle rh(*this, *r);
+			if (cond(rh))
+			{
+				result.emplace_back(rh);
+				if (first_only)
+					break;
+			}
+		}
+	}
+	else
+	{
+		std::vector<std::vector<row *>> hits(nr_of_threads);
+		std::vector<std::exception_ptr> errors(nr_of_threads);
+		std::atomic<bool> found = false;
+
+		std::vector<std::thread> threads;
+		threads.reserve(nr_of_threads);
+
+		for (size_t i = 0; i < nr_of_threads; ++i)
+		{
+			threads.emplace_back([&, i]()
+			{
+				try
+				{
+					auto b = rows.begin() + (i * rows.size()) / nr_of_threads;
+					auto e = rows.begin() + ((i + 1) * rows.size()) / nr_of_threads;
+
+					for (auto ri = b; ri != e; ++ri)
+					{
+						if (first_only and found)
+							break;
+
+						if (cond(row_handle(*this, **ri)))
+						{
+							hits[i].push_back(*ri);
+							if (first_only)
+								found = true;
+						}
+					}
+				}
+				catch (...)
+				{
+					errors[i] = std::current_exception();
+				}
+			});
+		}
+
+		for (auto &t : threads)
+			t.join();
+
+		for (auto &e : errors)
+		{
+			if (e)
+				std::rethrow_exception(e);
+		}
+
+		// merge the results in row order, partitions are consecutive
+		for (auto &h : hits)
+		{
+			for (auto r : h)
+			{
+				result.emplace_back(*this, *r);
+				if (first_only)
+					break;
+			}
+
+			if (first_only and not result.empty())
+				break;
+		}
+	}
+
+	return result;
+}
+
+// --------------------------------------------------------------------
+
+condition category::get_parents_condition(row_handle rh, const category &parentCat) const
+{
+	if (m_validator == nullptr or m_cat_validator == nullptr)
+		throw std::runtime_error("No validator known for category " + m_name);
+
+	condition result;
+
+	auto links = m_validator->get_links_for_child(m_name);
+	links.erase(remove_if(links.begin(), links.end(), [n=parentCat.m_name](auto &l) { return l->m_parent_category != n; }), links.end());
+
+	if (not links.empty())
+	{
+		for (auto &link : links)
+		{
+			condition cond;
+
+			for (size_t ix = 0; ix < link->m_child_keys.size(); ++ix)
 			{
 				auto childValue = rh[link->m_child_keys[ix]];
 
@@ -1080,6 +1692,11 @@ category::iterator category::erase(iterator pos)
 	if (m_index != nullptr)
 		m_index->erase(r);
 
+	if (m_hash_valid)
+		m_hash -= row_hash(r);
+
+	++m_erase_serial;
+
 	if (r == m_head)
 	{
 		m_head = m_head->m_next;
@@ -1204,6 +1821,13 @@ void category::clear()
 
 	delete m_index;
 	m_index = nullptr;
+
+	reset_validation_state(true);
+	invalidate_hash();
+
+	// child rows may have lost their parents, the children notice
+	// this change when validating their links incrementally
+	++m_erase_serial;
 }
 
 void category::erase_orphans(condition &&cond, category &parent)
@@ -1438,6 +2062,9 @@ void category::update_value(row *row, uint16_t column, std::string_view value, b
 			m_index->erase(row);
 	}
 
+	if (m_hash_valid)
+		m_hash -= row_hash(row);
+
 	// first remove old value with cix
 	if (ival != nullptr)
 		row->remove(column);
@@ -1445,12 +2072,19 @@ void category::update_value(row *row, uint16_t column, std::string_view value, b
 	if (not value.empty())
 		row->append(column, { value });
 
+	++m_update_serial;
+
+	if (m_hash_valid)
+		m_hash += row_hash(row);
+
 	if (reinsert)
 		m_index->insert(row);
 
+	mark_dirty(row);
+
 	// see if we need to update any child categories that depend on this value
 	auto iv = col.m_validator;
-	if (updateLinked and iv != nullptr /*and m_cascade*/)
+	if (iv != nullptr /*and m_cascade*/)
 	{
 		row_handle rh(*this, *row);
 
@@ -1459,6 +2093,40 @@ void category::update_value(row *row, uint16_t column, std::string_view value, b
 			if (std::find(linked->m_parent_keys.begin(), linked->m_parent_keys.end(), iv->m_tag) == linked->m_parent_keys.end())
 				continue;
 
+			if (not updateLinked)
+			{
+				// The child rows linking to the old value are not renamed,
+				// their links need to be checked again. Unless the child
+				// category is not validated incrementally, or will be
+				// validated completely anyway.
+				if (not childCat->m_incremental_links or childCat->m_dirty_links_all)
+					continue;
+
+				condition cond;
+
+				for (size_t ix = 0; ix < linked->m_parent_keys.size(); ++ix)
+				{
+					const std::string &pk = linked->m_parent_keys[ix];
+					const std::string &ck = linked->m_child_keys[ix];
+
+					if (pk == iv->m_tag)
+						cond = std::move(cond) and key(ck) == oldStrValue;
+					else
+					{
+						std::string_view pk_value = rh[pk].text();
+						if (pk_value.empty())
+							cond = std::move(cond) and key(ck) == null;
+						else
+							cond = std::move(cond) and key(ck) == pk_value;
+					}
+				}
+
+				for (auto cr : childCat->find(std::move(cond)))
+					childCat->mark_dirty(cr.get_row());
+
+				continue;
+			}
+
 			condition cond;
 			std::string childTag;
 
@@ -1522,6 +2190,10 @@ void category::update_value(row *row, uint16_t column, std::string_view value, b
 				if (cif::VERBOSE > 0)
 					std::cerr << "Will not rename in child category since there are already rows that link to the parent\n";
 
+				// the links of these rows should be checked again
+				for (auto cr : rows)
+					childCat->mark_dirty(cr.get_row());
+
 				continue;
 			}
 
@@ -1559,6 +2231,11 @@ void category::delete_row(row *r)
 {
 	if (r != nullptr)
 	{
+		if (not m_dirty_rows.empty())
+			m_dirty_rows.erase(r);
+		if (not m_dirty_link_rows.empty())
+			m_dirty_link_rows.erase(r);
+
 		row_allocator_type ra(get_allocator());
 		row_allocator_traits::destroy(ra, r);
 		row_allocator_traits::deallocate(ra, r, 1);
@@ -1644,6 +2321,11 @@ category::iterator category::insert_impl(const_iterator pos, row *n)
 		if (m_index != nullptr)
 			m_index->insert(n);
 
+		mark_dirty(n);
+
+		if (m_hash_valid)
+			m_hash += row_hash(n);
+
 		// insert at end, most often this is the case
 		if (pos.m_current == nullptr)
 		{
@@ -1684,7 +2366,16 @@ void category::swap_item(uint16_t column_ix, row_handle &a, row_handle &b)
 	auto &ra = *a.m_row;
 	auto &rb = *b.m_row;
 
+	if (m_hash_valid)
+		m_hash -= row_hash(&ra) + row_hash(&rb);
+
 	std::swap(ra.at(column_ix), rb.at(column_ix));
+
+	if (m_hash_valid)
+		m_hash += row_hash(&ra) + row_hash(&rb);
+
+	mark_dirty(&ra);
+	mark_dirty(&rb);
 }
 
 void category::sort(std::function<int(row_handle,row_handle)> f)
@@ -1722,76 +2413,182 @@ void category::reorder_by_index()
 
 namespace detail
 {
-	size_t write_value(std::ostream &os, std::string_view value, size_t offset, size_t width, bool right_aligned)
+	/// The way a value is written in a CIF file
+	enum class value_style : uint8_t
+	{
+		unquoted,
+		single_quoted,
+		double_quoted,
+		text_field
+	};
+
+	/// Find out how @a value should be written, this is expensive enough to do only once per value
+	value_style classify_value(std::string_view value)
+	{
+		if (value.find('\n') != std::string::npos or value.length() > kMaxLineLength)
+			return value_style::text_field;
+
+		if (sac_parser::is_unquoted_string(value))
+			return value_style::unquoted;
+
+		for (char q : { '\'', '"' })
+		{
+			auto p = value.find(q); // see if we can use the quote character
+			while (p != std::string::npos and sac_parser::is_non_blank(value[p + 1]) and value[p + 1] != q)
+				p = value.find(q, p + 1);
+
+			if (p == std::string::npos)
+				return q == '\'' ? value_style::single_quoted : value_style::double_quoted;
+		}
+
+		return value_style::text_field;
+	}
+
+	/// The length of @a value when written using @a style, not counting text fields
+	inline size_t written_length(std::string_view value, value_style style)
 	{
-		if (value.find('\n') != std::string::npos or width == 0 or value.length() > 132) // write as text field
+		return style == value_style::unquoted ? value.length() : value.length() + 2;
+	}
+
+	/// Output is collected in a large buffer that is written to the
+	/// std::ostream in big chunks, that is a lot faster than writing
+	/// each value separately.
+	class output_buffer
+	{
+	  public:
+		static constexpr size_t kBufferSize = 1024 * 1024;
+
+		output_buffer(std::ostream &os)
+			: m_os(&os)
 		{
-			if (offset > 0)
-				os << '\n';
-			os << ';';
+			m_buffer.reserve(kBufferSize + kBufferSize / 8);
+		}
+
+		/// Construct an output_buffer that only collects text, use release() to get it
+		output_buffer() = default;
 
-			char pc = 0;
-			for (auto ch : value)
+		output_buffer(const output_buffer &) = delete;
+		output_buffer &operator=(const output_buffer &) = delete;
+
+		~output_buffer()
+		{
+			flush();
+		}
+
+		void flush()
+		{
+			if (m_os != nullptr and not m_buffer.empty())
 			{
-				if (pc == '\n' and ch == ';')
-					os << '\\';
-				os << ch;
-				pc = ch;
+				m_os->write(m_buffer.data(), m_buffer.size());
+				m_buffer.clear();
 			}
+		}
 
-			if (value.back() != '\n')
-				os << '\n';
-			os << ';' << '\n';
-			offset = 0;
+		/// Flush the buffer if it is full enough, call this between rows
+		void check()
+		{
+			if (m_buffer.size() >= kBufferSize)
+				flush();
+		}
+
+		std::string release()
+		{
+			return std::move(m_buffer);
+		}
+
+		output_buffer &operator<<(std::string_view s)
+		{
+			m_buffer.append(s);
+			return *this;
+		}
+
+		output_buffer &operator<<(char ch)
+		{
+			m_buffer.push_back(ch);
+			return *this;
+		}
+
+		void fill(size_t n)
+		{
+			m_buffer.append(n, ' ');
 		}
-		else if (sac_parser::is_unquoted_string(value))
+
+	  private:
+		std::ostream *m_os = nullptr;
+		std::string m_buffer;
+	};
+
+	size_t write_value(output_buffer &os, std::string_view value, value_style style, size_t offset, size_t width, bool right_aligned)
+	{
+		switch (style)
 		{
-			if (right_aligned)
+			case value_style::text_field:
 			{
-				if (value.length() < width)
+				if (offset > 0)
+					os << '\n';
+				os << ';';
+
+				char pc = 0;
+				for (auto b = value.begin(), e = b; b != value.end(); b = e)
 				{
-					os << std::string(width - value.length() - 1, ' ');
-					offset += width;
+					// escape semicolons at the start of a line
+					if (pc == '\n' and *b == ';')
+						os << '\\';
+
+					e = std::find(b, value.end(), '\n');
+					if (e != value.end())
+						++e;
+					os << std::string_view(&*b, e - b);
+					pc = *(e - 1);
 				}
-				else
-					offset += value.length() + 1;
-			}
 
-			os << value;
+				if (value.back() != '\n')
+					os << '\n';
+				os << ';' << '\n';
+				offset = 0;
+				break;
+			}
 
-			if (right_aligned)
-				os << ' ';
-			else
-			{
-				if (value.length() < width)
+			case value_style::unquoted:
+				if (right_aligned)
 				{
-					os << std::string(width - value.length(), ' ');
-					offset += width;
+					if (value.length() < width)
+					{
+						os.fill(width - value.length() - 1);
+						offset += width;
+					}
+					else
+						offset += value.length() + 1;
 				}
+
+				os << value;
+
+				if (right_aligned)
+					os << ' ';
 				else
 				{
-					os << ' ';
-					offset += value.length() + 1;
+					if (value.length() < width)
+					{
+						os.fill(width - value.length());
+						offset += width;
+					}
+					else
+					{
+						os << ' ';
+						offset += value.length() + 1;
+					}
 				}
-			}
-		}
-		else
-		{
-			bool done = false;
-			for (char q : { '\'', '"' })
-			{
-				auto p = value.find(q); // see if we can use the quote character
-				while (p != std::string::npos and sac_parser::is_non_blank(value[p + 1]) and value[p + 1] != q)
-					p = value.find(q, p + 1);
+				break;
 
-				if (p != std::string::npos)
-					continue;
+			default:
+			{
+				char q = style == value_style::single_quoted ? '\'' : '"';
 
 				os << q << value << q;
 
 				if (value.length() + 2 < width)
 				{
-					os << std::string(width - value.length() - 2, ' ');
+					os.fill(width - value.length() - 2);
 					offset += width;
 				}
 				else
@@ -1799,19 +2596,8 @@ namespace detail
 					os << ' ';
 					offset += value.length() + 1;
 				}
-
-				done = true;
 				break;
 			}
-
-			if (not done)
-			{
-				if (offset > 0)
-					os << '\n';
-				os << ';' << value << '\n'
-				   << ';' << '\n';
-				offset = 0;
-			}
 		}
 
 		return offset;
@@ -1819,6 +2605,207 @@ namespace detail
 
 } // namespace detail
 
+// --------------------------------------------------------------------
+
+category_writer::category_writer(std::ostream &os, std::string_view name, std::vector<column> columns)
+	: m_name(name)
+	, m_columns(std::move(columns))
+	, m_out(std::make_unique<detail::output_buffer>(os))
+{
+	if (m_columns.empty())
+		throw std::runtime_error("A category_writer needs at least one column");
+
+	for (auto &col : m_columns)
+	{
+		if (col.m_width > 0 and col.m_width < 2)
+			col.m_width = 2;
+	}
+}
+
+category_writer::~category_writer()
+{
+	if (m_finished)
+		return;
+
+	try
+	{
+		finish();
+	}
+	catch (const std::exception &ex)
+	{
+		std::cerr << "Error writing category " << m_name << ": " << ex.what() << '\n';
+	}
+}
+
+void category_writer::add_text(std::string_view value)
+{
+	if (m_finished)
+		throw std::runtime_error("category_writer::write_row called after finish");
+
+	if (value.empty())
+		value = "?";
+
+	if (m_rows == 0)
+		m_first_row.emplace_back(value);
+	else
+	{
+		// a second row, so the first one is written in a loop_ as well
+		if (not m_first_row.empty())
+		{
+			write_loop_header();
+			for (size_t i = 0; i < m_first_row.size(); ++i)
+				write_loop_value(m_first_row[i], i);
+			std::vector<std::string>().swap(m_first_row);
+		}
+
+		write_loop_value(value, m_column);
+	}
+
+	if (++m_column == m_columns.size())
+	{
+		m_column = 0;
+		++m_rows;
+	}
+}
+
+void category_writer::write_loop_header()
+{
+	auto &out = *m_out;
+
+	out << "loop_\n";
+	for (auto &col : m_columns)
+	{
+		out << '_';
+		if (not m_name.empty())
+			out << m_name << '.';
+		out << col.m_name << ' ' << '\n';
+	}
+}
+
+void category_writer::write_loop_value(std::string_view value, size_t column)
+{
+	auto &out = *m_out;
+
+	auto &col = m_columns[column];
+	auto style = detail::classify_value(value);
+
+	size_t l = detail::written_length(value, style);
+	if (l < col.m_width)
+		l = col.m_width;
+
+	if (m_offset + l > kMaxLineLength and m_offset > 0)
+	{
+		out << '\n';
+		m_offset = 0;
+	}
+
+	m_offset = detail::write_value(out, value, style, m_offset, col.m_width, col.m_right_aligned);
+
+	if (m_offset > kMaxLineLength)
+	{
+		out << '\n';
+		m_offset = 0;
+	}
+
+	if (column + 1 == m_columns.size())
+	{
+		if (m_offset > 0)
+			out << '\n';
+
+		m_offset = 0;
+
+		out.check();
+	}
+}
+
+void category_writer::write_single_row()
+{
+	// The same layout category::write uses for a single row
+	auto &out = *m_out;
+
+	bool aligned = std::any_of(m_columns.begin(), m_columns.end(), [](const column &col)
+		{ return col.m_width > 0; });
+
+	size_t l = 0;
+	for (auto &col : m_columns)
+	{
+		size_t tl = col.m_name.length() + m_name.length() + 2;
+		if (l < tl)
+			l = tl;
+	}
+
+	l += 3;
+
+	size_t width = 1;
+
+	for (size_t i = 0; i < m_columns.size(); ++i)
+	{
+		if (not (aligned and m_columns[i].m_right_aligned))
+			continue;
+
+		auto &s = m_first_row[i];
+		size_t l2 = detail::written_length(s, detail::classify_value(s));
+
+		if (width < l2)
+			width = l2;
+	}
+
+	for (size_t i = 0; i < m_columns.size(); ++i)
+	{
+		auto &col = m_columns[i];
+
+		out << '_';
+		if (not m_name.empty())
+			out << m_name << '.';
+		out << col.m_name;
+
+		size_t offset = 0;
+
+		if (aligned)
+		{
+			out.fill(l - col.m_name.length() - m_name.length() - 2);
+			offset = l;
+		}
+		else
+		{
+			out << ' ';
+			offset = col.m_name.length() + m_name.length() + 3;
+		}
+
+		std::string_view s = m_first_row[i];
+
+		if (s.length() + offset >= kMaxLineLength)
+		{
+			out << '\n';
+			offset = 0;
+		}
+
+		if (detail::write_value(out, s, detail::classify_value(s), offset, aligned ? width : 0, aligned and col.m_right_aligned) != 0)
+			out << '\n';
+	}
+
+	std::vector<std::string>().swap(m_first_row);
+}
+
+void category_writer::finish()
+{
+	if (m_finished)
+		return;
+
+	if (m_column != 0)
+		throw std::runtime_error("category_writer::finish called with an incomplete row");
+
+	m_finished = true;
+
+	if (m_rows == 1)
+		write_single_row();
+
+	if (m_rows > 0)
+		*m_out << "# \n";
+
+	m_out->flush();
+}
+
 std::vector<std::string> category::get_tag_order() const
 {
 	std::vector<std::string> result;
@@ -1831,7 +2818,36 @@ void category::write(std::ostream &os) const
 {
 	std::vector<uint16_t> order(m_columns.size());
 	iota(order.begin(), order.end(), static_cast<uint16_t>(0));
-	write(os, order, false);
+	write(os, order, false, true);
+}
+
+void category::write(std::ostream &os, unaligned_type) const
+{
+	std::vector<uint16_t> order(m_columns.size());
+	iota(order.begin(), order.end(), static_cast<uint16_t>(0));
+	write(os, order, false, false);
+}
+
+void category::write(std::ostream &os, const parallel_policy &policy) const
+{
+	size_t nr_of_threads = policy.m_nr_of_threads;
+	if (nr_of_threads == 0)
+		nr_of_threads = std::thread::hardware_concurrency();
+
+	std::vector<uint16_t> order(m_columns.size());
+	iota(order.begin(), order.end(), static_cast<uint16_t>(0));
+	write(os, order, false, true, nr_of_threads);
+}
+
+void category::write(std::ostream &os, const parallel_policy &policy, unaligned_type) const
+{
+	size_t nr_of_threads = policy.m_nr_of_threads;
+	if (nr_of_threads == 0)
+		nr_of_threads = std::thread::hardware_concurrency();
+
+	std::vector<uint16_t> order(m_columns.size());
+	iota(order.begin(), order.end(), static_cast<uint16_t>(0));
+	write(os, order, false, false, nr_of_threads);
 }
 
 void category::write(std::ostream &os, const std::vector<std::string> &columns, bool addMissingColumns)
@@ -1855,20 +2871,24 @@ void category::write(std::ostream &os, const std::vector<std::string> &columns,
 		}
 	}
 
-	write(os, order, true);
+	write(os, order, true, true);
 }
 
-void category::write(std::ostream &os, const std::vector<uint16_t> &order, bool includeEmptyColumns) const
+void category::write(std::ostream &os, const std::vector<uint16_t> &order, bool includeEmptyColumns, bool aligned, size_t nr_of_threads) const
 {
+	using detail::value_style;
+
 	if (empty())
 		return;
 
+	detail::output_buffer out(os);
+
 	// If the first Row has a next, we need a loop_
 	bool needLoop = (m_head->m_next != nullptr);
 
 	std::vector<bool> right_aligned(m_columns.size(), false);
 
-	if (m_cat_validator != nullptr)
+	if (m_cat_validator != nullptr and aligned)
 	{
 		for (auto cix : order)
 		{
@@ -1879,85 +2899,282 @@ void category::write(std::ostream &os, const std::vector<uint16_t> &order, bool
 		}
 	}
 
+	auto value_text = [](const row *r, uint16_t cix)
+	{
+		std::string_view s;
+		auto iv = r->get(cix);
+		if (iv != nullptr)
+			s = iv->text();
+
+		if (s.empty())
+			s = "?";
+
+		return s;
+	};
+
 	if (needLoop)
 	{
-		os << "loop_\n";
+		out << "loop_\n";
 
 		std::vector<size_t> columnWidths(m_columns.size());
 
 		for (auto cix : order)
 		{
 			auto &col = m_columns[cix];
-			os << '_';
+			out << '_';
 			if (not m_name.empty())
-				os << m_name << '.';
-			os << col.m_name << ' ' << '\n';
+				out << m_name << '.';
+			out << col.m_name << ' ' << '\n';
 			columnWidths[cix] = 2;
 		}
 
-		for (auto r = m_head; r != nullptr; r = r->m_next)
+		// Large categories are divided into chunks of rows that are
+		// processed by separate threads
+		const size_t kRowsPerChunk = 8192;
+
+		std::vector<std::pair<const row *, const row *>> chunks;
+
+		if (nr_of_threads > 1 and size() >= 2 * kRowsPerChunk)
 		{
-			for (uint16_t ix = 0; ix < r->size(); ++ix)
+			size_t n = 0;
+			for (auto r = m_head; r != nullptr; r = r->m_next)
 			{
-				auto v = r->get(ix);
-				if (v == nullptr)
-					continue;
+				if (n++ % kRowsPerChunk == 0)
+				{
+					if (not chunks.empty())
+						chunks.back().second = r;
+					chunks.emplace_back(r, nullptr);
+				}
+			}
+		}
+		else
+			chunks.emplace_back(m_head, nullptr);
+
+		// The style for each value in each row, in the order of the columns
+		// in @a order. Only used when writing aligned output, since in that
+		// case each value would otherwise be classified twice.
+		std::vector<std::vector<value_style>> styles(chunks.size());
 
-				if (v->text().find('\n') == std::string_view::npos)
+		auto measure_chunk = [&](size_t chunk, std::vector<size_t> &widths)
+		{
+			auto &chunk_styles = styles[chunk];
+
+			for (auto r = chunks[chunk].first; r != chunks[chunk].second; r = r->m_next)
+			{
+				for (uint16_t cix : order)
 				{
-					size_t l = v->text().length();
+					auto s = value_text(r, cix);
+					auto style = detail::classify_value(s);
+					chunk_styles.push_back(style);
 
-					if (not sac_parser::is_unquoted_string(v->text()))
-						l += 2;
+					if (s.find('\n') != std::string_view::npos)
+						continue;
 
-					if (l > 132)
+					size_t l = detail::written_length(s, style);
+					if (l > kMaxLineLength)
 						continue;
 
-					if (columnWidths[ix] < l + 1)
-						columnWidths[ix] = l + 1;
+					if (widths[cix] < l + 1)
+						widths[cix] = l + 1;
 				}
 			}
-		}
+		};
 
-		for (auto r = m_head; r != nullptr; r = r->m_next) // loop over rows
+		auto format_chunk = [&](size_t chunk, detail::output_buffer &buffer)
 		{
-			size_t offset = 0;
+			auto style_i = styles[chunk].begin();
+
+			for (auto r = chunks[chunk].first; r != chunks[chunk].second; r = r->m_next)
+			{
+				size_t offset = 0;
+
+				for (uint16_t cix : order)
+				{
+					size_t w = aligned ? columnWidths[cix] : 0;
+
+					auto s = value_text(r, cix);
+					auto style = aligned ? *style_i++ : detail::classify_value(s);
+
+					size_t l = detail::written_length(s, style);
+					if (l < w)
+						l = w;
+
+					if (offset + l > kMaxLineLength and offset > 0)
+					{
+						buffer << '\n';
+						offset = 0;
+					}
+
+					offset = detail::write_value(buffer, s, style, offset, w, right_aligned[cix]);
+
+					if (offset > kMaxLineLength)
+					{
+						buffer << '\n';
+						offset = 0;
+					}
+				}
+
+				if (offset > 0)
+					buffer << '\n';
+
+				buffer.check();
+			}
+
+			// release memory as soon as possible
+			std::vector<value_style>().swap(styles[chunk]);
+		};
+
+		if (chunks.size() == 1)
+		{
+			if (aligned)
+			{
+				styles.front().reserve(size() * order.size());
+				measure_chunk(0, columnWidths);
+			}
 
-			for (uint16_t cix : order)
+			format_chunk(0, out);
+		}
+		else
+		{
+			if (aligned)
 			{
-				size_t w = columnWidths[cix];
+				// all chunks need to be measured before the first row can be written
+				std::vector<std::vector<size_t>> widths(chunks.size(), columnWidths);
+				std::vector<std::exception_ptr> errors(nr_of_threads);
+				std::atomic<size_t> next = 0;
+
+				auto measure_chunks = [&](size_t t)
+				{
+					try
+					{
+						for (size_t i = next++; i < chunks.size(); i = next++)
+							measure_chunk(i, widths[i]);
+					}
+					catch (...)
+					{
+						errors[t] = std::current_exception();
+					}
+				};
 
-				std::string_view s;
-				auto iv = r->get(cix);
-				if (iv != nullptr)
-					s = iv->text();
+				std::vector<std::thread> threads;
+				for (size_t t = 1; t < nr_of_threads; ++t)
+					threads.emplace_back(measure_chunks, t);
 
-				if (s.empty())
-					s = "?";
+				measure_chunks(0);
 
-				size_t l = s.length();
-				if (not sac_parser::is_unquoted_string(s))
-					l += 2;
-				if (l < w)
-					l = w;
+				for (auto &t : threads)
+					t.join();
 
-				if (offset + l > 132 and offset > 0)
+				for (auto &e : errors)
 				{
-					os << '\n';
-					offset = 0;
+					if (e)
+						std::rethrow_exception(e);
+				}
+
+				for (auto &w : widths)
+				{
+					for (auto cix : order)
+						columnWidths[cix] = std::max(columnWidths[cix], w[cix]);
 				}
+			}
 
-				offset = detail::write_value(os, s, offset, w, right_aligned[cix]);
+			// The chunks are formatted by worker threads while this thread
+			// writes the results in order. Workers stay at most a few chunks
+			// ahead of the writer to limit the memory used.
 
-				if (offset > 132)
+			struct formatted_chunk
+			{
+				std::string text;
+				bool done = false;
+				std::exception_ptr error;
+			};
+
+			std::vector<formatted_chunk> results(chunks.size());
+			std::mutex m;
+			std::condition_variable cv;
+			size_t next = 0, written = 0;
+			const size_t window = 2 * nr_of_threads;
+
+			auto format_chunks = [&]()
+			{
+				for (;;)
 				{
-					os << '\n';
-					offset = 0;
+					size_t i;
+
+					{
+						std::unique_lock lock(m);
+						cv.wait(lock, [&]
+							{ return next >= chunks.size() or next < written + window; });
+
+						if (next >= chunks.size())
+							break;
+
+						i = next++;
+					}
+
+					auto &result = results[i];
+
+					try
+					{
+						detail::output_buffer buffer;
+						format_chunk(i, buffer);
+						result.text = buffer.release();
+					}
+					catch (...)
+					{
+						result.error = std::current_exception();
+					}
+
+					std::lock_guard lock(m);
+					result.done = true;
+					cv.notify_all();
+				}
+			};
+
+			std::vector<std::thread> threads;
+			for (size_t t = 1; t < nr_of_threads; ++t)
+				threads.emplace_back(format_chunks);
+
+			std::exception_ptr error;
+
+			try
+			{
+				out.flush();
+
+				for (auto &result : results)
+				{
+					{
+						std::unique_lock lock(m);
+						cv.wait(lock, [&result]
+							{ return result.done; });
+					}
+
+					if (result.error)
+						std::rethrow_exception(result.error);
+
+					os.write(result.text.data(), result.text.length());
+					std::string().swap(result.text);
+
+					std::lock_guard lock(m);
+					++written;
+					cv.notify_all();
 				}
 			}
+			catch (...)
+			{
+				error = std::current_exception();
+
+				// stop the workers
+				std::lock_guard lock(m);
+				next = chunks.size();
+				cv.notify_all();
+			}
+
+			for (auto &t : threads)
+				t.join();
 
-			if (offset > 0)
-				os << '\n';
+			if (error)
+				std::rethrow_exception(error);
 		}
 	}
 	else
@@ -1982,18 +3199,8 @@ void category::write(std::ostream &os, const std::vector<uint16_t> &order, bool
 			if (not right_aligned[cix])
 				continue;
 
-			std::string_view s;
-			auto iv = m_head->get(cix);
-			if (iv != nullptr)
-				s = iv->text();
-
-			if (s.empty())
-				s = "?";
-
-			size_t l2 = s.length();
-
-			if (not sac_parser::is_unquoted_string(s))
-				l2 += 2;
+			auto s = value_text(m_head, cix);
+			size_t l2 = detail::written_length(s, detail::classify_value(s));
 
 			if (width < l2)
 				width = l2;
@@ -2003,32 +3210,38 @@ void category::write(std::ostream &os, const std::vector<uint16_t> &order, bool
 		{
 			auto &col = m_columns[cix];
 
-			os << '_';
+			out << '_';
 			if (not m_name.empty())
-				os << m_name << '.';
-			os << col.m_name << std::string(l - col.m_name.length() - m_name.length() - 2, ' ');
+				out << m_name << '.';
+			out << col.m_name;
 
-			std::string_view s;
-			auto iv = m_head->get(cix);
-			if (iv != nullptr)
-				s = iv->text();
+			size_t offset = 0;
+
+			if (aligned)
+			{
+				out.fill(l - col.m_name.length() - m_name.length() - 2);
+				offset = l;
+			}
+			else
+			{
+				out << ' ';
+				offset = col.m_name.length() + m_name.length() + 3;
+			}
 
-			if (s.empty())
-				s = "?";
+			auto s = value_text(m_head, cix);
 
-			size_t offset = l;
-			if (s.length() + l >= kMaxLineLength)
+			if (s.length() + offset >= kMaxLineLength)
 			{
-				os << '\n';
+				out << '\n';
 				offset = 0;
 			}
 
-			if (detail::write_value(os, s, offset, width, s.empty() or right_aligned[cix]) != 0)
-				os << '\n';
+			if (detail::write_value(out, s, detail::classify_value(s), offset, aligned ? width : 0, right_aligned[cix]) != 0)
+				out << '\n';
 		}
 	}
 
-	os << "# \n";
+	out << "# \n";
 }
 
 bool category::operator==(const category &rhs) const
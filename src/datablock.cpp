@@ -26,6 +26,11 @@
 
 #include "cif++/datablock.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <thread>
+
 namespace cif
 {
 
@@ -46,6 +51,8 @@ datablock &datablock::operator=(const datablock &db)
 		m_name = db.m_name;
 		m_validator = db.m_validator;
 
+		invalidate_directory();
+
 		for (auto &cat : *this)
 			cat.update_links(*this);
 	}
@@ -85,6 +92,105 @@ bool datablock::is_valid() const
 	return result;
 }
 
+bool datablock::is_valid(const parallel_policy &policy) const
+{
+	if (m_validator == nullptr)
+		throw std::runtime_error("Validator not specified");
+
+	// Categories with at least this many rows are validated using all
+	// threads each, the others are divided over the threads.
+	const size_t kLargeCategorySize = 8192;
+
+	size_t nr_of_threads = policy.m_nr_of_threads;
+	if (nr_of_threads == 0)
+		nr_of_threads = std::thread::hardware_concurrency();
+
+	struct outcome
+	{
+		const category *cat;
+		bool large;
+		bool valid = true;
+		std::vector<std::pair<std::string, bool>> reports;
+		std::exception_ptr error;
+	};
+
+	std::vector<outcome> outcomes;
+	for (auto &cat : *this)
+		outcomes.push_back({ &cat, cat.size() >= kLargeCategorySize });
+
+	std::atomic<size_t> next = 0;
+
+	auto validate_small = [&]()
+	{
+		for (;;)
+		{
+			size_t i = next++;
+			if (i >= outcomes.size())
+				break;
+
+			auto &o = outcomes[i];
+			if (o.large)
+				continue;
+
+			detail::report_collector collector;
+
+			try
+			{
+				o.valid = o.cat->is_valid();
+			}
+			catch (...)
+			{
+				o.error = std::current_exception();
+			}
+
+			o.reports = std::move(collector.m_reports);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < nr_of_threads; ++i)
+		threads.emplace_back(validate_small);
+
+	validate_small();
+
+	for (auto &t : threads)
+		t.join();
+
+	// report in the order of the categories
+	bool result = true;
+
+	for (auto &o : outcomes)
+	{
+		if (o.large)
+		{
+			result = o.cat->is_valid(policy) and result;
+			continue;
+		}
+
+		for (auto &[msg, fatal] : o.reports)
+			m_validator->report_error(msg, fatal);
+
+		if (o.error)
+			std::rethrow_exception(o.error);
+
+		result = o.valid and result;
+	}
+
+	return result;
+}
+
+bool datablock::is_valid(incremental_type) const
+{
+	if (m_validator == nullptr)
+		throw std::runtime_error("Validator not specified");
+
+	bool result = true;
+	for (auto &cat : *this)
+		result = cat.is_valid(incremental) and result;
+
+	return result;
+}
+
 bool datablock::validate_links() const
 {
 	bool result = true;
@@ -95,13 +201,72 @@ bool datablock::validate_links() const
 	return result;
 }
 
+bool datablock::validate_links(incremental_type) const
+{
+	bool result = true;
+
+	for (auto &cat : *this)
+		result = cat.validate_links(incremental) and result;
+
+	return result;
+}
+
 // --------------------------------------------------------------------
 
-category &datablock::operator[](std::string_view name)
+void datablock::rebuild_directory()
+{
+	m_directory.clear();
+	m_directory.reserve(size());
+
+	// In case of duplicate names, the first one wins, just like a linear search would
+	for (auto i = begin(); i != end(); ++i)
+		m_directory.emplace(i->name(), i);
+
+	m_directory_size = size();
+}
+
+datablock::iterator datablock::lookup(std::string_view name)
 {
-	auto i = std::find_if(begin(), end(), [name](const category &c)
-		{ return iequals(c.name(), name); });
+	// categories may have been added using the std::list interface
+	if (m_directory_size != size())
+		rebuild_directory();
+
+	auto i = m_directory.find(name);
+	if (i != m_directory.end() and iequals(i->second->name(), name))
+		return i->second;
+
+	// Either the name is not known or the directory is stale since a
+	// category was renamed by assigning another category to it. The
+	// number of categories is small, a linear search settles it.
+	auto result = std::find_if(begin(), end(), [name](const category &cat)
+		{ return iequals(cat.name(), name); });
+
+	if (result != end() or i != m_directory.end())
+		rebuild_directory();
+
+	return result;
+}
+
+datablock::const_iterator datablock::lookup(std::string_view name) const
+{
+	// The const version never updates the directory, it may be called
+	// from multiple threads at the same time. If the directory is out
+	// of date, or does not contain the name, a linear search is done.
+
+	if (m_directory_size == size())
+	{
+		auto i = m_directory.find(name);
+		if (i != m_directory.end() and iequals(i->second->name(), name))
+			return i->second;
+	}
 
+	return std::find_if(begin(), end(), [name](const category &cat)
+		{ return iequals(cat.name(), name); });
+}
+
+category &datablock::operator[](std::string_view name)
+{
+	auto i = lookup(name);
 	if (i != end())
 		return *i;
 
@@ -110,56 +275,48 @@ category &datablock::operator[](std::string_view name)
 	if (m_validator)
 		cat.set_validator(m_validator, *this);
 
-	return back();
+	m_directory.emplace(cat.name(), std::prev(end()));
+	m_directory_size = size();
+
+	return cat;
 }
 
 const category &datablock::operator[](std::string_view name) const
 {
 	static const category s_empty;
-	auto i = std::find_if(begin(), end(), [name](const category &c)
-		{ return iequals(c.name(), name); });
-	return i == end() ? s_empty : *i;
+	auto cat = get(name);
+	return cat == nullptr ? s_empty : *cat;
 }
 
 category *datablock::get(std::string_view name)
 {
-	auto i = std::find_if(begin(), end(), [name](const category &c)
-		{ return iequals(c.name(), name); });
+	auto i = lookup(name);
 	return i == end() ? nullptr : &*i;
 }
 
 const category *datablock::get(std::string_view name) const
 {
-	return const_cast<datablock *>(this)->get(name);
+	auto i = lookup(name);
+	return i == end() ? nullptr : &*i;
 }
 
 std::tuple<datablock::iterator, bool> datablock::emplace(std::string_view name)
 {
-	bool is_new = true;
-
-	auto i = begin();
-	while (i != end())
-	{
-		if (iequals(name, i->name()))
-		{
-			is_new = false;
-
-			if (i != begin())
-			{
-				auto n = std::next(i);
-				splice(begin(), *this, i, n);
-			}
-
-			break;
-		}
-
-		++i;
-	}
+	auto i = lookup(name);
+	bool is_new = i == end();
 
 	if (is_new)
 	{
 		auto &c = emplace_front(name);
 		c.set_validator(m_validator, *this);
+
+		m_directory.emplace(c.name(), begin());
+		m_directory_size = size();
+	}
+	else if (i != begin())
+	{
+		// splicing within the same list does not invalidate the iterators in the directory
+		std::list<category>::splice(begin(), *this, i);
 	}
 
 	return std::make_tuple(begin(), is_new);
@@ -198,40 +355,139 @@ std::vector<std::string> datablock::get_tag_order() const
 
 void datablock::write(std::ostream &os) const
 {
-	os << "data_" << m_name << '\n'
-	   << "# \n";
+	write(os, true, 1);
+}
+
+void datablock::write(std::ostream &os, unaligned_type) const
+{
+	write(os, false, 1);
+}
+
+void datablock::write(std::ostream &os, const parallel_policy &policy) const
+{
+	size_t nr_of_threads = policy.m_nr_of_threads;
+	if (nr_of_threads == 0)
+		nr_of_threads = std::thread::hardware_concurrency();
+
+	write(os, true, nr_of_threads);
+}
+
+void datablock::write(std::ostream &os, const parallel_policy &policy, unaligned_type) const
+{
+	size_t nr_of_threads = policy.m_nr_of_threads;
+	if (nr_of_threads == 0)
+		nr_of_threads = std::thread::hardware_concurrency();
+
+	write(os, false, nr_of_threads);
+}
+
+void datablock::write(std::ostream &os, bool aligned, size_t nr_of_threads) const
+{
+	// Categories with at least this many rows are formatted using all
+	// threads each, the others are divided over the threads.
+	const size_t kLargeCategorySize = 16384;
+
+	if (nr_of_threads == 0)
+		nr_of_threads = 1;
+
+	auto write_category = [aligned](const category &cat, std::ostream &out, size_t threads)
+	{
+		if (aligned)
+			cat.write(out, parallel_policy{ threads });
+		else
+			cat.write(out, parallel_policy{ threads }, unaligned);
+	};
 
 	// mmcif support, sort of. First write the 'entry' Category
 	// and if it exists, _AND_ we have a Validator, write out the
 	// audit_conform record.
 
+	std::vector<const category *> cats;
+
 	for (auto &cat : *this)
 	{
 		if (cat.name() != "entry")
 			continue;
 
-		cat.write(os);
+		cats.push_back(&cat);
 
 		break;
 	}
 
 	// If the dictionary declares an audit_conform category, put it in,
 	// but only if it does not exist already!
+	category auditConform("audit_conform");
+
 	if (get("audit_conform"))
-		get("audit_conform")->write(os);
+		cats.push_back(get("audit_conform"));
 	else if (m_validator != nullptr and m_validator->get_validator_for_category("audit_conform") != nullptr)
 	{
-		category auditConform("audit_conform");
 		auditConform.emplace({
 			{"dict_name", m_validator->name()},
 			{"dict_version", m_validator->version()}});
-		auditConform.write(os);
+		cats.push_back(&auditConform);
 	}
 
 	for (auto &cat : *this)
 	{
 		if (cat.name() != "entry" and cat.name() != "audit_conform")
-			cat.write(os);
+			cats.push_back(&cat);
+	}
+
+	// Format the small categories in parallel into separate buffers
+	std::vector<std::string> formatted(cats.size());
+
+	if (nr_of_threads > 1)
+	{
+		std::vector<std::exception_ptr> errors(nr_of_threads);
+		std::atomic<size_t> next = 0;
+
+		auto format_small = [&](size_t t)
+		{
+			try
+			{
+				for (size_t i = next++; i < cats.size(); i = next++)
+				{
+					if (cats[i]->size() >= kLargeCategorySize)
+						continue;
+
+					std::ostringstream out;
+					write_category(*cats[i], out, 1);
+					formatted[i] = std::move(out).str();
+				}
+			}
+			catch (...)
+			{
+				errors[t] = std::current_exception();
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (size_t t = 1; t < nr_of_threads; ++t)
+			threads.emplace_back(format_small, t);
+
+		format_small(0);
+
+		for (auto &t : threads)
+			t.join();
+
+		for (auto &e : errors)
+		{
+			if (e)
+				std::rethrow_exception(e);
+		}
+	}
+
+	// And write them in order, the large categories use all threads
+	os << "data_" << m_name << '\n'
+	   << "# \n";
+
+	for (size_t i = 0; i < cats.size(); ++i)
+	{
+		if (nr_of_threads > 1 and cats[i]->size() < kLargeCategorySize)
+			os.write(formatted[i].data(), formatted[i].length());
+		else
+			write_category(*cats[i], os, nr_of_threads);
 	}
 }
 
@@ -280,6 +536,19 @@ void datablock::write(std::ostream &os, const std::vector<std::string> &tag_orde
 	}
 }
 
+uint64_t datablock::hash() const
+{
+	uint64_t result = 0;
+
+	for (auto &cat : *this)
+	{
+		if (not cat.empty())
+			result += cat.hash();
+	}
+
+	return result;
+}
+
 bool datablock::operator==(const datablock &rhs) const
 {
 	auto &dbA = *this;
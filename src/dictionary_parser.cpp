@@ -208,7 +208,7 @@ class dictionary_parser : public parser
 			if (not(typeCode.empty() or typeCode == "?"))
 				tv = m_validator.get_validator_for_type(typeCode);
 
-			iset ess;
+			ihash_set ess;
 			for (auto e : dict["item_enumeration"])
 				ess.insert(e["value"].as<std::string>());
 
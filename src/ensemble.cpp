@@ -0,0 +1,246 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 NKI/AVL, Netherlands Cancer Institute
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "cif++/ensemble.hpp"
+#include "cif++/file.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+
+namespace cif::mm
+{
+
+namespace
+{
+	// The fields used to match the atoms of different models
+	const char *const kAtomKeyFields[] = {
+		"label_asym_id", "label_seq_id", "label_comp_id", "auth_seq_id", "pdbx_PDB_ins_code", "label_atom_id", "label_alt_id"
+	};
+
+	template <typename Get>
+	std::string make_atom_key(Get &&get)
+	{
+		std::string key;
+		for (auto field : kAtomKeyFields)
+		{
+			key += get(field);
+			key += '\x1f';
+		}
+		return key;
+	}
+
+	// The lowest model number in atom_site, model numbering does not
+	// necessarily start at 1
+	size_t get_first_model_nr(datablock &db)
+	{
+		std::optional<size_t> result;
+
+		for (auto model_nr : db["atom_site"].rows<std::optional<size_t>>("pdbx_PDB_model_num"))
+		{
+			if (model_nr and (not result or *model_nr < *result))
+				result = model_nr;
+		}
+
+		return result.value_or(1);
+	}
+} // namespace
+
+// --------------------------------------------------------------------
+
+ensemble::ensemble(file &f, StructureOpenOptions options)
+	: ensemble(f.front(), options)
+{
+}
+
+ensemble::ensemble(datablock &db, StructureOpenOptions options)
+	: m_structure(db, get_first_model_nr(db), options)
+{
+	auto &atoms = m_structure.atoms();
+	const size_t atom_count = m_atom_count = atoms.size();
+
+	std::unordered_map<std::string, size_t> key_index;
+	key_index.reserve(atom_count);
+
+	m_frames.reserve(atom_count);
+	m_atom_index.reserve(atom_count);
+
+	for (size_t i = 0; i < atom_count; ++i)
+	{
+		auto &a = atoms[i];
+
+		m_frames.push_back(a.get_location());
+		m_atom_index.emplace(a.id(), i);
+
+		auto key = make_atom_key([&a](std::string_view field)
+			{ return a.get_property(field); });
+		if (not key_index.emplace(std::move(key), i).second)
+			throw std::runtime_error("Atom " + a.id() + " cannot be distinguished from other atoms in model " + std::to_string(m_structure.get_model_nr()));
+	}
+
+	const size_t first_model_nr = m_structure.get_model_nr();
+	m_model_numbers.push_back(first_model_nr);
+
+	// A single pass over atom_site collecting the locations for all other models
+
+	std::unordered_map<size_t, size_t> frame_index;
+	std::vector<bool> assigned;
+
+	auto &atom_site = db["atom_site"];
+	for (auto r : atom_site)
+	{
+		auto model_nr = r["pdbx_PDB_model_num"].value_or<size_t>(first_model_nr);
+		if (model_nr == first_model_nr)
+			continue;
+
+		auto ki = key_index.find(make_atom_key([&r](std::string_view field)
+			{ return r[field].as<std::string>(); }));
+		if (ki == key_index.end())
+			continue;
+
+		auto fi = frame_index.find(model_nr);
+		if (fi == frame_index.end())
+		{
+			fi = frame_index.emplace(model_nr, m_model_numbers.size()).first;
+			m_model_numbers.push_back(model_nr);
+			m_frames.resize(m_frames.size() + atom_count);
+			assigned.resize(assigned.size() + atom_count);
+		}
+
+		size_t ix = (fi->second - 1) * atom_count + ki->second;
+		if (assigned[ix])
+			throw std::runtime_error("Duplicate atom in model " + std::to_string(model_nr));
+		assigned[ix] = true;
+
+		auto &p = m_frames[fi->second * atom_count + ki->second];
+		cif::tie(p.m_x, p.m_y, p.m_z) = r.get("Cartn_x", "Cartn_y", "Cartn_z");
+	}
+
+	for (size_t frame = 1; frame < m_model_numbers.size(); ++frame)
+	{
+		auto b = assigned.begin() + (frame - 1) * atom_count;
+		if (std::find(b, b + atom_count, false) != b + atom_count)
+			throw std::runtime_error("Model " + std::to_string(m_model_numbers[frame]) + " does not contain the same atoms as model " + std::to_string(first_model_nr));
+	}
+
+	// The average frame and the mean square fluctuations are needed by
+	// all analyses, calculate them once
+
+	m_average.resize(atom_count);
+	for (size_t frame = 0; frame < size(); ++frame)
+	{
+		auto f = get_frame(frame);
+		for (size_t i = 0; i < atom_count; ++i)
+			m_average[i] += f[i];
+	}
+
+	for (auto &p : m_average)
+		p /= static_cast<float>(size());
+
+	m_mean_square_fluctuation.assign(atom_count, 0);
+	for (size_t frame = 0; frame < size(); ++frame)
+	{
+		auto f = get_frame(frame);
+		for (size_t i = 0; i < atom_count; ++i)
+			m_mean_square_fluctuation[i] += distance_squared(f[i], m_average[i]);
+	}
+
+	for (auto &msf : m_mean_square_fluctuation)
+		msf /= size();
+}
+
+std::span<const point> ensemble::get_frame(size_t frame) const
+{
+	if (frame >= size())
+		throw std::out_of_range("Invalid frame index");
+
+	return { m_frames.data() + frame * m_atom_count, m_atom_count };
+}
+
+size_t ensemble::get_atom_index(const atom &a) const
+{
+	auto i = m_atom_index.find(a.id());
+	if (i == m_atom_index.end() or m_structure.atoms()[i->second] != a)
+		throw std::runtime_error("Atom " + a.id() + " is not part of this ensemble");
+	return i->second;
+}
+
+double ensemble::rmsd(size_t a, size_t b, const structure::atom_filter &filter) const
+{
+	auto fa = get_frame(a);
+	auto fb = get_frame(b);
+	auto &atoms = m_structure.atoms();
+
+	double sum = 0;
+	size_t n = 0;
+
+	for (size_t i = 0; i < fa.size(); ++i)
+	{
+		if (filter and not filter(atoms[i]))
+			continue;
+
+		sum += distance_squared(fa[i], fb[i]);
+		++n;
+	}
+
+	return n ? std::sqrt(sum / n) : 0;
+}
+
+std::vector<float> ensemble::get_fluctuations() const
+{
+	std::vector<float> result(m_atom_count);
+	for (size_t i = 0; i < m_atom_count; ++i)
+		result[i] = static_cast<float>(std::sqrt(m_mean_square_fluctuation[i]));
+
+	return result;
+}
+
+float ensemble::get_fluctuation(const residue &res) const
+{
+	double sum = 0;
+	size_t n = 0;
+
+	for (auto &a : res.atoms())
+	{
+		sum += m_mean_square_fluctuation[get_atom_index(a)];
+		++n;
+	}
+
+	return n ? static_cast<float>(std::sqrt(sum / n)) : 0;
+}
+
+std::vector<float> ensemble::get_fluctuations(const std::vector<const residue *> &residues) const
+{
+	std::vector<float> result;
+	result.reserve(residues.size());
+
+	for (auto res : residues)
+		result.push_back(get_fluctuation(*res));
+
+	return result;
+}
+
+} // namespace cif::mm
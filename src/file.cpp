@@ -87,6 +87,49 @@ bool file::validate_links() const
 	return result;
 }
 
+bool file::is_valid(const parallel_policy &policy) const
+{
+	if (m_validator == nullptr)
+		throw std::runtime_error("No validator loaded explicitly, cannot continue");
+
+	bool result = true;
+	for (auto &d : *this)
+		result = d.is_valid(policy) and result;
+
+	if (result)
+		result = validate_links();
+
+	return result;
+}
+
+bool file::is_valid(incremental_type) const
+{
+	if (m_validator == nullptr)
+		throw std::runtime_error("No validator loaded explicitly, cannot continue");
+
+	bool result = true;
+	for (auto &d : *this)
+		result = d.is_valid(incremental) and result;
+
+	if (result)
+		result = validate_links(incremental);
+
+	return result;
+}
+
+bool file::validate_links(incremental_type) const
+{
+	if (m_validator == nullptr)
+		throw std::runtime_error("No validator loaded explicitly, cannot continue");
+
+	bool result = true;
+
+	for (auto &db : *this)
+		result = db.validate_links(incremental) and result;
+
+	return result;
+}
+
 void file::load_dictionary()
 {
 	if (not empty())
@@ -225,4 +268,40 @@ void file::save(std::ostream &os) const
 		db.write(os);
 }
 
+void file::save(const std::filesystem::path &p, unaligned_type) const
+{
+	gzio::ofstream outFile(p);
+	save(outFile, unaligned);
+}
+
+void file::save(std::ostream &os, unaligned_type) const
+{
+	for (auto &db : *this)
+		db.write(os, unaligned);
+}
+
+void file::save(const std::filesystem::path &p, const parallel_policy &policy) const
+{
+	gzio::ofstream outFile(p);
+	save(outFile, policy);
+}
+
+void file::save(std::ostream &os, const parallel_policy &policy) const
+{
+	for (auto &db : *this)
+		db.write(os, policy);
+}
+
+void file::save(const std::filesystem::path &p, const parallel_policy &policy, unaligned_type) const
+{
+	gzio::ofstream outFile(p);
+	save(outFile, policy, unaligned);
+}
+
+void file::save(std::ostream &os, const parallel_policy &policy, unaligned_type) const
+{
+	for (auto &db : *this)
+		db.write(os, policy, unaligned);
+}
+
 } // namespace cif
\ No newline at end of file
@@ -26,11 +26,14 @@
 
 #include "cif++.hpp"
 
+#include <array>
 #include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <numeric>
+#include <set>
 #include <stack>
+#include <unordered_map>
 
 namespace fs = std::filesystem;
 
@@ -40,6 +43,18 @@ namespace cif::mm
 // --------------------------------------------------------------------
 // atom
 
+namespace
+{
+	// Coordinates are stored with three digits after the decimal point
+	std::string_view format_coordinate(char (&buffer)[32], float v)
+	{
+		auto [ptr, ec] = cif::to_chars_fixed(buffer, buffer + sizeof(buffer), v, 3);
+		if (ec != std::errc())
+			throw std::runtime_error("Could not format coordinate");
+		return { buffer, static_cast<size_t>(ptr - buffer) };
+	}
+} // namespace
+
 void atom::atom_impl::moveTo(const point &p)
 {
 	if (m_symop != "1_555")
@@ -47,20 +62,54 @@ void atom::atom_impl::moveTo(const point &p)
 
 	auto r = row();
 
-#if __cpp_lib_format
-	r.assign("Cartn_x", std::format("{:.3f}", p.m_x), false, false);
-	r.assign("Cartn_y", std::format("{:.3f}", p.m_y), false, false);
-	r.assign("Cartn_z", std::format("{:.3f}", p.m_z), false, false);
-#else
-	r.assign("Cartn_x", cif::format("%.3f", p.m_x).str(), false, false);
-	r.assign("Cartn_y", cif::format("%.3f", p.m_y).str(), false, false);
-	r.assign("Cartn_z", cif::format("%.3f", p.m_z).str(), false, false);
-#endif
+	char buffer[32];
+	r.assign("Cartn_x", format_coordinate(buffer, p.m_x), false, false);
+	r.assign("Cartn_y", format_coordinate(buffer, p.m_y), false, false);
+	r.assign("Cartn_z", format_coordinate(buffer, p.m_z), false, false);
+
+	m_location = p;
+}
+
+void atom::atom_impl::moveTo(const point &p, uint16_t x_ix, uint16_t y_ix, uint16_t z_ix)
+{
+	if (m_symop != "1_555")
+		throw std::runtime_error("Moving symmetry copy");
+
+	auto r = row();
+
+	char buffer[32];
+	r.assign(x_ix, format_coordinate(buffer, p.m_x), false, false);
+	r.assign(y_ix, format_coordinate(buffer, p.m_y), false, false);
+	r.assign(z_ix, format_coordinate(buffer, p.m_z), false, false);
+
 	m_location = p;
 }
 
 // const compound *compound() const;
 
+namespace
+{
+	template <typename T>
+	T property_to_number(const item_handle &item, std::string_view name)
+	{
+		T result = 0;
+		if (not item.empty())
+		{
+			auto s = item.text();
+
+			std::from_chars_result r;
+			if constexpr (std::is_floating_point_v<T>)
+				r = cif::from_chars(s.data(), s.data() + s.length(), result);
+			else
+				r = std::from_chars(s.data(), s.data() + s.length(), result);
+
+			if (r.ec != std::errc() and VERBOSE > 0)
+				std::cerr << "Error converting " << s << " to number for property " << name << '\n';
+		}
+		return result;
+	}
+} // namespace
+
 std::string atom::atom_impl::get_property(std::string_view name) const
 {
 	return row()[name].as<std::string>();
@@ -68,30 +117,27 @@ std::string atom::atom_impl::get_property(std::string_view name) const
 
 int atom::atom_impl::get_property_int(std::string_view name) const
 {
-	int result = 0;
-	if (not row()[name].empty())
-	{
-		auto s = get_property(name);
-
-		std::from_chars_result r = std::from_chars(s.data(), s.data() + s.length(), result);
-		if (r.ec != std::errc() and VERBOSE > 0)
-			std::cerr << "Error converting " << s << " to number for property " << name << '\n';
-	}
-	return result;
+	return property_to_number<int>(row()[name], name);
 }
 
 float atom::atom_impl::get_property_float(std::string_view name) const
 {
-	float result = 0;
-	if (not row()[name].empty())
-	{
-		auto s = get_property(name);
+	return property_to_number<float>(row()[name], name);
+}
 
-		std::from_chars_result r = cif::from_chars(s.data(), s.data() + s.length(), result);
-		if (r.ec != std::errc() and VERBOSE > 0)
-			std::cerr << "Error converting " << s << " to number for property " << name << '\n';
-	}
-	return result;
+std::string atom::atom_impl::get_property(const column_ref &column) const
+{
+	return row()[column].as<std::string>();
+}
+
+int atom::atom_impl::get_property_int(const column_ref &column) const
+{
+	return property_to_number<int>(row()[column], column.name());
+}
+
+float atom::atom_impl::get_property_float(const column_ref &column) const
+{
+	return property_to_number<float>(row()[column], column.name());
 }
 
 void atom::atom_impl::set_property(const std::string_view name, const std::string &value)
@@ -883,20 +929,36 @@ bool monomer::is_cis(const monomer &a, const monomer &b)
 // --------------------------------------------------------------------
 // polymer
 
+namespace
+{
+	std::vector<row_handle> find_scheme_rows(const category &scheme, const std::string &asym_id)
+	{
+		using namespace cif::literals;
+
+		std::vector<row_handle> result;
+		for (auto r : scheme.find("asym_id"_key == asym_id))
+			result.push_back(r);
+		return result;
+	}
+} // namespace
+
 polymer::polymer(structure &s, const std::string &entityID, const std::string &asym_id, const std::string &auth_asym_id)
+	: polymer(s, entityID, asym_id, auth_asym_id, find_scheme_rows(s.get_datablock()["pdbx_poly_seq_scheme"], asym_id))
+{
+}
+
+polymer::polymer(structure &s, const std::string &entityID, const std::string &asym_id, const std::string &auth_asym_id,
+	const std::vector<row_handle> &poly_seq_scheme_rows)
 	: m_structure(const_cast<structure *>(&s))
 	, m_entity_id(entityID)
 	, m_asym_id(asym_id)
 	, m_auth_asym_id(auth_asym_id)
 {
-	using namespace cif::literals;
-
-	std::map<size_t, size_t> ix;
+	std::set<int> seen;
 
-	auto &poly_seq_scheme = s.get_datablock()["pdbx_poly_seq_scheme"];
-	reserve(poly_seq_scheme.size());
+	reserve(poly_seq_scheme_rows.size());
 
-	for (auto r : poly_seq_scheme.find("asym_id"_key == asym_id))
+	for (auto r : poly_seq_scheme_rows)
 	{
 		int seqID;
 		std::optional<int> pdbSeqNum;
@@ -909,9 +971,8 @@ polymer::polymer(structure &s, const std::string &entityID, const std::string &a
 		size_t index = size();
 
 		// store only the first
-		if (not ix.count(seqID))
+		if (seen.insert(seqID).second)
 		{
-			ix[seqID] = index;
 			emplace_back(*this, index, seqID, authSeqID, pdbInsCode, compoundID);
 		}
 		else if (VERBOSE > 0)
@@ -1071,6 +1132,12 @@ cif::mm::atom sugar::add_atom(row_initializer atom_info)
 }
 
 branch::branch(structure &structure, const std::string &asym_id, const std::string &entity_id)
+	: branch(structure, asym_id, entity_id, find_scheme_rows(structure.get_datablock()["pdbx_branch_scheme"], asym_id))
+{
+}
+
+branch::branch(structure &structure, const std::string &asym_id, const std::string &entity_id,
+	const std::vector<row_handle> &branch_scheme_rows)
 	: m_structure(&structure)
 	, m_asym_id(asym_id)
 	, m_entity_id(entity_id)
@@ -1079,14 +1146,13 @@ branch::branch(structure &structure, const std::string &asym_id, const std::stri
 
 	auto &db = structure.get_datablock();
 	auto &struct_asym = db["struct_asym"];
-	auto &branch_scheme = db["pdbx_branch_scheme"];
 	auto &branch_link = db["pdbx_entity_branch_link"];
 
 	for (const auto &asym_entity_id : struct_asym.find<std::string>("id"_key == asym_id, "entity_id"))
 	{
-		for (const auto &[comp_id, num] : branch_scheme.find<std::string, int>(
-				 "asym_id"_key == asym_id, "mon_id", "pdb_seq_num"))
+		for (auto r : branch_scheme_rows)
 		{
+			const auto &[comp_id, num] = r.get<std::string, int>("mon_id", "pdb_seq_num");
 			emplace_back(*this, comp_id, asym_id, num);
 		}
 
@@ -1165,7 +1231,9 @@ sugar &branch::construct_sugar(const std::string &compound_id)
 			{"type", compound->type()}});
 	}
 
+	m_structure->unindex_branch(*this);
 	sugar &result = emplace_back(*this, compound_id, m_asym_id, static_cast<int>(size() + 1));
+	m_structure->index_branch(*this);
 
 	db["pdbx_branch_scheme"].emplace({
 		{"asym_id", result.get_asym_id()},
@@ -1252,6 +1320,36 @@ float branch::weight() const
 // --------------------------------------------------------------------
 //	structure
 
+namespace
+{
+	// Atom IDs are ordered numerically when both consist of digits only,
+	// numeric IDs sort before all others. Ties between numerically equal
+	// IDs (e.g. leading zeros) are broken by comparing the text.
+	int compare_atom_id(std::string_view a, std::string_view b)
+	{
+		auto is_number = [](std::string_view s)
+		{ return not s.empty() and std::all_of(s.begin(), s.end(), [](char ch) { return ch >= '0' and ch <= '9'; }); };
+
+		bool na = is_number(a), nb = is_number(b);
+
+		if (na and nb)
+		{
+			auto sa = a.substr(std::min(a.find_first_not_of('0'), a.length()));
+			auto sb = b.substr(std::min(b.find_first_not_of('0'), b.length()));
+
+			if (sa.length() != sb.length())
+				return sa.length() < sb.length() ? -1 : 1;
+
+			if (int d = sa.compare(sb); d != 0)
+				return d;
+		}
+		else if (na != nb)
+			return na ? -1 : 1;
+
+		return a.compare(b);
+	}
+} // namespace
+
 structure::structure(file &p, size_t modelNr, StructureOpenOptions options)
 	: structure(p.front(), modelNr, options)
 {
@@ -1298,8 +1396,37 @@ void structure::load_atoms_for_model(StructureOpenOptions options)
 	if (options bitand StructureOpenOptions::SkipHydrogen)
 		c = std::move(c) and ("type_symbol"_key != "H" and "type_symbol"_key != "D");
 
-	for (auto id : atomCat.find<std::string>(std::move(c), "id"))
-		emplace_atom(std::make_shared<atom::atom_impl>(m_db, id));
+	// Single pass over atom_site, the rows are bound directly to the new atoms
+	std::set<std::string> symbols;
+	for (auto r : atomCat.find(std::move(c)))
+	{
+		auto &a = m_atoms.emplace_back(std::make_shared<atom::atom_impl>(m_db, r));
+		a.m_impl->m_columns = m_atom_columns;
+		symbols.insert(a.get_property("type_symbol"));
+	}
+
+	// and the index is sorted once
+	m_atom_index.resize(m_atoms.size());
+	std::iota(m_atom_index.begin(), m_atom_index.end(), 0);
+
+	std::sort(m_atom_index.begin(), m_atom_index.end(), [this](size_t a, size_t b)
+		{ return compare_atom_id(m_atoms[a].id(), m_atoms[b].id()) < 0; });
+
+	for (size_t i = 0; i + 1 < m_atom_index.size(); ++i)
+	{
+		if (m_atoms[m_atom_index[i]].id() == m_atoms[m_atom_index[i + 1]].id())
+			throw std::runtime_error("Duplicate atom ID " + m_atoms[m_atom_index[i]].id());
+	}
+
+	invalidate_indexes();
+
+	// make sure the atom_types are known
+	auto &atom_type = m_db["atom_type"];
+	for (auto &symbol : symbols)
+	{
+		if (not atom_type.exists("symbol"_key == symbol))
+			atom_type.emplace({ { "symbol", symbol } });
+	}
 }
 
 // structure::structure(const structure &s)
@@ -1317,23 +1444,73 @@ void structure::load_atoms_for_model(StructureOpenOptions options)
 // {
 // }
 
+namespace
+{
+	inline void combine_hash(size_t &seed, size_t v)
+	{
+		seed ^= v + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+	}
+
+	// Residues are looked up by the number of their asym_id in the
+	// order of first appearance, their seq_id and their auth_seq_id
+	struct residue_key
+	{
+		uint32_t m_asym_nr;
+		int m_seq_id;
+		std::string m_auth_seq_id;
+
+		bool operator==(const residue_key &rhs) const = default;
+	};
+
+	struct residue_key_hash
+	{
+		size_t operator()(const residue_key &k) const
+		{
+			size_t h = std::hash<std::string>{}(k.m_auth_seq_id);
+			combine_hash(h, static_cast<size_t>(k.m_asym_nr) << 32 | static_cast<uint32_t>(k.m_seq_id));
+			return h;
+		}
+	};
+
+	// Collect the rows of a scheme category grouped by asym_id, in
+	// order of first appearance, in a single pass.
+	std::vector<std::tuple<std::string, std::string, std::vector<row_handle>>> group_scheme_rows(const category &scheme)
+	{
+		std::vector<std::tuple<std::string, std::string, std::vector<row_handle>>> result;
+		std::unordered_map<std::string, size_t> index;
+
+		for (auto r : scheme)
+		{
+			const auto &[asym_id, entity_id] = r.get<std::string, std::string>("asym_id", "entity_id");
+
+			auto i = index.find(asym_id);
+			if (i == index.end())
+			{
+				i = index.emplace(asym_id, result.size()).first;
+				result.emplace_back(asym_id, entity_id, std::vector<row_handle>{});
+			}
+
+			std::get<2>(result[i->second]).push_back(r);
+		}
+
+		return result;
+	}
+} // namespace
+
 void structure::load_data()
 {
 	auto &polySeqScheme = m_db["pdbx_poly_seq_scheme"];
 
-	for (const auto &[asym_id, auth_asym_id, entityID] : polySeqScheme.rows<std::string,std::string,std::string>("asym_id", "pdb_strand_id", "entity_id"))
+	for (auto &[asym_id, entityID, rows] : group_scheme_rows(polySeqScheme))
 	{
-		if (m_polymers.empty() or m_polymers.back().get_asym_id() != asym_id or m_polymers.back().get_entity_id() != entityID)
-			m_polymers.emplace_back(*this, entityID, asym_id, auth_asym_id);
+		auto auth_asym_id = rows.front()["pdb_strand_id"].as<std::string>();
+		m_polymers.emplace_back(*this, entityID, asym_id, auth_asym_id, rows);
 	}
 
 	auto &branchScheme = m_db["pdbx_branch_scheme"];
 
-	for (const auto &[asym_id, entity_id] : branchScheme.rows<std::string,std::string>("asym_id", "entity_id"))
-	{
-		if (m_branches.empty() or m_branches.back().get_asym_id() != asym_id)
-			m_branches.emplace_back(*this, asym_id, entity_id);
-	}
+	for (auto &[asym_id, entity_id, rows] : group_scheme_rows(branchScheme))
+		m_branches.emplace_back(*this, asym_id, entity_id, rows);
 
 	auto &nonPolyScheme = m_db["pdbx_nonpoly_scheme"];
 
@@ -1343,52 +1520,65 @@ void structure::load_data()
 
 	// place atoms in residues
 
-	using key_type = std::tuple<std::string, int, std::string>;
-	std::map<key_type, residue *> resMap;
+	std::unordered_map<std::string, uint32_t> asymNr;
+	std::unordered_map<residue_key, residue *, residue_key_hash> resMap;
+
+	auto add_residue = [&](residue &res)
+	{
+		auto asym_nr = asymNr.emplace(res.get_asym_id(), static_cast<uint32_t>(asymNr.size())).first->second;
+		resMap[{ asym_nr, res.get_seq_id(), res.get_auth_seq_id() }] = &res;
+	};
 
 	for (auto &poly : m_polymers)
 	{
 		for (auto &res : poly)
-			resMap[{res.get_asym_id(), res.get_seq_id(), res.get_auth_seq_id()}] = &res;
+			add_residue(res);
 	}
 
 	for (auto &res : m_non_polymers)
-		resMap[{res.get_asym_id(), res.get_seq_id(), res.get_auth_seq_id()}] = &res;
+		add_residue(res);
 
 	std::set<std::string> sugars;
 	for (auto &branch : m_branches)
 	{
 		for (auto &sugar : branch)
 		{
-			resMap[{sugar.get_asym_id(), sugar.get_seq_id(), sugar.get_auth_seq_id()}] = &sugar;
+			add_residue(sugar);
 			sugars.insert(sugar.get_compound_id());
 		}
 	}
 
+	// the first non-polymer for each asym, used for atoms without a matching residue
+	std::vector<residue *> firstNonPoly(asymNr.size(), nullptr);
+	for (auto ri = m_non_polymers.rbegin(); ri != m_non_polymers.rend(); ++ri)
+		firstNonPoly[asymNr[ri->get_asym_id()]] = &*ri;
+
 	for (auto &atom : m_atoms)
 	{
-		key_type k(atom.get_label_asym_id(), atom.get_label_seq_id(), atom.get_auth_seq_id());
-		auto ri = resMap.find(k);
+		residue *res = nullptr;
 
-		if (ri == resMap.end())
+		auto ai = asymNr.find(atom.get_label_asym_id());
+		if (ai != asymNr.end())
+		{
+			auto ri = resMap.find({ ai->second, atom.get_label_seq_id(), atom.get_auth_seq_id() });
+			if (ri != resMap.end())
+				res = ri->second;
+		}
+
+		if (res == nullptr)
 		{
 			if (VERBOSE > 0)
 				std::cerr << "Missing residue for atom " << atom << '\n';
 
 			// see if it might match a non poly
-			for (auto &res : m_non_polymers)
-			{
-				if (res.get_asym_id() != atom.get_label_asym_id())
-					continue;
-
-				res.add_atom(atom);
-				break;
-			}
+			if (ai != asymNr.end())
+				res = firstNonPoly[ai->second];
 
-			continue;
+			if (res == nullptr)
+				continue;
 		}
 
-		ri->second->add_atom(atom);
+		res->add_atom(atom);
 	}
 
 	// what the ...
@@ -1396,6 +1586,8 @@ void structure::load_data()
 
 	for (auto &branch : m_branches)
 		branch.link_atoms();
+
+	invalidate_indexes();
 }
 
 EntityType structure::get_entity_type_for_entity_id(const std::string entityID) const
@@ -1457,6 +1649,348 @@ EntityType structure::get_entity_type_for_asym_id(const std::string asym_id) con
 // 	return result;
 // }
 
+// --------------------------------------------------------------------
+
+namespace
+{
+	// The index of the first element that moves when appending to \a v
+	template <typename T>
+	size_t first_moved(const std::vector<T> &v)
+	{
+		return v.size() < v.capacity() ? v.size() : 0;
+	}
+
+	enum class residue_kind : uint8_t
+	{
+		non_poly_any, // first non-polymer for an asym, regardless of auth_seq_id
+		non_poly,
+		monomer,
+		sugar
+	};
+
+	struct residue_lookup_key
+	{
+		residue_kind m_kind;
+		bool m_with_compound;
+		std::string m_asym_id;
+		int m_seq_id;
+		std::string m_auth_seq_id;
+		std::string m_compound_id;
+
+		bool operator==(const residue_lookup_key &rhs) const = default;
+	};
+
+	struct residue_lookup_key_hash
+	{
+		size_t operator()(const residue_lookup_key &k) const
+		{
+			size_t h = std::hash<std::string>{}(k.m_asym_id);
+			combine_hash(h, static_cast<size_t>(k.m_kind) << 40 | static_cast<size_t>(k.m_with_compound) << 32 | static_cast<uint32_t>(k.m_seq_id));
+			combine_hash(h, std::hash<std::string>{}(k.m_auth_seq_id));
+			combine_hash(h, std::hash<std::string>{}(k.m_compound_id));
+			return h;
+		}
+	};
+
+	struct atom_label_key
+	{
+		std::string m_atom_id;
+		std::string m_asym_id;
+		std::string m_compound_id;
+		int m_seq_id;
+		std::string m_alt_id;
+
+		bool operator==(const atom_label_key &rhs) const = default;
+	};
+
+	struct atom_label_key_hash
+	{
+		size_t operator()(const atom_label_key &k) const
+		{
+			size_t h = std::hash<std::string>{}(k.m_atom_id);
+			combine_hash(h, std::hash<std::string>{}(k.m_asym_id));
+			combine_hash(h, std::hash<std::string>{}(k.m_compound_id));
+			combine_hash(h, static_cast<uint32_t>(k.m_seq_id));
+			combine_hash(h, std::hash<std::string>{}(k.m_alt_id));
+			return h;
+		}
+	};
+} // namespace
+
+struct structure::residue_index
+{
+	// The number of containers and residues at the time the index was
+	// last updated, a mismatch means residues were added or removed
+	// directly, through the references returned by polymers() or branches()
+	struct shape
+	{
+		size_t m_polymers = 0, m_branches = 0, m_non_polymers = 0;
+		size_t m_monomers = 0, m_sugars = 0;
+
+		bool operator==(const shape &rhs) const = default;
+	};
+
+	static shape shape_of(const structure &s)
+	{
+		shape result{ s.m_polymers.size(), s.m_branches.size(), s.m_non_polymers.size() };
+		for (auto &poly : s.m_polymers)
+			result.m_monomers += poly.size();
+		for (auto &branch : s.m_branches)
+			result.m_sugars += branch.size();
+		return result;
+	}
+
+	shape m_shape;
+
+	std::unordered_map<residue_lookup_key, residue *, residue_lookup_key_hash> m_residues;
+	std::unordered_map<std::string, polymer *> m_polymers;
+	std::unordered_map<std::string, branch *> m_branches;
+
+	residue *find_residue(residue_kind kind, const std::string &asym_id, int seq_id, const std::string &auth_seq_id) const
+	{
+		auto i = m_residues.find({ kind, false, asym_id, seq_id, auth_seq_id, {} });
+		return i == m_residues.end() ? nullptr : i->second;
+	}
+
+	residue *find_residue(residue_kind kind, const std::string &asym_id, int seq_id, const std::string &auth_seq_id,
+		const std::string &compound_id) const
+	{
+		auto i = m_residues.find({ kind, true, asym_id, seq_id, auth_seq_id, compound_id });
+		return i == m_residues.end() ? nullptr : i->second;
+	}
+
+	// The keys for a residue, the first one is only used for non-polymers
+	static std::array<residue_lookup_key, 3> keys_for(const residue &res)
+	{
+		auto kind = residue_kind::non_poly;
+		if (dynamic_cast<const monomer *>(&res) != nullptr)
+			kind = residue_kind::monomer;
+		else if (dynamic_cast<const sugar *>(&res) != nullptr)
+			kind = residue_kind::sugar;
+
+		int seq_id = kind == residue_kind::monomer ? res.get_seq_id() : 0;
+		std::string auth_seq_id = kind == residue_kind::monomer ? std::string{} : res.get_auth_seq_id();
+
+		return { residue_lookup_key{ kind == residue_kind::non_poly ? residue_kind::non_poly_any : kind, false, res.get_asym_id(), seq_id, {}, {} },
+			residue_lookup_key{ kind, false, res.get_asym_id(), seq_id, auth_seq_id, {} },
+			residue_lookup_key{ kind, true, res.get_asym_id(), seq_id, auth_seq_id, res.get_compound_id() } };
+	}
+
+	void add(residue &res)
+	{
+		auto keys = keys_for(res);
+
+		// the first residue wins, as it would in a linear search
+		for (size_t i = keys[0].m_kind == residue_kind::non_poly_any ? 0 : 1; i < keys.size(); ++i)
+			m_residues.try_emplace(std::move(keys[i]), &res);
+	}
+
+	void remove(const residue &res)
+	{
+		for (auto &key : keys_for(res))
+		{
+			if (auto i = m_residues.find(key); i != m_residues.end() and i->second == &res)
+				m_residues.erase(i);
+		}
+	}
+
+	void add(polymer &poly)
+	{
+		m_polymers.try_emplace(poly.get_asym_id(), &poly);
+		for (auto &res : poly)
+			add(res);
+	}
+
+	void remove(const polymer &poly)
+	{
+		if (auto i = m_polymers.find(poly.get_asym_id()); i != m_polymers.end() and i->second == &poly)
+			m_polymers.erase(i);
+		for (auto &res : poly)
+			remove(res);
+	}
+
+	void add(branch &branch)
+	{
+		m_branches.try_emplace(branch.get_asym_id(), &branch);
+		for (auto &sugar : branch)
+		{
+			if (sugar.get_asym_id() == branch.get_asym_id())
+				add(sugar);
+		}
+	}
+
+	void remove(const branch &branch)
+	{
+		if (auto i = m_branches.find(branch.get_asym_id()); i != m_branches.end() and i->second == &branch)
+			m_branches.erase(i);
+		for (auto &sugar : branch)
+			remove(sugar);
+	}
+};
+
+struct structure::atom_label_index
+{
+	static atom_label_key key_for(const atom &a)
+	{
+		return { a.get_label_atom_id(), a.get_label_asym_id(), a.get_label_comp_id(), a.get_label_seq_id(), a.get_label_alt_id() };
+	}
+
+	void add(const atom &a)
+	{
+		// the first atom wins, as it would in a linear search
+		if (not m_atoms.try_emplace(key_for(a), a).second)
+			m_duplicates = true;
+	}
+
+	// Returns false if the index needs to be rebuilt
+	bool remove(const atom &a)
+	{
+		auto i = m_atoms.find(key_for(a));
+		if (i == m_atoms.end() or i->second != a)
+			return true;
+
+		m_atoms.erase(i);
+
+		// another atom with the same label may now have to take its place
+		return not m_duplicates;
+	}
+
+	std::unordered_map<atom_label_key, atom, atom_label_key_hash> m_atoms;
+	bool m_duplicates = false;
+};
+
+structure::structure(structure &&s) = default;
+structure::~structure() = default;
+
+void structure::invalidate_indexes()
+{
+	m_residue_index.reset();
+	m_atom_label_index.reset();
+	m_spatial_index.reset();
+}
+
+structure::residue_index *structure::validate_residue_index() const
+{
+	if (m_residue_index and m_residue_index->m_shape != residue_index::shape_of(*this))
+		m_residue_index.reset();
+	return m_residue_index.get();
+}
+
+structure::residue_index &structure::get_residue_index() const
+{
+	if (validate_residue_index() != nullptr)
+		return *m_residue_index;
+
+	auto index = std::make_unique<residue_index>();
+
+	// Same order as the linear searches these replace
+	for (auto &res : const_cast<std::vector<residue> &>(m_non_polymers))
+		index->add(res);
+
+	for (auto &poly : const_cast<std::list<polymer> &>(m_polymers))
+		index->add(poly);
+
+	for (auto &branch : const_cast<std::list<cif::mm::branch> &>(m_branches))
+		index->add(branch);
+
+	index->m_shape = residue_index::shape_of(*this);
+
+	m_residue_index = std::move(index);
+	return *m_residue_index;
+}
+
+void structure::residue_index_updated()
+{
+	if (m_residue_index)
+		m_residue_index->m_shape = residue_index::shape_of(*this);
+}
+
+void structure::unindex_residue(const residue &res)
+{
+	if (auto index = validate_residue_index())
+		index->remove(res);
+}
+
+void structure::index_residue(residue &res)
+{
+	if (m_residue_index)
+		m_residue_index->add(res);
+	residue_index_updated();
+}
+
+void structure::unindex_polymer(const polymer &poly)
+{
+	if (auto index = validate_residue_index())
+		index->remove(poly);
+}
+
+void structure::index_polymer(polymer &poly)
+{
+	if (m_residue_index)
+		m_residue_index->add(poly);
+	residue_index_updated();
+}
+
+void structure::unindex_branch(const branch &branch)
+{
+	if (auto index = validate_residue_index())
+		index->remove(branch);
+}
+
+void structure::index_branch(branch &branch)
+{
+	if (m_residue_index)
+		m_residue_index->add(branch);
+	residue_index_updated();
+}
+
+void structure::unindex_non_polymers(size_t from)
+{
+	if (auto index = validate_residue_index())
+	{
+		for (size_t i = from; i < m_non_polymers.size(); ++i)
+			index->remove(m_non_polymers[i]);
+	}
+}
+
+void structure::index_non_polymers(size_t from)
+{
+	if (m_residue_index)
+	{
+		for (size_t i = from; i < m_non_polymers.size(); ++i)
+			m_residue_index->add(m_non_polymers[i]);
+	}
+	residue_index_updated();
+}
+
+structure::atom_label_index &structure::get_atom_label_index() const
+{
+	if (not m_atom_label_index)
+	{
+		auto index = std::make_unique<atom_label_index>();
+
+		index->m_atoms.reserve(m_atoms.size());
+		for (auto &a : m_atoms)
+			index->add(a);
+
+		m_atom_label_index = std::move(index);
+	}
+
+	return *m_atom_label_index;
+}
+
+void structure::unindex_atom(const atom &a)
+{
+	if (m_atom_label_index and not m_atom_label_index->remove(a))
+		m_atom_label_index.reset();
+}
+
+void structure::index_atom(const atom &a)
+{
+	if (m_atom_label_index)
+		m_atom_label_index->add(a);
+}
+
 bool structure::has_atom_id(const std::string &id) const
 {
 	assert(m_atoms.size() == m_atom_index.size());
@@ -1470,7 +2004,7 @@ bool structure::has_atom_id(const std::string &id) const
 
 		const atom &atom = m_atoms[m_atom_index[i]];
 
-		int d = atom.id().compare(id);
+		int d = compare_atom_id(atom.id(), id);
 
 		if (d == 0)
 		{
@@ -1498,7 +2032,7 @@ atom structure::get_atom_by_id(const std::string &id) const
 
 		const atom &atom = m_atoms[m_atom_index[i]];
 
-		int d = atom.id().compare(id);
+		int d = compare_atom_id(atom.id(), id);
 
 		if (d == 0)
 			return atom;
@@ -1514,125 +2048,281 @@ atom structure::get_atom_by_id(const std::string &id) const
 
 atom structure::get_atom_by_label(const std::string &atom_id, const std::string &asym_id, const std::string &compID, int seqID, const std::string &altID)
 {
-	for (auto &a : m_atoms)
+	atom_label_key key{ atom_id, asym_id, compID, seqID, altID };
+
+	for (int attempt = 0; attempt < 2; ++attempt)
 	{
-		if (a.get_label_atom_id() == atom_id and
-			a.get_label_asym_id() == asym_id and
-			a.get_label_comp_id() == compID and
-			a.get_label_seq_id() == seqID and
-			a.get_label_alt_id() == altID)
-		{
-			return a;
-		}
+		auto &index = get_atom_label_index();
+
+		auto i = index.m_atoms.find(key);
+		if (i == index.m_atoms.end())
+			break;
+
+		if (atom_label_index::key_for(i->second) == key)
+			return i->second;
+
+		// The atom was relabeled directly, rebuild the index once
+		m_atom_label_index.reset();
 	}
 
 	throw std::out_of_range("Could not find atom with specified label");
 }
 
-atom structure::get_atom_by_position(point p) const
-{
-	double dist = std::numeric_limits<double>::max();
-	size_t index = std::numeric_limits<size_t>::max();
+// --------------------------------------------------------------------
 
-	for (size_t i = 0; i < m_atoms.size(); ++i)
+struct structure::spatial_index
+{
+	spatial_index(const std::vector<atom> &atoms, uint64_t serial)
+		: m_serial(serial)
 	{
-		auto &a = m_atoms.at(i);
+		m_locations.reserve(atoms.size());
+		for (auto &a : atoms)
+			m_locations.push_back(a.get_location());
 
-		auto d = distance(a.get_location(), p);
-		if (d < dist)
+		m_min = m_max = m_locations.empty() ? point{} : m_locations.front();
+		for (auto &p : m_locations)
 		{
-			dist = d;
-			index = i;
+			m_min = { std::min(m_min.m_x, p.m_x), std::min(m_min.m_y, p.m_y), std::min(m_min.m_z, p.m_z) };
+			m_max = { std::max(m_max.m_x, p.m_x), std::max(m_max.m_y, p.m_y), std::max(m_max.m_z, p.m_z) };
 		}
+
+		// Cells are at least 4 Angstrom wide, but never more cells than atoms
+		auto d = m_max - m_min;
+		float volume = std::max(d.m_x, 1.0f) * std::max(d.m_y, 1.0f) * std::max(d.m_z, 1.0f);
+		m_cell_size = std::max(kMinCellSize, std::cbrt(volume / std::max<size_t>(m_locations.size(), 1)));
+
+		m_nx = static_cast<size_t>(d.m_x / m_cell_size) + 1;
+		m_ny = static_cast<size_t>(d.m_y / m_cell_size) + 1;
+		m_nz = static_cast<size_t>(d.m_z / m_cell_size) + 1;
+
+		m_cells.resize(m_nx * m_ny * m_nz);
+		for (uint32_t i = 0; i < m_locations.size(); ++i)
+			m_cells[cell_index(m_locations[i])].push_back(i);
 	}
 
-	if (index < m_atoms.size())
-		return m_atoms.at(index);
+	static size_t cell_coordinate(float v, float min, float cell_size, size_t n)
+	{
+		float c = std::floor((v - min) / cell_size);
+		return c <= 0 ? 0 : std::min(static_cast<size_t>(c), n - 1);
+	}
 
-	return {};
-}
+	size_t cell_index(point p) const
+	{
+		return (cell_coordinate(p.m_x, m_min.m_x, m_cell_size, m_nx) * m_ny +
+				   cell_coordinate(p.m_y, m_min.m_y, m_cell_size, m_ny)) *
+		           m_nz +
+		       cell_coordinate(p.m_z, m_min.m_z, m_cell_size, m_nz);
+	}
 
-atom structure::get_atom_by_position_and_type(point p, std::string_view type, std::string_view res_type) const
-{
-	double dist = std::numeric_limits<double>::max();
-	size_t index = std::numeric_limits<size_t>::max();
+	bool contains(point p) const
+	{
+		return p.m_x >= m_min.m_x and p.m_x <= m_max.m_x and
+		       p.m_y >= m_min.m_y and p.m_y <= m_max.m_y and
+		       p.m_z >= m_min.m_z and p.m_z <= m_max.m_z;
+	}
 
-	for (size_t i = 0; i < m_atoms.size(); ++i)
+	// The largest distance from p to any point inside the grid
+	float reach(point p) const
 	{
-		auto &a = m_atoms.at(i);
+		float dx = std::max(std::abs(p.m_x - m_min.m_x), std::abs(p.m_x - m_max.m_x));
+		float dy = std::max(std::abs(p.m_y - m_min.m_y), std::abs(p.m_y - m_max.m_y));
+		float dz = std::max(std::abs(p.m_z - m_min.m_z), std::abs(p.m_z - m_max.m_z));
+		return std::sqrt(dx * dx + dy * dy + dz * dz);
+	}
 
-		if (a.get_label_comp_id() != res_type)
-			continue;
+	// Call f for the index of each atom in the cells overlapping the
+	// box with half size r around p
+	template <typename F>
+	void for_each_in_box(point p, float r, F &&f) const
+	{
+		auto x0 = cell_coordinate(p.m_x - r, m_min.m_x, m_cell_size, m_nx), x1 = cell_coordinate(p.m_x + r, m_min.m_x, m_cell_size, m_nx);
+		auto y0 = cell_coordinate(p.m_y - r, m_min.m_y, m_cell_size, m_ny), y1 = cell_coordinate(p.m_y + r, m_min.m_y, m_cell_size, m_ny);
+		auto z0 = cell_coordinate(p.m_z - r, m_min.m_z, m_cell_size, m_nz), z1 = cell_coordinate(p.m_z + r, m_min.m_z, m_cell_size, m_nz);
 
-		if (a.get_label_atom_id() != type)
-			continue;
+		for (auto x = x0; x <= x1; ++x)
+		{
+			for (auto y = y0; y <= y1; ++y)
+			{
+				for (auto z = z0; z <= z1; ++z)
+				{
+					for (auto i : m_cells[(x * m_ny + y) * m_nz + z])
+						f(i);
+				}
+			}
+		}
+	}
 
-		auto d = distance(a.get_location(), p);
-		if (dist > d)
+	// Update the location of atom i, returns false if p is outside the grid
+	bool move(size_t i, point p)
+	{
+		if (not contains(p))
+			return false;
+
+		auto &from = m_cells[cell_index(m_locations[i])];
+		auto &to = m_cells[cell_index(p)];
+
+		if (&from != &to)
 		{
-			dist = d;
-			index = i;
+			from.erase(std::find(from.begin(), from.end(), static_cast<uint32_t>(i)));
+			to.push_back(static_cast<uint32_t>(i));
 		}
+
+		m_locations[i] = p;
+		return true;
 	}
 
-	if (index < m_atoms.size())
-		return m_atoms.at(index);
+	static constexpr float kMinCellSize = 4.0f;
+
+	// The update_serial of atom_site for the locations in this index
+	uint64_t m_serial;
 
-	return {};
+	point m_min, m_max;
+	float m_cell_size;
+	size_t m_nx, m_ny, m_nz;
+	std::vector<point> m_locations;
+	std::vector<std::vector<uint32_t>> m_cells;
+};
+
+uint64_t structure::get_location_serial() const
+{
+	// Atoms are moved by changing the Cartn_x/y/z fields in atom_site
+	auto atom_site = m_db.get("atom_site");
+	return atom_site ? atom_site->update_serial() : 0;
 }
 
-polymer &structure::get_polymer_by_asym_id(const std::string &asym_id)
+bool structure::has_valid_spatial_index() const
 {
-	for (auto &poly : m_polymers)
-	{
-		if (poly.get_asym_id() != asym_id)
-			continue;
+	return m_spatial_index and
+	       m_spatial_index->m_locations.size() == m_atoms.size() and
+	       m_spatial_index->m_serial == get_location_serial();
+}
 
-		return poly;
-	}
+structure::spatial_index &structure::get_spatial_index() const
+{
+	if (not has_valid_spatial_index())
+		m_spatial_index = std::make_unique<spatial_index>(m_atoms, get_location_serial());
+	return *m_spatial_index;
+}
 
-	throw std::runtime_error("polymer with asym id " + asym_id + " not found");
+std::vector<std::pair<float, size_t>> structure::find_atoms_near(point p, float radius, const atom_filter &filter) const
+{
+	auto &index = get_spatial_index();
+
+	std::vector<std::pair<float, size_t>> result;
+	float r2 = radius * radius;
+
+	index.for_each_in_box(p, radius, [&](size_t i)
+		{
+		auto d2 = distance_squared(index.m_locations[i], p);
+		if (d2 <= r2 and (not filter or filter(m_atoms[i])))
+			result.emplace_back(d2, i); });
+
+	return result;
 }
 
-residue &structure::create_residue(const std::vector<atom> &atoms)
+std::vector<atom> structure::get_atoms_near(point p, float radius, const atom_filter &filter) const
 {
-	return m_non_polymers.emplace_back(*this, atoms);
+	auto near = find_atoms_near(p, radius, filter);
+	std::sort(near.begin(), near.end());
+
+	std::vector<atom> result;
+	result.reserve(near.size());
+	for (auto &[d2, i] : near)
+		result.push_back(m_atoms[i]);
+	return result;
 }
 
-residue &structure::get_residue(const std::string &asym_id, int seqID, const std::string &authSeqID)
+std::vector<atom> structure::get_nearest_atoms(point p, size_t k, const atom_filter &filter) const
 {
-	if (seqID == 0)
-	{
-		for (auto &res : m_non_polymers)
-		{
-			if (res.get_asym_id() == asym_id and (authSeqID.empty() or res.get_auth_seq_id() == authSeqID))
-				return res;
-		}
-	}
+	std::vector<atom> result;
 
-	for (auto &poly : m_polymers)
+	if (k == 0 or m_atoms.empty())
+		return result;
+
+	// Search in a growing sphere until it contains k atoms, or the whole grid
+	auto &index = get_spatial_index();
+	float reach = index.reach(p);
+
+	for (float r = index.m_cell_size;; r *= 2)
 	{
-		if (poly.get_asym_id() != asym_id)
-			continue;
+		auto near = find_atoms_near(p, std::min(r, reach), filter);
 
-		for (auto &res : poly)
+		if (near.size() >= k or r >= reach)
 		{
-			if (res.get_seq_id() == seqID)
-				return res;
+			k = std::min(k, near.size());
+			std::partial_sort(near.begin(), near.begin() + k, near.end());
+
+			for (size_t i = 0; i < k; ++i)
+				result.push_back(m_atoms[near[i].second]);
+			break;
 		}
 	}
 
-	for (auto &branch : m_branches)
-	{
-		if (branch.get_asym_id() != asym_id)
-			continue;
+	return result;
+}
 
-		for (auto &sugar : branch)
-		{
-			if (sugar.get_asym_id() == asym_id and sugar.get_auth_seq_id() == authSeqID)
-				return sugar;
-		}
+std::vector<std::pair<atom, atom>> structure::get_symmetry_contacts(const crystal &c, float max_distance) const
+{
+	std::vector<point> locations;
+	locations.reserve(m_atoms.size());
+	for (auto &a : m_atoms)
+		locations.push_back(a.get_location());
+
+	std::vector<std::pair<atom, atom>> result;
+	for (auto &contact : c.find_symmetry_contacts(locations, max_distance))
+		result.emplace_back(m_atoms[contact.m_a], atom(m_atoms[contact.m_b], contact.m_location, contact.m_symop.string()));
+
+	return result;
+}
+
+atom structure::get_atom_by_position(point p) const
+{
+	auto result = get_nearest_atoms(p, 1);
+	return result.empty() ? atom{} : result.front();
+}
+
+atom structure::get_atom_by_position_and_type(point p, std::string_view type, std::string_view res_type) const
+{
+	auto result = get_nearest_atoms(p, 1, [type, res_type](const atom &a)
+		{ return a.get_label_comp_id() == res_type and a.get_label_atom_id() == type; });
+	return result.empty() ? atom{} : result.front();
+}
+
+polymer &structure::get_polymer_by_asym_id(const std::string &asym_id)
+{
+	auto &index = get_residue_index();
+	if (auto i = index.m_polymers.find(asym_id); i != index.m_polymers.end())
+		return *i->second;
+
+	throw std::runtime_error("polymer with asym id " + asym_id + " not found");
+}
+
+residue &structure::create_residue(const std::vector<atom> &atoms)
+{
+	auto from = first_moved(m_non_polymers);
+	unindex_non_polymers(from);
+	auto &result = m_non_polymers.emplace_back(*this, atoms);
+	index_non_polymers(from);
+	return result;
+}
+
+residue &structure::get_residue(const std::string &asym_id, int seqID, const std::string &authSeqID)
+{
+	auto &index = get_residue_index();
+
+	residue *res = nullptr;
+	if (seqID == 0)
+	{
+		res = authSeqID.empty()
+		          ? index.find_residue(residue_kind::non_poly_any, asym_id, 0, {})
+		          : index.find_residue(residue_kind::non_poly, asym_id, 0, authSeqID);
 	}
+	if (res == nullptr)
+		res = index.find_residue(residue_kind::monomer, asym_id, seqID, {});
+	if (res == nullptr)
+		res = index.find_residue(residue_kind::sugar, asym_id, 0, authSeqID);
+	if (res != nullptr)
+		return *res;
 
 	std::string desc = asym_id;
 
@@ -1647,38 +2337,17 @@ residue &structure::get_residue(const std::string &asym_id, int seqID, const std
 
 residue &structure::get_residue(const std::string &asym_id, const std::string &compID, int seqID, const std::string &authSeqID)
 {
-	if (seqID == 0)
-	{
-		for (auto &res : m_non_polymers)
-		{
-			if (res.get_asym_id() == asym_id and res.get_auth_seq_id() == authSeqID and res.get_compound_id() == compID)
-				return res;
-		}
-	}
+	auto &index = get_residue_index();
 
-	for (auto &poly : m_polymers)
-	{
-		if (poly.get_asym_id() != asym_id)
-			continue;
-
-		for (auto &res : poly)
-		{
-			if (res.get_seq_id() == seqID and res.get_compound_id() == compID)
-				return res;
-		}
-	}
-
-	for (auto &branch : m_branches)
-	{
-		if (branch.get_asym_id() != asym_id)
-			continue;
-
-		for (auto &sugar : branch)
-		{
-			if (sugar.get_asym_id() == asym_id and sugar.get_auth_seq_id() == authSeqID and sugar.get_compound_id() == compID)
-				return sugar;
-		}
-	}
+	residue *res = nullptr;
+	if (seqID == 0)
+		res = index.find_residue(residue_kind::non_poly, asym_id, 0, authSeqID, compID);
+	if (res == nullptr)
+		res = index.find_residue(residue_kind::monomer, asym_id, seqID, {}, compID);
+	if (res == nullptr)
+		res = index.find_residue(residue_kind::sugar, asym_id, 0, authSeqID, compID);
+	if (res != nullptr)
+		return *res;
 
 	std::string desc = asym_id;
 
@@ -1693,11 +2362,9 @@ residue &structure::get_residue(const std::string &asym_id, const std::string &c
 
 branch &structure::get_branch_by_asym_id(const std::string &asym_id)
 {
-	for (auto &branch : m_branches)
-	{
-		if (branch.get_asym_id() == asym_id)
-			return branch;
-	}
+	auto &index = get_residue_index();
+	if (auto i = index.m_branches.find(asym_id); i != index.m_branches.end())
+		return *i->second;
 
 	throw std::runtime_error("branch not found for asym id " + asym_id);
 }
@@ -1755,6 +2422,9 @@ std::string structure::insert_compound(const std::string &compoundID, bool is_en
 
 atom &structure::emplace_atom(atom &&atom)
 {
+	if (atom.m_impl and not atom.m_impl->m_columns and &atom.m_impl->m_cat == m_db.get("atom_site"))
+		atom.m_impl->m_columns = m_atom_columns;
+
 	int L = 0, R = static_cast<int>(m_atom_index.size() - 1);
 	while (L <= R)
 	{
@@ -1762,7 +2432,7 @@ atom &structure::emplace_atom(atom &&atom)
 
 		auto &ai = m_atoms[m_atom_index[i]];
 
-		int d = ai.id().compare(atom.id());
+		int d = compare_atom_id(ai.id(), atom.id());
 
 		if (d == 0)
 			throw std::runtime_error("Duplicate atom ID " + atom.id());
@@ -1786,7 +2456,11 @@ atom &structure::emplace_atom(atom &&atom)
 	if (not atom_type.exists("symbol"_key == symbol))
 		atom_type.emplace({ { "symbol", symbol } });
 
-	return m_atoms.emplace_back(std::move(atom));
+	m_spatial_index.reset();
+
+	auto &result = m_atoms.emplace_back(std::move(atom));
+	index_atom(result);
+	return result;
 }
 
 void structure::remove_atom(atom &a, bool removeFromResidue)
@@ -1864,11 +2538,13 @@ void structure::remove_atom(atom &a, bool removeFromResidue)
 
 		const atom &atom = m_atoms[m_atom_index[i]];
 
-		int d = atom.id().compare(a.id());
+		int d = compare_atom_id(atom.id(), a.id());
 
 		if (d == 0)
 		{
+			unindex_atom(a);
 			m_atoms.erase(m_atoms.begin() + m_atom_index[i]);
+			m_spatial_index.reset();
 
 			auto ai = m_atom_index[i];
 			m_atom_index.erase(m_atom_index.begin() + i);
@@ -1903,6 +2579,9 @@ void structure::swap_atoms(atom a1, atom a2)
 		auto r1 = atomSites.find1(key("id") == a1.id());
 		auto r2 = atomSites.find1(key("id") == a2.id());
 
+		unindex_atom(a1);
+		unindex_atom(a2);
+
 		auto l1 = r1["label_atom_id"];
 		auto l2 = r2["label_atom_id"];
 		l1.swap(l2);
@@ -1910,6 +2589,9 @@ void structure::swap_atoms(atom a1, atom a2)
 		auto l3 = r1["auth_atom_id"];
 		auto l4 = r2["auth_atom_id"];
 		l3.swap(l4);
+
+		index_atom(a1);
+		index_atom(a2);
 	}
 	catch (const std::exception &ex)
 	{
@@ -1919,7 +2601,21 @@ void structure::swap_atoms(atom a1, atom a2)
 
 void structure::move_atom(atom a, point p)
 {
+	// Update the spatial index in place, but only if it was up to date
+	bool update_index = has_valid_spatial_index();
+
 	a.set_location(p);
+
+	if (update_index)
+	{
+		auto i = std::lower_bound(m_atom_index.begin(), m_atom_index.end(), a.id(), [this](size_t ix, const std::string &id)
+			{ return compare_atom_id(m_atoms[ix].id(), id) < 0; });
+
+		if (i != m_atom_index.end() and m_atoms[*i] == a and m_spatial_index->move(*i, p))
+			m_spatial_index->m_serial = get_location_serial();
+		else
+			m_spatial_index.reset();
+	}
 }
 
 void structure::change_residue(residue &res, const std::string &newCompound,
@@ -1984,11 +2680,16 @@ void structure::change_residue(residue &res, const std::string &newCompound,
 	else
 		insert_compound(newCompound, false);
 
+	unindex_residue(res);
 	res.set_compound_id(newCompound);
+	index_residue(res);
 
 	auto &atomSites = m_db["atom_site"];
 	auto atoms = res.atoms();
 
+	for (auto &a : atoms)
+		unindex_atom(a);
+
 	for (const auto &[a1, a2] : remappedAtoms)
 	{
 		auto i = find_if(atoms.begin(), atoms.end(), [id = a1](const atom &a)
@@ -2024,6 +2725,9 @@ void structure::change_residue(residue &res, const std::string &newCompound,
 		atomSites.update_value(key("id") == a.id(), "label_comp_id", newCompound);
 		atomSites.update_value(key("id") == a.id(), "auth_comp_id", newCompound);
 	}
+
+	for (auto &a : res.atoms())
+		index_atom(a);
 }
 
 void structure::remove_residue(const std::string &asym_id, int seq_id, const std::string &auth_seq_id)
@@ -2088,20 +2792,39 @@ void structure::remove_residue(residue &res)
 				"seq_id"_key == res.get_seq_id());
 
 			for (auto &poly : m_polymers)
+			{
+				if (std::find(poly.begin(), poly.end(), m) == poly.end())
+					continue;
+
+				unindex_polymer(poly);
 				poly.erase(std::remove(poly.begin(), poly.end(), m), poly.end());
+				index_polymer(poly);
+			}
 			break;
 		}
 
 		case EntityType::NonPolymer:
+		{
 			m_db["pdbx_nonpoly_scheme"].erase("asym_id"_key == res.get_asym_id());
 			m_db["struct_asym"].erase("id"_key == res.get_asym_id());
+
+			auto from = static_cast<size_t>(std::find(m_non_polymers.begin(), m_non_polymers.end(), res) - m_non_polymers.begin());
+			unindex_non_polymers(from);
 			m_non_polymers.erase(std::remove(m_non_polymers.begin(), m_non_polymers.end(), res), m_non_polymers.end());
+			index_non_polymers(from);
 			break;
+		}
 
 		case EntityType::Water:
+		{
 			m_db["pdbx_nonpoly_scheme"].erase("asym_id"_key == res.get_asym_id());
+
+			auto from = static_cast<size_t>(std::find(m_non_polymers.begin(), m_non_polymers.end(), res) - m_non_polymers.begin());
+			unindex_non_polymers(from);
 			m_non_polymers.erase(std::remove(m_non_polymers.begin(), m_non_polymers.end(), res), m_non_polymers.end());
+			index_non_polymers(from);
 			break;
+		}
 
 		case EntityType::Branched:
 		{
@@ -2161,7 +2884,9 @@ void structure::remove_sugar(sugar &s)
 				remove_atom(atom, false);
 		}
 
+		unindex_branch(branch);
 		branch.erase(remove_if(branch.begin(), branch.end(), [dix](const sugar &s) { return dix.count(s.num()); }), branch.end());
+		index_branch(branch);
 
 		auto entity_id = create_entity_for_branch(branch);
 
@@ -2217,7 +2942,9 @@ void structure::remove_branch(branch &branch)
 	m_db["struct_asym"].erase("id"_key == branch.get_asym_id());
 	m_db["struct_conn"].erase("ptnr1_label_asym_id"_key == branch.get_asym_id() or "ptnr2_label_asym_id"_key == branch.get_asym_id());
 
+	unindex_branch(branch);
 	m_branches.erase(remove(m_branches.begin(), m_branches.end(), branch), m_branches.end());
+	residue_index_updated();
 }
 
 std::string structure::create_non_poly_entity(const std::string &comp_id)
@@ -2244,7 +2971,10 @@ std::string structure::create_non_poly(const std::string &entity_id, const std::
 
 	auto &atom_site = m_db["atom_site"];
 
+	auto from = first_moved(m_non_polymers);
+	unindex_non_polymers(from);
 	auto &res = m_non_polymers.emplace_back(*this, comp_id, asym_id, 0, asym_id, "1", "");
+	index_non_polymers(from);
 
 	for (auto &atom : atoms)
 	{
@@ -2315,7 +3045,10 @@ std::string structure::create_non_poly(const std::string &entity_id, std::vector
 
 	auto &atom_site = m_db["atom_site"];
 
+	auto from = first_moved(m_non_polymers);
+	unindex_non_polymers(from);
 	auto &res = m_non_polymers.emplace_back(*this, comp_id, asym_id, 0, asym_id, "1", "");
+	index_non_polymers(from);
 
 	for (auto &atom : atoms)
 	{
@@ -2446,7 +3179,10 @@ branch &structure::create_branch()
 		{"details", "?"}
 	});
 
-	return m_branches.emplace_back(*this, asym_id, entity_id);
+	validate_residue_index();
+	auto &result = m_branches.emplace_back(*this, asym_id, entity_id);
+	index_branch(result);
+	return result;
 }
 
 // branch &structure::create_branch(std::vector<row_initializer> atoms)
@@ -2771,34 +3507,106 @@ void structure::cleanup_empty_categories()
 
 void structure::translate(point t)
 {
+	std::vector<point> locations;
+	locations.reserve(m_atoms.size());
+
 	for (auto &a : m_atoms)
-		a.translate(t);
+		locations.push_back(a.get_location() + t);
+
+	set_locations(locations);
 }
 
 void structure::rotate(quaternion q)
 {
+	std::vector<point> locations;
+	locations.reserve(m_atoms.size());
+
 	for (auto &a : m_atoms)
-		a.rotate(q);
+	{
+		auto loc = a.get_location();
+		loc.rotate(q);
+		locations.push_back(loc);
+	}
+
+	set_locations(locations);
 }
 
 void structure::translate_and_rotate(point t, quaternion q)
 {
+	std::vector<point> locations;
+	locations.reserve(m_atoms.size());
+
 	for (auto &a : m_atoms)
-		a.translate_and_rotate(t, q);
+	{
+		auto loc = a.get_location();
+		loc += t;
+		loc.rotate(q);
+		locations.push_back(loc);
+	}
+
+	set_locations(locations);
 }
 
 void structure::translate_rotate_and_translate(point t1, quaternion q, point t2)
 {
+	std::vector<point> locations;
+	locations.reserve(m_atoms.size());
+
+	for (auto &a : m_atoms)
+	{
+		auto loc = a.get_location();
+		loc += t1;
+		loc.rotate(q);
+		loc += t2;
+		locations.push_back(loc);
+	}
+
+	set_locations(locations);
+}
+
+std::vector<point> structure::get_locations() const
+{
+	std::vector<point> result;
+	result.reserve(m_atoms.size());
+
 	for (auto &a : m_atoms)
-		a.translate_rotate_and_translate(t1, q, t2);
+		result.push_back(a.get_location());
+
+	return result;
+}
+
+void structure::set_locations(std::span<const point> locations)
+{
+	if (locations.size() != m_atoms.size())
+		throw std::runtime_error("The number of locations does not match the number of atoms");
+
+	// Look up the columns only once
+	auto &atom_site = m_db["atom_site"];
+	uint16_t x_ix = atom_site.add_column("Cartn_x");
+	uint16_t y_ix = atom_site.add_column("Cartn_y");
+	uint16_t z_ix = atom_site.add_column("Cartn_z");
+
+	bool moved = false;
+	for (size_t i = 0; i < m_atoms.size(); ++i)
+	{
+		// Only reformat the fields for atoms that actually moved
+		if (m_atoms[i].m_impl->m_location == locations[i])
+			continue;
+
+		m_atoms[i].m_impl->moveTo(locations[i], x_ix, y_ix, z_ix);
+		moved = true;
+	}
+
+	if (moved)
+		m_spatial_index.reset();
 }
 
 void structure::validate_atoms() const
 {
 	// validate order
 	assert(m_atoms.size() == m_atom_index.size());
-	for (size_t i = 0; i + i < m_atoms.size(); ++i)
-		assert(m_atoms[m_atom_index[i]].id().compare(m_atoms[m_atom_index[i + 1]].id()) < 0);
+	for (size_t i = 0; i + 1 < m_atoms.size(); ++i)
+		assert(compare_atom_id(m_atoms[m_atom_index[i]].id(), m_atoms[m_atom_index[i + 1]].id()) < 0);
 
 	std::vector<atom> atoms = m_atoms;
 
@@ -0,0 +1,578 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 NKI/AVL, Netherlands Cancer Institute
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "cif++/pattern.hpp"
+
+#include <bitset>
+#include <cctype>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace cif
+{
+
+// --------------------------------------------------------------------
+// A simple expression is compiled into a list of atoms, each atom matching
+// a single character from a set, optionally repeated. The resulting
+// automaton has a state for each atom and state i means the first i atoms
+// have been matched. With at most 63 atoms the set of active states fits
+// in a single 64 bit word, which allows a bit parallel simulation.
+
+struct pattern::pattern_impl
+{
+	using char_set = std::bitset<256>;
+
+	enum class quantifier
+	{
+		one,
+		optional,
+		star
+	};
+
+	struct atom
+	{
+		char_set m_chars;
+		quantifier m_q;
+	};
+
+	static constexpr size_t kMaxAtoms = 63;
+	static constexpr size_t kUnbounded = std::numeric_limits<size_t>::max();
+
+	pattern_impl(std::string_view rx, bool icase, syntax s, bool fallback = true);
+
+	pattern_impl(const std::regex &rx)
+		: m_regex(new std::regex(rx))
+	{
+	}
+
+	bool match(std::string_view text) const;
+
+	bool parse(std::string_view rx, bool icase, syntax s, std::vector<atom> &atoms) const;
+	bool parse_escape(char ch, char_set &chars) const;
+	bool parse_class(std::string_view rx, size_t &i, bool icase, syntax s, char_set &chars) const;
+
+	static void fold_case(char_set &chars)
+	{
+		for (unsigned char c = 'a'; c <= 'z'; ++c)
+		{
+			unsigned char uc = c - 'a' + 'A';
+			if (chars.test(c) or chars.test(uc))
+			{
+				chars.set(c);
+				chars.set(uc);
+			}
+		}
+	}
+
+	uint64_t closure(uint64_t s) const
+	{
+		for (;;)
+		{
+			auto t = s | ((s & m_skip) << 1);
+			if (t == s)
+				break;
+			s = t;
+		}
+
+		return s;
+	}
+
+	// The automaton
+	uint64_t m_one[256] = {};
+	uint64_t m_star[256] = {};
+	uint64_t m_skip = 0;
+	uint64_t m_accept = 0;
+	uint64_t m_start = 0;
+
+	// Prefilter
+	size_t m_min_length = 0, m_max_length = kUnbounded;
+	std::string m_prefix, m_suffix;
+	bool m_literal = false;
+
+	// Fallback for anything that is not simple
+	std::unique_ptr<std::regex> m_regex;
+	bool m_simple = true;
+};
+
+pattern::pattern_impl::pattern_impl(std::string_view rx, bool icase, syntax s, bool fallback)
+{
+	std::vector<atom> atoms;
+
+	if (not parse(rx, icase, s, atoms))
+	{
+		m_simple = false;
+		if (not fallback)
+			return;
+
+		auto flags = s == syntax::extended ? std::regex::extended : std::regex::ECMAScript;
+		if (icase)
+			flags |= std::regex::icase;
+
+		m_regex.reset(new std::regex(rx.begin(), rx.end(), flags | std::regex::optimize));
+		return;
+	}
+
+	m_min_length = 0;
+	bool bounded = true;
+
+	for (size_t i = 0; i < atoms.size(); ++i)
+	{
+		auto &a = atoms[i];
+		uint64_t bit = 1ULL << i;
+
+		for (size_t ch = 0; ch < 256; ++ch)
+		{
+			if (not a.m_chars.test(ch))
+				continue;
+
+			if (a.m_q == quantifier::star)
+				m_star[ch] |= bit;
+			else
+				m_one[ch] |= bit;
+		}
+
+		if (a.m_q == quantifier::one)
+			++m_min_length;
+		else
+			m_skip |= bit;
+
+		if (a.m_q == quantifier::star)
+			bounded = false;
+	}
+
+	m_accept = 1ULL << atoms.size();
+	m_max_length = bounded ? atoms.size() : kUnbounded;
+
+	// Literal prefix and suffix, consisting of atoms matching exactly one character
+	auto is_literal = [](const atom &a)
+	{ return a.m_q == quantifier::one and a.m_chars.count() == 1; };
+
+	auto literal_char = [](const atom &a)
+	{
+		size_t ch = 0;
+		while (not a.m_chars.test(ch))
+			++ch;
+		return static_cast<char>(ch);
+	};
+
+	size_t i = 0;
+	while (i < atoms.size() and is_literal(atoms[i]))
+		m_prefix += literal_char(atoms[i++]);
+
+	m_literal = i == atoms.size();
+
+	if (not m_literal)
+	{
+		for (size_t j = atoms.size(); j > i and is_literal(atoms[j - 1]); --j)
+			m_suffix.insert(m_suffix.begin(), literal_char(atoms[j - 1]));
+	}
+
+	// after the prefix was matched, the automaton is in state prefix length
+	m_start = closure(1ULL << m_prefix.length());
+}
+
+bool pattern::pattern_impl::parse(std::string_view rx, bool icase, syntax s, std::vector<atom> &atoms) const
+{
+	size_t i = 0, n = rx.length();
+
+	// Anchors are implied, since we always match the complete text
+	if (i < n and rx[i] == '^')
+		++i;
+
+	if (n > i and rx[n - 1] == '$')
+	{
+		size_t backslashes = 0;
+		while (n - 1 - backslashes > i and rx[n - 2 - backslashes] == '\\')
+			++backslashes;
+
+		if (backslashes % 2 == 0)
+			--n;
+	}
+
+	while (i < n)
+	{
+		char_set chars;
+
+		char ch = rx[i++];
+		switch (ch)
+		{
+			case '.':
+				chars.set();
+				if (s == syntax::ecmascript)
+				{
+					chars.reset('\n');
+					chars.reset('\r');
+				}
+				else
+					chars.reset(0);
+				break;
+
+			case '[':
+				if (not parse_class(rx.substr(0, n), i, icase, s, chars))
+					return false;
+				break;
+
+			case '\\':
+				if (i == n or not parse_escape(rx[i++], chars))
+					return false;
+				if (s == syntax::extended and std::isalnum(static_cast<unsigned char>(rx[i - 1])))
+					return false;
+				break;
+
+			// groups, alternatives, anchors in the middle and unexpected quantifiers
+			case '(':
+			case ')':
+			case '|':
+			case '*':
+			case '+':
+			case '?':
+			case '{':
+			case '}':
+			case ']':
+			case '^':
+			case '$':
+				return false;
+
+			default:
+				chars.set(static_cast<unsigned char>(ch));
+				break;
+		}
+
+		if (icase)
+			fold_case(chars);
+
+		size_t min = 1, max = 1;
+		bool quantified = true;
+
+		if (i < n)
+		{
+			switch (rx[i])
+			{
+				case '*':
+					min = 0;
+					max = kUnbounded;
+					++i;
+					break;
+
+				case '+':
+					max = kUnbounded;
+					++i;
+					break;
+
+				case '?':
+					min = 0;
+					++i;
+					break;
+
+				case '{':
+				{
+					auto parse_number = [&](size_t &v)
+					{
+						size_t b = ++i;
+						v = 0;
+						while (i < n and std::isdigit(static_cast<unsigned char>(rx[i])))
+							v = 10 * v + (rx[i++] - '0');
+						return i > b and v <= kMaxAtoms;
+					};
+
+					if (not parse_number(min) or i == n)
+						return false;
+
+					if (rx[i] == ',')
+					{
+						if (i + 1 < n and rx[i + 1] == '}')
+						{
+							max = kUnbounded;
+							++i;
+						}
+						else if (not parse_number(max) or i == n or max < min)
+							return false;
+					}
+					else
+						max = min;
+
+					if (rx[i] != '}')
+						return false;
+					++i;
+					break;
+				}
+
+				default:
+					quantified = false;
+					break;
+			}
+		}
+
+		if (quantified and i < n)
+		{
+			// Lazy quantifiers do not change the outcome of a complete match
+			if (s == syntax::ecmascript and rx[i] == '?')
+				++i;
+
+			if (i < n and (rx[i] == '*' or rx[i] == '+' or rx[i] == '?' or rx[i] == '{'))
+				return false;
+		}
+
+		for (size_t k = 0; k < min; ++k)
+			atoms.push_back({ chars, quantifier::one });
+
+		if (max == kUnbounded)
+			atoms.push_back({ chars, quantifier::star });
+		else
+		{
+			for (size_t k = min; k < max; ++k)
+				atoms.push_back({ chars, quantifier::optional });
+		}
+
+		if (atoms.size() > kMaxAtoms)
+			return false;
+	}
+
+	return true;
+}
+
+bool pattern::pattern_impl::parse_escape(char ch, char_set &chars) const
+{
+	auto set_range = [&chars](unsigned char a, unsigned char b)
+	{
+		for (unsigned c = a; c <= b; ++c)
+			chars.set(c);
+	};
+
+	bool result = true;
+
+	switch (ch)
+	{
+		case 'd':
+		case 'D':
+			set_range('0', '9');
+			break;
+
+		case 'w':
+		case 'W':
+			set_range('0', '9');
+			set_range('a', 'z');
+			set_range('A', 'Z');
+			chars.set('_');
+			break;
+
+		case 's':
+		case 'S':
+			for (unsigned char c : { ' ', '\t', '\n', '\r', '\f', '\v' })
+				chars.set(c);
+			break;
+
+		case 't': chars.set('\t'); break;
+		case 'n': chars.set('\n'); break;
+		case 'r': chars.set('\r'); break;
+		case 'f': chars.set('\f'); break;
+		case 'v': chars.set('\v'); break;
+
+		default:
+			if (std::isalnum(static_cast<unsigned char>(ch)))
+				result = false;
+			else
+				chars.set(static_cast<unsigned char>(ch));
+			break;
+	}
+
+	if (ch == 'D' or ch == 'W' or ch == 'S')
+		chars.flip();
+
+	return result;
+}
+
+bool pattern::pattern_impl::parse_class(std::string_view rx, size_t &i, bool icase, syntax s, char_set &chars) const
+{
+	size_t n = rx.length();
+
+	bool negate = i < n and rx[i] == '^';
+	if (negate)
+		++i;
+
+	bool first = true;
+
+	for (;;)
+	{
+		if (i >= n)
+			return false;
+
+		char ch = rx[i++];
+
+		if (ch == ']')
+		{
+			if (not first)
+				break;
+
+			// An empty class in ECMAScript, a literal ] in POSIX
+			if (s == syntax::ecmascript)
+				return false;
+		}
+
+		first = false;
+
+		// character classes, equivalence classes and collating elements
+		if (ch == '[' and i < n and (rx[i] == ':' or rx[i] == '.' or rx[i] == '='))
+			return false;
+
+		char_set item;
+		bool single = true;
+
+		if (ch == '\\' and s == syntax::ecmascript)
+		{
+			if (i == n)
+				return false;
+
+			char esc = rx[i++];
+			if (not parse_escape(esc, item))
+				return false;
+
+			single = item.count() == 1;
+			if (single)
+			{
+				ch = 0;
+				while (not item.test(static_cast<unsigned char>(ch)))
+					++ch;
+			}
+		}
+
+		if (single and i + 1 < n and rx[i] == '-' and rx[i + 1] != ']')
+		{
+			++i;
+			char hi = rx[i++];
+
+			if (hi == '[')
+				return false;
+
+			if (hi == '\\' and s == syntax::ecmascript)
+			{
+				if (i == n)
+					return false;
+
+				char_set hs;
+				if (not parse_escape(rx[i++], hs) or hs.count() != 1)
+					return false;
+
+				hi = 0;
+				while (not hs.test(static_cast<unsigned char>(hi)))
+					++hi;
+			}
+
+			auto a = static_cast<unsigned char>(ch), b = static_cast<unsigned char>(hi);
+			if (b < a)
+				return false;
+
+			for (unsigned c = a; c <= b; ++c)
+				chars.set(c);
+		}
+		else if (single)
+			chars.set(static_cast<unsigned char>(ch));
+		else
+			chars |= item;
+	}
+
+	// fold before negating, [^a] should not match A when ignoring case
+	if (icase)
+		fold_case(chars);
+
+	if (negate)
+		chars.flip();
+
+	return true;
+}
+
+bool pattern::pattern_impl::match(std::string_view text) const
+{
+	if (m_regex)
+		return std::regex_match(text.begin(), text.end(), *m_regex);
+
+	if (text.length() < m_min_length or text.length() > m_max_length)
+		return false;
+
+	if (m_literal)
+		return text == m_prefix;
+
+	if (text.compare(0, m_prefix.length(), m_prefix) != 0)
+		return false;
+
+	if (not m_suffix.empty() and text.compare(text.length() - m_suffix.length(), m_suffix.length(), m_suffix) != 0)
+		return false;
+
+	uint64_t s = m_start;
+
+	for (auto ch : text.substr(m_prefix.length()))
+	{
+		auto c = static_cast<unsigned char>(ch);
+
+		s = ((s & m_one[c]) << 1) | (s & m_star[c]);
+		if (s == 0)
+			return false;
+
+		s = closure(s);
+	}
+
+	return (s & m_accept) != 0;
+}
+
+// --------------------------------------------------------------------
+
+pattern::pattern(std::string_view rx, bool icase, syntax s)
+	: m_str(rx)
+	, m_impl(std::make_shared<pattern_impl>(rx, icase, s))
+{
+}
+
+pattern::pattern(std::string_view rx, std::shared_ptr<const pattern_impl> impl)
+	: m_str(rx)
+	, m_impl(std::move(impl))
+{
+}
+
+std::optional<pattern> pattern::simple(std::string_view rx, bool icase, syntax s)
+{
+	auto impl = std::make_shared<pattern_impl>(rx, icase, s, false);
+	if (not impl->m_simple)
+		return std::nullopt;
+	return pattern(rx, std::move(impl));
+}
+
+pattern::pattern(const std::regex &rx)
+	: m_impl(std::make_shared<pattern_impl>(rx))
+{
+}
+
+bool pattern::match(std::string_view text) const
+{
+	return m_impl->match(text);
+}
+
+bool pattern::is_simple() const
+{
+	return m_impl->m_simple;
+}
+
+} // namespace cif
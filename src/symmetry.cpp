@@ -28,6 +28,8 @@
 #include "cif++/datablock.hpp"
 #include "cif++/point.hpp"
 
+#include <algorithm>
+#include <numeric>
 #include <stdexcept>
 
 #include "symop_table_data.hpp"
@@ -312,6 +314,116 @@ point spacegroup::operator()(const point &pt, const cell &c, sym_op symop) const
 	return orthogonal(spt, c);
 }
 
+namespace
+{
+	// A spacegroup operation for a cell combined into a single affine
+	// transformation. Applying transformation t in fractional space to a
+	// point p moved to the origin by the integral offset o amounts to:
+	//
+	//   O (R (F p + o) + T - o) = (O R F) p + O (R - I) o + O T
+	//
+	// Only o depends on the point, it is derived from the fractional
+	// coordinates.
+	struct affine_symop
+	{
+		float m_f[3][3]; // fractional matrix F
+		float m_m[3][3]; // O R F
+		float m_a[3][3]; // O (R - I)
+		float m_c[3];    // O T
+
+		static float offset(float f)
+		{
+			// same as offsetToOriginFractional
+			return f < -0.5f ? std::ceil(-0.5f - f) : f > 0.5f ? std::floor(0.5f - f) : 0.0f;
+		}
+
+		void apply(float &x, float &y, float &z) const
+		{
+			float fx = m_f[0][0] * x + m_f[0][1] * y + m_f[0][2] * z;
+			float fy = m_f[1][0] * x + m_f[1][1] * y + m_f[1][2] * z;
+			float fz = m_f[2][0] * x + m_f[2][1] * y + m_f[2][2] * z;
+
+			float ox = offset(fx), oy = offset(fy), oz = offset(fz);
+
+			float rx = m_m[0][0] * x + m_m[0][1] * y + m_m[0][2] * z + m_a[0][0] * ox + m_a[0][1] * oy + m_a[0][2] * oz + m_c[0];
+			float ry = m_m[1][0] * x + m_m[1][1] * y + m_m[1][2] * z + m_a[1][0] * ox + m_a[1][1] * oy + m_a[1][2] * oz + m_c[1];
+			float rz = m_m[2][0] * x + m_m[2][1] * y + m_m[2][2] * z + m_a[2][0] * ox + m_a[2][1] * oy + m_a[2][2] * oz + m_c[2];
+
+			x = rx;
+			y = ry;
+			z = rz;
+		}
+	};
+
+	affine_symop make_affine_symop(const cell &c, const matrix3x3<float> &rm, point tr, sym_op symop)
+	{
+		auto fm = c.get_fractional_matrix();
+		auto om = c.get_orthogonal_matrix();
+
+		tr.m_x += symop.m_ta - 5;
+		tr.m_y += symop.m_tb - 5;
+		tr.m_z += symop.m_tc - 5;
+
+		affine_symop result;
+
+		for (size_t i = 0; i < 3; ++i)
+		{
+			for (size_t j = 0; j < 3; ++j)
+			{
+				result.m_f[i][j] = fm(i, j);
+
+				float orf = 0, ora = 0;
+				for (size_t k = 0; k < 3; ++k)
+				{
+					float rf = 0;
+					for (size_t l = 0; l < 3; ++l)
+						rf += rm(k, l) * fm(l, j);
+
+					orf += om(i, k) * rf;
+					ora += om(i, k) * (rm(k, j) - (k == j ? 1 : 0));
+				}
+
+				result.m_m[i][j] = orf;
+				result.m_a[i][j] = ora;
+			}
+
+			result.m_c[i] = om(i, 0) * tr.m_x + om(i, 1) * tr.m_y + om(i, 2) * tr.m_z;
+		}
+
+		return result;
+	}
+} // namespace
+
+void spacegroup::operator()(std::span<point> pts, const cell &c, sym_op symop) const
+{
+	if (symop.m_nr < 1 or symop.m_nr > size())
+		throw std::out_of_range("symmetry operator number out of range");
+
+	auto &st = at(symop.m_nr - 1);
+	auto t = make_affine_symop(c, st.m_rotation, st.m_translation, symop);
+
+	for (auto &pt : pts)
+		t.apply(pt.m_x, pt.m_y, pt.m_z);
+}
+
+void spacegroup::operator()(std::span<float> x, std::span<float> y, std::span<float> z, const cell &c, sym_op symop) const
+{
+	if (x.size() != y.size() or x.size() != z.size())
+		throw std::invalid_argument("coordinate arrays should be of equal length");
+
+	if (symop.m_nr < 1 or symop.m_nr > size())
+		throw std::out_of_range("symmetry operator number out of range");
+
+	auto &st = at(symop.m_nr - 1);
+	auto t = make_affine_symop(c, st.m_rotation, st.m_translation, symop);
+
+	// Plain loop over separate arrays, so the compiler can vectorize it
+	const size_t n = x.size();
+	float *xp = x.data(), *yp = y.data(), *zp = z.data();
+	for (size_t i = 0; i < n; ++i)
+		t.apply(xp[i], yp[i], zp[i]);
+}
+
 point spacegroup::inverse(const point &pt, const cell &c, sym_op symop) const
 {
 	if (symop.m_nr < 1 or symop.m_nr > size())
@@ -534,4 +646,167 @@ std::tuple<float,point,sym_op> crystal::closest_symmetry_copy(point a, point b)
 	return { std::sqrt(result_d), p, result_s };
 }
 
+std::vector<symmetry_contact> crystal::find_symmetry_contacts(const std::vector<point> &locations, float max_distance) const
+{
+	if (m_cell.get_a() == 0 or m_cell.get_b() == 0 or m_cell.get_c() == 0)
+		throw std::runtime_error("Invalid cell, contains a dimension that is zero");
+
+	std::vector<symmetry_contact> result;
+
+	if (locations.empty() or max_distance <= 0)
+		return result;
+
+	auto fm = m_cell.get_fractional_matrix();
+	auto om = m_cell.get_orthogonal_matrix();
+
+	std::vector<std::array<float, 3>> frac;
+	frac.reserve(locations.size());
+	for (auto &l : locations)
+	{
+		auto f = fm * l;
+		frac.push_back({ f.m_x, f.m_y, f.m_z });
+	}
+
+	std::array<float, 3> fmin = frac.front(), fmax = frac.front();
+	for (auto &f : frac)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			fmin[k] = std::min(fmin[k], f[k]);
+			fmax[k] = std::max(fmax[k], f[k]);
+		}
+	}
+
+	// The maximum extent of a sphere with radius max_distance along each
+	// fractional axis is max_distance times the norm of that row of the
+	// fractional matrix.
+	std::array<float, 3> reach;
+	for (int k = 0; k < 3; ++k)
+		reach[k] = max_distance * std::sqrt(fm(k, 0) * fm(k, 0) + fm(k, 1) * fm(k, 1) + fm(k, 2) * fm(k, 2));
+
+	// A cell list in fractional space, cells are at least reach wide and
+	// there are never more cells than points.
+	std::array<size_t, 3> n;
+	std::array<float, 3> width;
+	for (int k = 0; k < 3; ++k)
+		n[k] = std::max<size_t>(1, static_cast<size_t>((fmax[k] - fmin[k]) / reach[k]));
+
+	if (float cells = static_cast<float>(n[0] * n[1] * n[2]); cells > locations.size())
+	{
+		float scale = std::cbrt(cells / locations.size());
+		for (int k = 0; k < 3; ++k)
+			n[k] = std::max<size_t>(1, static_cast<size_t>(n[k] / scale));
+	}
+
+	for (int k = 0; k < 3; ++k)
+		width[k] = fmax[k] > fmin[k] ? (fmax[k] - fmin[k]) / n[k] : 1.0f;
+
+	auto cell_coordinate = [&](float v, int k) -> size_t
+	{
+		float c = std::floor((v - fmin[k]) / width[k]);
+		return c <= 0 ? 0 : std::min(static_cast<size_t>(c), n[k] - 1);
+	};
+
+	auto cell_index = [&](size_t x, size_t y, size_t z)
+	{
+		return (x * n[1] + y) * n[2] + z;
+	};
+
+	std::vector<uint32_t> cell_start(n[0] * n[1] * n[2] + 1, 0);
+	std::vector<uint32_t> cell_points(frac.size());
+	std::vector<size_t> point_cell(frac.size());
+
+	for (size_t i = 0; i < frac.size(); ++i)
+	{
+		auto &f = frac[i];
+		point_cell[i] = cell_index(cell_coordinate(f[0], 0), cell_coordinate(f[1], 1), cell_coordinate(f[2], 2));
+		++cell_start[point_cell[i] + 1];
+	}
+
+	std::partial_sum(cell_start.begin(), cell_start.end(), cell_start.begin());
+
+	{
+		auto next = cell_start;
+		for (size_t i = 0; i < frac.size(); ++i)
+			cell_points[next[point_cell[i]]++] = static_cast<uint32_t>(i);
+	}
+
+	const float max_distance_sq = max_distance * max_distance;
+
+	for (size_t i = 0; i < m_spacegroup.size(); ++i)
+	{
+		auto &t = m_spacegroup[i];
+
+		for (size_t b = 0; b < locations.size(); ++b)
+		{
+			// The copy in the unit cell, as calculated by spacegroup::operator()
+			point fb{ frac[b][0], frac[b][1], frac[b][2] };
+			auto o = offsetToOriginFractional(fb);
+			auto s0 = t(fb + o) - o;
+			std::array<float, 3> fs0{ s0.m_x, s0.m_y, s0.m_z };
+
+			// The lattice translations that can bring the copy near any of the points,
+			// limited to what can be expressed in a sym_op
+			std::array<int, 3> lo, hi;
+			for (int k = 0; k < 3; ++k)
+			{
+				lo[k] = std::max(-5, static_cast<int>(std::ceil(fmin[k] - reach[k] - fs0[k])));
+				hi[k] = std::min(4, static_cast<int>(std::floor(fmax[k] + reach[k] - fs0[k])));
+			}
+
+			for (int tx = lo[0]; tx <= hi[0]; ++tx)
+			{
+				for (int ty = lo[1]; ty <= hi[1]; ++ty)
+				{
+					for (int tz = lo[2]; tz <= hi[2]; ++tz)
+					{
+						if (i == 0 and tx == 0 and ty == 0 and tz == 0)
+							continue;
+
+						point fs{ fs0[0] + tx, fs0[1] + ty, fs0[2] + tz };
+						point q = om * fs;
+
+						auto x0 = cell_coordinate(fs.m_x - reach[0], 0), x1 = cell_coordinate(fs.m_x + reach[0], 0);
+						auto y0 = cell_coordinate(fs.m_y - reach[1], 1), y1 = cell_coordinate(fs.m_y + reach[1], 1);
+						auto z0 = cell_coordinate(fs.m_z - reach[2], 2), z1 = cell_coordinate(fs.m_z + reach[2], 2);
+
+						for (auto x = x0; x <= x1; ++x)
+						{
+							for (auto y = y0; y <= y1; ++y)
+							{
+								for (auto z = z0; z <= z1; ++z)
+								{
+									auto ci = cell_index(x, y, z);
+									for (auto pi = cell_start[ci]; pi < cell_start[ci + 1]; ++pi)
+									{
+										auto a = cell_points[pi];
+										auto d = distance_squared(locations[a], q);
+										if (d > max_distance_sq)
+											continue;
+
+										sym_op symop(static_cast<uint8_t>(i + 1),
+											static_cast<uint8_t>(5 + tx), static_cast<uint8_t>(5 + ty), static_cast<uint8_t>(5 + tz));
+										result.push_back({ a, b, symop, q, std::sqrt(d) });
+									}
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	std::sort(result.begin(), result.end(), [](const symmetry_contact &lhs, const symmetry_contact &rhs)
+		{
+		if (lhs.m_a != rhs.m_a)
+			return lhs.m_a < rhs.m_a;
+		if (lhs.m_b != rhs.m_b)
+			return lhs.m_b < rhs.m_b;
+		return std::tie(lhs.m_symop.m_nr, lhs.m_symop.m_ta, lhs.m_symop.m_tb, lhs.m_symop.m_tc) <
+		       std::tie(rhs.m_symop.m_nr, rhs.m_symop.m_ta, rhs.m_symop.m_tb, rhs.m_symop.m_tc); });
+
+	return result;
+}
+
 } // namespace cif
@@ -28,6 +28,8 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <iterator>
 
 namespace cif
 {
@@ -494,4 +496,105 @@ std::vector<std::string> word_wrap(const std::string &text, size_t width)
 	return result;
 }
 
+// --------------------------------------------------------------------
+
+namespace
+{
+	// The two digit decimal representation of all numbers below 100
+	constexpr char kDigitPairs[] =
+		"00010203040506070809"
+		"10111213141516171819"
+		"20212223242526272829"
+		"30313233343536373839"
+		"40414243444546474849"
+		"50515253545556575859"
+		"60616263646566676869"
+		"70717273747576777879"
+		"80818283848586878889"
+		"90919293949596979899";
+
+	constexpr uint64_t kPowersOfTen[] = {
+		1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+		10000000ULL, 100000000ULL, 1000000000ULL
+	};
+
+	/// Write exactly @a digits digits of @a v, padded with zeros, ending at @a last
+	void write_digits_backward(char *last, uint64_t v, int digits)
+	{
+		while (digits >= 2)
+		{
+			auto p = kDigitPairs + 2 * (v % 100);
+			*--last = p[1];
+			*--last = p[0];
+			v /= 100;
+			digits -= 2;
+		}
+
+		if (digits == 1)
+			*--last = static_cast<char>('0' + v % 10);
+	}
+
+	int count_digits(uint64_t v)
+	{
+		int result = 1;
+		while (v >= 10)
+		{
+			v /= 10;
+			++result;
+		}
+		return result;
+	}
+} // namespace
+
+std::to_chars_result to_chars_fixed(char *first, char *last, double value, int precision)
+{
+	// Scaled values up to this limit are calculated with an error small
+	// enough to decide correctly on rounding, except for values very close
+	// to a tie, those are left to std::to_chars.
+	const double kMaxScaled = 1e9;
+	const double kTieMargin = 1e-6;
+
+	if (precision < 0 or precision >= static_cast<int>(std::size(kPowersOfTen)) or not std::isfinite(value))
+		return std::to_chars(first, last, value, std::chars_format::fixed, precision);
+
+	double scaled = std::abs(value) * static_cast<double>(kPowersOfTen[precision]);
+	if (scaled >= kMaxScaled)
+		return std::to_chars(first, last, value, std::chars_format::fixed, precision);
+
+	double whole = std::floor(scaled);
+	double fraction = scaled - whole;
+
+	if (std::abs(fraction - 0.5) < kTieMargin)
+		return std::to_chars(first, last, value, std::chars_format::fixed, precision);
+
+	uint64_t v = static_cast<uint64_t>(whole);
+	if (fraction > 0.5)
+		++v;
+
+	uint64_t int_part = v / kPowersOfTen[precision];
+	uint64_t frac_part = v % kPowersOfTen[precision];
+
+	int int_digits = count_digits(int_part);
+	size_t length = std::signbit(value) + int_digits + (precision > 0 ? precision + 1 : 0);
+
+	if (static_cast<size_t>(last - first) < length)
+		return { last, std::errc::value_too_large };
+
+	char *p = first;
+	if (std::signbit(value))
+		*p++ = '-';
+
+	p += int_digits;
+	write_digits_backward(p, int_part, int_digits);
+
+	if (precision > 0)
+	{
+		*p++ = '.';
+		p += precision;
+		write_digits_backward(p, frac_part, precision);
+	}
+
+	return { p, std::errc() };
+}
+
 } // namespace cif
\ No newline at end of file
@@ -26,12 +26,17 @@
 
 #include "cif++/validate.hpp"
 #include "cif++/dictionary_parser.hpp"
+#include "cif++/format.hpp"
 #include "cif++/gzio.hpp"
+#include "cif++/pattern.hpp"
 #include "cif++/utilities.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <fstream>
 #include <iostream>
+#include <random>
+#include <sstream>
 
 // The validator depends on regular expressions. Unfortunately,
 // the implementation of std::regex in g++ is buggy and crashes
@@ -49,12 +54,116 @@ using std::regex;
 namespace cif
 {
 
-struct regex_impl : public regex
+// --------------------------------------------------------------------
+// Hand written validators for common types whose expression cannot be
+// handled by cif::pattern
+
+namespace
+{
+
+	bool is_digit(char ch)
+	{
+		return ch >= '0' and ch <= '9';
+	}
+
+	const char *skip_digits(const char *s, const char *e)
+	{
+		while (s != e and is_digit(*s))
+			++s;
+		return s;
+	}
+
+	// -?(([0-9]+)[.]?|([0-9]*[.][0-9]+))([(][0-9]+[)])?([eE][+-]?[0-9]+)?
+	bool match_float(std::string_view value)
+	{
+		auto s = value.data(), e = s + value.length();
+
+		if (s != e and *s == '-')
+			++s;
+
+		auto b = s;
+		s = skip_digits(s, e);
+		bool int_digits = s != b;
+
+		if (s != e and *s == '.')
+		{
+			b = ++s;
+			s = skip_digits(s, e);
+			if (not int_digits and s == b)
+				return false;
+		}
+		else if (not int_digits)
+			return false;
+
+		if (s != e and *s == '(')
+		{
+			b = ++s;
+			s = skip_digits(s, e);
+			if (s == b or s == e or *s != ')')
+				return false;
+			++s;
+		}
+
+		if (s != e and (*s == 'e' or *s == 'E'))
+		{
+			++s;
+			if (s != e and (*s == '+' or *s == '-'))
+				++s;
+
+			b = s;
+			s = skip_digits(s, e);
+			if (s == b)
+				return false;
+		}
+
+		return s == e;
+	}
+
+	struct known_expression
+	{
+		std::string_view m_rx;
+		bool (*m_match)(std::string_view);
+	} const kKnownExpressions[] = {
+		{ R"(-?(([0-9]+)[.]?|([0-9]*[.][0-9]+))([(][0-9]+[)])?([eE][+-]?[0-9]+)?)", &match_float }
+	};
+
+} // namespace
+
+// --------------------------------------------------------------------
+// A type expression is matched using a hand written validator if one is
+// known, using cif::pattern if the expression is simple enough and using
+// a regular expression library otherwise.
+
+struct regex_impl
 {
 	regex_impl(std::string_view rx)
-		: regex(rx.begin(), rx.end(), regex::extended | regex::optimize)
 	{
+		for (auto &ke : kKnownExpressions)
+		{
+			if (ke.m_rx == rx)
+			{
+				m_match = ke.m_match;
+				return;
+			}
+		}
+
+		m_pattern = pattern::simple(rx, false, pattern::syntax::extended);
+		if (not m_pattern)
+			m_rx.reset(new regex(rx.begin(), rx.end(), regex::extended | regex::optimize));
 	}
+
+	bool match(std::string_view value) const
+	{
+		if (m_match)
+			return m_match(value);
+		if (m_pattern)
+			return m_pattern->match(value);
+		return regex_match(value.begin(), value.end(), *m_rx);
+	}
+
+	bool (*m_match)(std::string_view) = nullptr;
+	std::optional<pattern> m_pattern;
+	std::unique_ptr<regex> m_rx;
 };
 
 validation_error::validation_error(const std::string &msg)
@@ -88,6 +197,7 @@ DDL_PrimitiveType map_to_primitive_type(std::string_view s)
 type_validator::type_validator(std::string_view name, DDL_PrimitiveType type, std::string_view rx)
 	: m_name(name)
 	, m_primitive_type(type)
+	, m_expression(rx)
 	, m_rx(new regex_impl(rx.empty() ? ".+" : rx)) /// Empty regular expressions are not allowed, in libcpp's std::regex (POSIX?)
 {
 }
@@ -97,6 +207,11 @@ type_validator::~type_validator()
 	delete m_rx;
 }
 
+bool type_validator::match(std::string_view value) const
+{
+	return m_rx->match(value);
+}
+
 int type_validator::compare(std::string_view a, std::string_view b) const
 {
 	int result = 0;
@@ -220,12 +335,12 @@ void item_validator::operator()(std::string_view value) const
 {
 	if (not value.empty() and value != "?" and value != ".")
 	{
-		if (m_type != nullptr and not regex_match(value.begin(), value.end(), *m_type->m_rx))
+		if (m_type != nullptr and not m_type->match(value))
 			throw validation_error(m_category->m_name, m_tag, "Value '" + std::string{ value } + "' does not match type expression for type " + m_type->m_name);
 
 		if (not m_enums.empty())
 		{
-			if (m_enums.count(std::string{ value }) == 0)
+			if (m_enums.find(value) == m_enums.end())
 				throw validation_error(m_category->m_name, m_tag, "Value '" + std::string{ value } + "' is not in the list of allowed values");
 		}
 	}
@@ -371,11 +486,253 @@ std::vector<const link_validator *> validator::get_links_for_child(std::string_v
 	return result;
 }
 
+// --------------------------------------------------------------------
+// Binary format for validators. This is a cache format only, data is
+// written in native byte order and a version change simply invalidates
+// all existing data.
+
+namespace
+{
+	const char kBinaryMagic[8] = { 'C', 'I', 'F', '+', '+', 'V', 'A', 'L' };
+	const uint32_t kBinaryVersion = 1;
+	const uint32_t kByteOrderMark = 0x01020304;
+
+	class binary_writer
+	{
+	  public:
+		binary_writer(std::ostream &os)
+			: m_os(os)
+		{
+		}
+
+		void write(uint32_t v)
+		{
+			m_os.write(reinterpret_cast<const char *>(&v), sizeof(v));
+		}
+
+		void write(std::string_view s)
+		{
+			write(static_cast<uint32_t>(s.length()));
+			m_os.write(s.data(), s.length());
+		}
+
+		template <typename C>
+		void write_strings(const C &c)
+		{
+			write(static_cast<uint32_t>(c.size()));
+			for (auto &s : c)
+				write(s);
+		}
+
+	  private:
+		std::ostream &m_os;
+	};
+
+	class binary_reader
+	{
+	  public:
+		binary_reader(std::istream &is)
+			: m_is(is)
+		{
+		}
+
+		uint32_t read_uint()
+		{
+			uint32_t result;
+			m_is.read(reinterpret_cast<char *>(&result), sizeof(result));
+			check();
+			return result;
+		}
+
+		std::string read_string()
+		{
+			std::string result(read_uint(), 0);
+			m_is.read(result.data(), result.length());
+			check();
+			return result;
+		}
+
+		template <typename C>
+		C read_strings()
+		{
+			C result;
+			for (auto n = read_uint(); n > 0; --n)
+				result.insert(result.end(), read_string());
+			return result;
+		}
+
+		void check()
+		{
+			if (not m_is)
+				throw std::runtime_error("Unexpected end of validator data");
+		}
+
+	  private:
+		std::istream &m_is;
+	};
+
+	// FNV-1a, the hash used to name the cached validators
+	uint64_t hash_bytes(uint64_t h, std::string_view s)
+	{
+		for (unsigned char ch : s)
+		{
+			h ^= ch;
+			h *= 0x100000001b3ULL;
+		}
+		return h;
+	}
+
+} // namespace
+
+void validator::save_binary(std::ostream &os) const
+{
+	binary_writer w(os);
+
+	os.write(kBinaryMagic, sizeof(kBinaryMagic));
+	w.write(kBinaryVersion);
+	w.write(kByteOrderMark);
+
+	w.write(m_name);
+	w.write(m_version);
+	w.write(m_strict ? 1 : 0);
+
+	w.write(static_cast<uint32_t>(m_type_validators.size()));
+	for (auto &tv : m_type_validators)
+	{
+		w.write(tv.m_name);
+		w.write(static_cast<uint32_t>(tv.m_primitive_type));
+		w.write(tv.m_expression);
+	}
+
+	w.write(static_cast<uint32_t>(m_category_validators.size()));
+	for (auto &cv : m_category_validators)
+	{
+		w.write(cv.m_name);
+		w.write_strings(cv.m_keys);
+		w.write_strings(cv.m_groups);
+		w.write_strings(cv.m_mandatory_fields);
+
+		w.write(static_cast<uint32_t>(cv.m_item_validators.size()));
+		for (auto &iv : cv.m_item_validators)
+		{
+			w.write(iv.m_tag);
+			w.write(iv.m_mandatory ? 1 : 0);
+			w.write(iv.m_type ? iv.m_type->m_name : "");
+
+			// sorted, to make the output reproducible
+			std::vector<std::string_view> enums(iv.m_enums.begin(), iv.m_enums.end());
+			std::sort(enums.begin(), enums.end());
+			w.write_strings(enums);
+			w.write(iv.m_default);
+		}
+	}
+
+	w.write(static_cast<uint32_t>(m_link_validators.size()));
+	for (auto &lv : m_link_validators)
+	{
+		w.write(static_cast<uint32_t>(lv.m_link_group_id));
+		w.write(lv.m_parent_category);
+		w.write_strings(lv.m_parent_keys);
+		w.write(lv.m_child_category);
+		w.write_strings(lv.m_child_keys);
+		w.write(lv.m_link_group_label);
+	}
+
+	if (not os)
+		throw std::runtime_error("Error writing validator data");
+}
+
+validator validator::load_binary(std::istream &is)
+{
+	binary_reader r(is);
+
+	char magic[sizeof(kBinaryMagic)];
+	is.read(magic, sizeof(magic));
+	r.check();
+
+	if (not std::equal(magic, magic + sizeof(magic), kBinaryMagic))
+		throw std::runtime_error("Not validator data");
+
+	if (r.read_uint() != kBinaryVersion or r.read_uint() != kByteOrderMark)
+		throw std::runtime_error("Validator data was written using a different format version");
+
+	validator result(r.read_string());
+	result.m_version = r.read_string();
+	result.m_strict = r.read_uint() != 0;
+
+	for (auto n = r.read_uint(); n > 0; --n)
+	{
+		auto name = r.read_string();
+		auto type = static_cast<DDL_PrimitiveType>(r.read_uint());
+		auto expression = r.read_string();
+
+		result.add_type_validator({ name, type, expression });
+	}
+
+	for (auto n = r.read_uint(); n > 0; --n)
+	{
+		category_validator cv{ r.read_string() };
+		cv.m_keys = r.read_strings<std::vector<std::string>>();
+		cv.m_groups = r.read_strings<iset>();
+		cv.m_mandatory_fields = r.read_strings<iset>();
+
+		auto &cvr = const_cast<category_validator &>(*result.m_category_validators.insert(std::move(cv)).first);
+
+		for (auto ni = r.read_uint(); ni > 0; --ni)
+		{
+			item_validator iv{ r.read_string() };
+			iv.m_mandatory = r.read_uint() != 0;
+
+			auto type = r.read_string();
+			iv.m_type = type.empty() ? nullptr : result.get_validator_for_type(type);
+			iv.m_enums = r.read_strings<ihash_set>();
+			iv.m_default = r.read_string();
+
+			cvr.addItemValidator(std::move(iv));
+		}
+	}
+
+	for (auto n = r.read_uint(); n > 0; --n)
+	{
+		link_validator lv;
+		lv.m_link_group_id = static_cast<int>(r.read_uint());
+		lv.m_parent_category = r.read_string();
+		lv.m_parent_keys = r.read_strings<std::vector<std::string>>();
+		lv.m_child_category = r.read_string();
+		lv.m_child_keys = r.read_strings<std::vector<std::string>>();
+		lv.m_link_group_label = r.read_string();
+
+		result.m_link_validators.emplace_back(std::move(lv));
+	}
+
+	return result;
+}
+
+// --------------------------------------------------------------------
+
+namespace detail
+{
+	thread_local report_collector *tl_report_collector = nullptr;
+
+	report_collector::report_collector()
+		: m_previous(std::exchange(tl_report_collector, this))
+	{
+	}
+
+	report_collector::~report_collector()
+	{
+		tl_report_collector = m_previous;
+	}
+} // namespace detail
+
 void validator::report_error(const std::string &msg, bool fatal) const
 {
+	if (detail::tl_report_collector != nullptr)
+		detail::tl_report_collector->m_reports.emplace_back(msg, fatal);
+
 	if (m_strict or fatal)
 		throw validation_error(msg);
-	else if (VERBOSE > 0)
+	else if (VERBOSE > 0 and detail::tl_report_collector == nullptr)
 		std::cerr << msg << '\n';
 }
 
@@ -387,101 +744,258 @@ validator_factory &validator_factory::instance()
 	return s_instance;
 }
 
-const validator &validator_factory::operator[](std::string_view dictionary_name)
+validator_factory::validator_factory()
 {
-	try
+	if (auto dir = getenv("LIBCIFPP_DICT_CACHE_DIR"); dir != nullptr)
+		m_cache_dir = dir;
+}
+
+void validator_factory::set_cache_directory(const std::filesystem::path &dir)
+{
+	std::lock_guard lock(m_mutex);
+	m_cache_dir = dir;
+}
+
+const validator *validator_factory::find(std::string_view dictionary_name) const
+{
+	const validator *result = nullptr;
+
+	auto map = m_validator_map.load(std::memory_order_acquire);
+	if (map != nullptr)
 	{
-		std::lock_guard lock(m_mutex);
+		auto i = map->find(dictionary_name);
 
-		for (auto &validator : m_validators)
+		// not found, try to see if it helps if we tweak the name a little
+		if (i == map->end())
 		{
-			if (iequals(validator.name(), dictionary_name))
-				return validator;
+			// too bad clang version 10 did not have a constructor for std::filesystem::path that accepts a std::string_view
+			std::filesystem::path dictionary(dictionary_name.data(), dictionary_name.data() + dictionary_name.length());
+
+			if (dictionary.extension() != ".dic")
+				i = map->find(dictionary.filename().string() + ".dic");
 		}
 
-		// not found, try to see if it helps if we tweak the name a little
+		if (i != map->end())
+			result = i->second;
+	}
 
-		// too bad clang version 10 did not have a constructor for std::filesystem::path that accepts a std::string_view
-		std::filesystem::path dictionary(dictionary_name.data(), dictionary_name.data() + dictionary_name.length());
+	return result;
+}
+
+const validator &validator_factory::operator[](std::string_view dictionary_name)
+{
+	// The fast path, no locking
+	if (auto v = find(dictionary_name); v != nullptr)
+		return *v;
+
+	std::promise<const validator *> promise;
+	std::shared_future<const validator *> future;
+	bool load_it = false;
+
+	{
+		std::lock_guard lock(m_mutex);
+
+		if (auto v = find(dictionary_name); v != nullptr)
+			return *v;
+
+		std::string name(dictionary_name);
+
+		auto i = m_loading.find(name);
+		if (i != m_loading.end())
+			future = i->second;
+		else
+		{
+			future = promise.get_future().share();
+			m_loading.emplace(name, future);
+			load_it = true;
+		}
+	}
 
-		if (dictionary.extension() != ".dic")
+	if (load_it)
+	{
+		try
 		{
-			auto dict_name = dictionary.filename().string() + ".dic";
+			// parse outside the lock, other dictionaries can be loaded simultaneously
+			auto v = load(dictionary_name);
 
-			for (auto &validator : m_validators)
+			std::lock_guard lock(m_mutex);
+			promise.set_value(&add(std::move(v), dictionary_name));
+			m_loading.erase(std::string{ dictionary_name });
+		}
+		catch (...)
+		{
+			try
 			{
-				if (iequals(validator.name(), dict_name))
-					return validator;
+				std::string msg = "Error while loading dictionary ";
+				msg += dictionary_name;
+				std::throw_with_nested(std::runtime_error(msg));
 			}
+			catch (...)
+			{
+				promise.set_exception(std::current_exception());
+			}
+
+			std::lock_guard lock(m_mutex);
+			m_loading.erase(std::string{ dictionary_name });
 		}
+	}
 
-		// not found, add it
-		auto data = load_resource(dictionary_name);
+	return *future.get();
+}
 
-		if (not data and dictionary.extension().string() != ".dic")
-			data = load_resource(dictionary.parent_path() / (dictionary.filename().string() + ".dic"));
+validator validator_factory::load(std::string_view dictionary_name)
+{
+	// too bad clang version 10 did not have a constructor for std::filesystem::path that accepts a std::string_view
+	std::filesystem::path dictionary(dictionary_name.data(), dictionary_name.data() + dictionary_name.length());
 
-		if (data)
-			construct_validator(dictionary_name, *data);
-		else
-		{
-			std::error_code ec;
+	auto data = load_resource(dictionary_name);
+
+	if (not data and dictionary.extension().string() != ".dic")
+		data = load_resource(dictionary.parent_path() / (dictionary.filename().string() + ".dic"));
+
+	if (data)
+		return parse(dictionary_name, *data);
+
+	std::error_code ec;
 
-			// might be a compressed dictionary on disk
-			std::filesystem::path p = dictionary;
-			if (p.extension() == ".dic")
-				p = p.parent_path() / (p.filename().string() + ".gz");
-			else
-				p = p.parent_path() / (p.filename().string() + ".dic.gz");
+	// might be a compressed dictionary on disk
+	std::filesystem::path p = dictionary;
+	if (p.extension() == ".dic")
+		p = p.parent_path() / (p.filename().string() + ".gz");
+	else
+		p = p.parent_path() / (p.filename().string() + ".dic.gz");
 
 #if defined(CACHE_DIR) or defined(DATA_DIR)
-			if (not std::filesystem::exists(p, ec) or ec)
-			{
-				for (const char *dir : {
+	if (not std::filesystem::exists(p, ec) or ec)
+	{
+		for (const char *dir : {
 #if defined(CACHE_DIR)
-						 CACHE_DIR,
+				 CACHE_DIR,
 #endif
 #if defined(DATA_DIR)
-							 DATA_DIR
+					 DATA_DIR
 #endif
-					 })
-				{
-					auto p2 = std::filesystem::path(dir) / p;
-					if (std::filesystem::exists(p2, ec) and not ec)
-					{
-						swap(p, p2);
-						break;
-					}
-				}
+			 })
+		{
+			auto p2 = std::filesystem::path(dir) / p;
+			if (std::filesystem::exists(p2, ec) and not ec)
+			{
+				swap(p, p2);
+				break;
 			}
+		}
+	}
 #endif
 
-			if (std::filesystem::exists(p, ec) and not ec)
-			{
-				gzio::ifstream in(p);
+	if (not std::filesystem::exists(p, ec) or ec)
+		throw std::runtime_error("Dictionary not found or defined (" + dictionary.string() + ")");
 
-				if (not in.is_open())
-					throw std::runtime_error("Could not open dictionary (" + p.string() + ")");
+	gzio::ifstream in(p);
 
-				construct_validator(dictionary_name, in);
-			}
-			else
-				throw std::runtime_error("Dictionary not found or defined (" + dictionary.string() + ")");
+	if (not in.is_open())
+		throw std::runtime_error("Could not open dictionary (" + p.string() + ")");
+
+	return parse(dictionary_name, in);
+}
+
+const validator &validator_factory::add(validator &&v, std::string_view alias)
+{
+	auto &result = m_validators.emplace_back(std::move(v));
+
+	// Readers may still be using the current map, so it is kept alive
+	auto current = m_validator_map.load(std::memory_order_relaxed);
+	auto map = current ? std::make_unique<validator_map>(*current) : std::make_unique<validator_map>();
+
+	// the first validator with a name wins
+	map->emplace(result.name(), &result);
+	if (not alias.empty())
+		map->emplace(alias, &result);
+
+	m_validator_map.store(map.get(), std::memory_order_release);
+	m_validator_maps.emplace_back(std::move(map));
+
+	return result;
+}
+
+const validator &validator_factory::construct_validator(std::string_view name, std::istream &is)
+{
+	auto v = parse(name, is);
+
+	std::lock_guard lock(m_mutex);
+	return add(std::move(v), {});
+}
+
+validator validator_factory::parse(std::string_view name, std::istream &is)
+{
+	std::filesystem::path cache_dir;
+
+	{
+		std::lock_guard lock(m_mutex);
+		cache_dir = m_cache_dir;
+	}
+
+	if (cache_dir.empty())
+		return parse_dictionary(name, is);
+
+	// The cached copy is named after the hash of the name and the contents
+	std::string text(std::istreambuf_iterator<char>(is), {});
+
+	uint64_t hash = hash_bytes(0xcbf29ce484222325ULL, name);
+	hash = hash_bytes(hash, text);
+
+	std::filesystem::path dictionary(name.data(), name.data() + name.length());
+	auto cached = cache_dir / (dictionary.filename().string() + '-' + cif::format("%016llx", static_cast<unsigned long long>(hash)).str() + ".bin");
+
+	std::error_code ec;
+	if (std::filesystem::exists(cached, ec))
+	{
+		try
+		{
+			std::ifstream in(cached, std::ios::binary);
+			return validator::load_binary(in);
+		}
+		catch (const std::exception &ex)
+		{
+			if (VERBOSE > 0)
+				std::cerr << "Ignoring cached dictionary " << cached << ": " << ex.what() << '\n';
 		}
+	}
+
+	std::istringstream in(std::move(text));
+	auto result = parse_dictionary(name, in);
+
+	// Write to a temporary file first, so other processes never see a partial file
+	std::filesystem::path tmp;
+
+	try
+	{
+		std::filesystem::create_directories(cache_dir);
+
+		tmp = cached;
+		tmp += cif::format(".%08x.tmp", std::random_device{}()).str();
+
+		std::ofstream out(tmp, std::ios::binary);
+		if (not out.is_open())
+			throw std::runtime_error("could not create " + tmp.string());
 
-		return m_validators.back();
+		result.save_binary(out);
+		out.close();
+
+		if (not out)
+			throw std::runtime_error("error writing " + tmp.string());
+
+		std::filesystem::rename(tmp, cached);
 	}
 	catch (const std::exception &ex)
 	{
-		std::string msg = "Error while loading dictionary ";
-		msg += dictionary_name;
-		std::throw_with_nested(std::runtime_error(msg));
+		if (not tmp.empty())
+			std::filesystem::remove(tmp, ec);
+
+		if (VERBOSE > 0)
+			std::cerr << "Could not cache dictionary " << name << ": " << ex.what() << '\n';
 	}
-}
 
-const validator &validator_factory::construct_validator(std::string_view name, std::istream &is)
-{
-	return m_validators.emplace_back(parse_dictionary(name, is));
+	return result;
 }
 
 } // namespace cif
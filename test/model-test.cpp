@@ -433,3 +433,648 @@ TEST_CASE("remove_residue_1")
 
 	REQUIRE_NOTHROW(s.validate_atoms());
 }
+
+// --------------------------------------------------------------------
+
+TEST_CASE("translate_1")
+{
+	const std::filesystem::path example(gTestDir / ".." / "examples" / "1cbs.cif.gz");
+	cif::file file(example.string());
+
+	cif::mm::structure s(file);
+
+	std::vector<cif::point> locations;
+	for (auto &a : s.atoms())
+		locations.push_back(a.get_location());
+
+	cif::point t(1.5f, -2.25f, 100.0f);
+	s.translate(t);
+
+	auto &atom_site = file.front()["atom_site"];
+	REQUIRE(atom_site.size() == locations.size());
+
+	size_t i = 0;
+	for (auto &a : s.atoms())
+	{
+		auto expected = locations[i++] + t;
+
+		auto r = a.get_row();
+		CHECK(r["Cartn_x"].as<std::string>() == cif::format("%.3f", expected.m_x).str());
+		CHECK(r["Cartn_y"].as<std::string>() == cif::format("%.3f", expected.m_y).str());
+		CHECK(r["Cartn_z"].as<std::string>() == cif::format("%.3f", expected.m_z).str());
+		CHECK(cif::distance(a.get_location(), expected) < 0.001f);
+	}
+
+	CHECK_THROWS(s.set_locations({}));
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("atom_row_cache_1")
+{
+	using namespace cif::literals;
+
+	const std::filesystem::path example(gTestDir / ".." / "examples" / "1cbs.cif.gz");
+	cif::file file(example.string());
+
+	cif::mm::structure s(file);
+	auto &atom_site = file.front()["atom_site"];
+
+	auto a = s.atoms()[10];
+	auto b = s.atoms()[11];
+
+	auto comp_id = a.get_label_comp_id();
+	auto seq_id = a.get_label_seq_id();
+	CHECK(a.get_row() == atom_site.find1("id"_key == a.id()));
+
+	// changes to the row are seen
+	atom_site.find1("id"_key == a.id())["auth_seq_id"] = "999";
+	CHECK(a.get_auth_seq_id() == "999");
+
+	// erasing another row keeps the atom valid
+	atom_site.erase("id"_key == b.id());
+	CHECK(a.get_label_comp_id() == comp_id);
+	CHECK(a.get_label_seq_id() == seq_id);
+	CHECK(not b.get_row());
+
+	// and erasing the row of the atom itself is detected
+	atom_site.erase("id"_key == a.id());
+	CHECK(not a.get_row());
+	CHECK(a.get_label_comp_id().empty());
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("bulk_load_1")
+{
+	using namespace cif::literals;
+
+	const std::filesystem::path example(gTestDir / ".." / "examples" / "1cbs.cif.gz");
+	cif::file file(example.string());
+
+	auto &db = file.front();
+	db["atom_type"].clear();
+
+	cif::mm::structure s(file);
+	REQUIRE(s.atoms().size() == db["atom_site"].size());
+
+	std::set<std::string> symbols;
+	for (auto &a : s.atoms())
+	{
+		CHECK(s.has_atom_id(a.id()));
+		CHECK(s.get_atom_by_id(a.id()) == a);
+		symbols.insert(a.get_property("type_symbol"));
+	}
+
+	CHECK_FALSE(s.has_atom_id("0"));
+	CHECK_FALSE(s.has_atom_id("X"));
+
+	auto &atom_type = db["atom_type"];
+	CHECK(atom_type.size() == symbols.size());
+	for (auto &symbol : symbols)
+		CHECK(atom_type.exists("symbol"_key == symbol));
+
+	// atoms added later are kept in the same order
+	CHECK_THROWS(s.emplace_atom(db, s.atoms().front().get_row()));
+
+	cif::row_initializer ri(s.atoms().back().get_row());
+	ri.set_value("id", "A1");
+	cif::row_handle r = *db["atom_site"].emplace(std::move(ri));
+	auto &b = s.emplace_atom(db, r);
+
+	CHECK(s.get_atom_by_id("A1") == b);
+	for (auto &a : s.atoms())
+		CHECK(s.get_atom_by_id(a.id()) == a);
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("load_data_1")
+{
+	using namespace cif::literals;
+
+	const std::filesystem::path example(gTestDir / ".." / "examples" / "1cbs.cif.gz");
+	cif::file file(example.string());
+
+	cif::mm::structure s(file);
+	auto &db = file.front();
+
+	std::set<std::string> asyms;
+	for (const auto &asym_id : db["pdbx_poly_seq_scheme"].rows<std::string>("asym_id"))
+		asyms.insert(asym_id);
+	CHECK(s.polymers().size() == asyms.size());
+
+	size_t n = 0;
+	for (auto &poly : s.polymers())
+	{
+		CHECK(poly.size() == db["pdbx_poly_seq_scheme"].find("asym_id"_key == poly.get_asym_id()).size());
+		for (auto &res : poly)
+		{
+			for (auto &a : res.atoms())
+			{
+				CHECK(a.get_label_asym_id() == res.get_asym_id());
+				CHECK(a.get_label_seq_id() == res.get_seq_id());
+				++n;
+			}
+		}
+	}
+
+	CHECK(s.non_polymers().size() == db["pdbx_nonpoly_scheme"].size());
+	for (auto &res : s.non_polymers())
+	{
+		for (auto &a : res.atoms())
+		{
+			CHECK(a.get_label_asym_id() == res.get_asym_id());
+			++n;
+		}
+	}
+
+	CHECK(n == s.atoms().size());
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("lookup_index_1")
+{
+	using namespace cif::literals;
+
+	const std::filesystem::path example(gTestDir / ".." / "examples" / "1cbs.cif.gz");
+	cif::file file(example.string());
+
+	cif::mm::structure s(file);
+
+	for (auto &poly : s.polymers())
+	{
+		CHECK(&s.get_polymer_by_asym_id(poly.get_asym_id()) == &poly);
+
+		for (auto &res : poly)
+		{
+			CHECK(&s.get_residue(res.get_asym_id(), res.get_seq_id(), res.get_auth_seq_id()) == &res);
+			CHECK(&s.get_residue(res.get_asym_id(), res.get_compound_id(), res.get_seq_id(), res.get_auth_seq_id()) == &res);
+
+			for (auto &a : res.atoms())
+			{
+				auto b = s.get_atom_by_label(a.get_label_atom_id(), a.get_label_asym_id(), a.get_label_comp_id(),
+					a.get_label_seq_id(), a.get_label_alt_id());
+				CHECK(a == b);
+			}
+		}
+	}
+
+	for (auto &res : s.non_polymers())
+	{
+		CHECK(&s.get_residue(res.get_asym_id(), 0, res.get_auth_seq_id()) == &res);
+		CHECK(&s.get_residue(res.get_asym_id(), res.get_compound_id(), 0, res.get_auth_seq_id()) == &res);
+
+		// without auth_seq_id the first non-polymer of the asym is returned
+		auto first = std::find_if(s.non_polymers().begin(), s.non_polymers().end(),
+			[asym_id = res.get_asym_id()](const cif::mm::residue &r) { return r.get_asym_id() == asym_id; });
+		CHECK(&s.get_residue(res.get_asym_id()) == &*first);
+	}
+
+	CHECK_THROWS_AS(s.get_residue("A", "GLY", 1, ""), std::out_of_range);
+	CHECK_THROWS_AS(s.get_atom_by_label("CA", "A", "GLY", 1), std::out_of_range);
+
+	// The index follows changes to the structure
+	auto &ligand = s.get_residue("B");
+	auto comp_id = ligand.get_compound_id();
+	s.remove_residue(ligand);
+	CHECK_THROWS_AS(s.get_residue("B"), std::out_of_range);
+
+	auto &poly = s.polymers().front();
+	auto &res = poly[1];
+	auto a = res.get_atom_by_atom_id("CA");
+	s.remove_atom(a);
+	CHECK_THROWS_AS(s.get_atom_by_label("CA", res.get_asym_id(), res.get_compound_id(), res.get_seq_id()), std::out_of_range);
+	CHECK_NOTHROW(s.get_atom_by_label("N", res.get_asym_id(), res.get_compound_id(), res.get_seq_id()));
+}
+
+TEST_CASE("lookup_index_2")
+{
+	const std::filesystem::path example(gTestDir / ".." / "examples" / "1cbs.cif.gz");
+	cif::file file(example.string());
+
+	cif::mm::structure s(file);
+
+	// build the index, then remove a monomer
+	auto &res = s.get_residue("A", 6, "");
+	CHECK(res.get_compound_id() == "ASN");
+	s.remove_residue(res);
+
+	CHECK_THROWS(s.get_residue("A", 6, ""));
+	CHECK(s.get_residue("A", 7, "").get_compound_id() == "TRP");
+	CHECK(s.get_residue("A", 137, "").get_seq_id() == 137);
+
+	// changes made through the non-const accessor are noticed as well
+	auto &poly = s.polymers().front();
+	poly.erase(poly.begin());
+	CHECK_THROWS(s.get_residue("A", 1, ""));
+	CHECK(s.get_residue("A", 2, "").get_seq_id() == 2);
+}
+
+TEST_CASE("lookup_index_3")
+{
+	const std::filesystem::path example(gTestDir / ".." / "examples" / "1cbs.cif.gz");
+	cif::file file(example.string());
+
+	cif::mm::structure s(file);
+
+	std::vector<std::pair<std::string, std::string>> waters;
+	for (auto &res : s.non_polymers())
+	{
+		if (res.get_compound_id() == "HOH")
+			waters.emplace_back(res.get_asym_id(), res.get_auth_seq_id());
+	}
+	REQUIRE(waters.size() > 10);
+
+	// Remove waters one at a time, the residues after them move but are
+	// still found. All waters share a label, the first one wins.
+	for (size_t i = 0; i < 10; ++i)
+	{
+		auto &[asym_id, auth_seq_id] = waters[i];
+		s.remove_residue(s.get_residue(asym_id, 0, auth_seq_id));
+		CHECK_THROWS_AS(s.get_residue(asym_id, 0, auth_seq_id), std::out_of_range);
+
+		auto &next = s.get_residue(waters[i + 1].first, 0, waters[i + 1].second);
+		CHECK(next.get_auth_seq_id() == waters[i + 1].second);
+		CHECK(&s.get_residue(asym_id) == &next);
+		CHECK(s.get_atom_by_label("O", asym_id, "HOH", 0) == next.atoms().front());
+
+		for (size_t j = i + 1; j < waters.size(); ++j)
+			CHECK(s.get_residue(waters[j].first, 0, waters[j].second).get_auth_seq_id() == waters[j].second);
+	}
+
+	// a new non-polymer is added to the index
+	auto &ligand = s.get_residue("B");
+	auto comp_id = ligand.get_compound_id();
+	auto ligand_atoms = ligand.atoms();
+	auto asym_id = s.create_non_poly(ligand.get_entity_id(), ligand_atoms);
+
+	auto &copy = s.get_residue(asym_id);
+	CHECK(copy.get_compound_id() == comp_id);
+	CHECK(&s.get_residue(asym_id, copy.get_compound_id(), 0, copy.get_auth_seq_id()) == &copy);
+	for (auto &a : copy.atoms())
+		CHECK(s.get_atom_by_label(a.get_label_atom_id(), asym_id, a.get_label_comp_id(), 0) == a);
+
+	// swapped atoms are found by their new label
+	auto &res = s.polymers().front()[2];
+	auto n = res.get_atom_by_atom_id("N");
+	auto ca = res.get_atom_by_atom_id("CA");
+	CHECK(s.get_atom_by_label("N", res.get_asym_id(), res.get_compound_id(), res.get_seq_id()) == n);
+
+	s.swap_atoms(n, ca);
+	CHECK(s.get_atom_by_label("N", res.get_asym_id(), res.get_compound_id(), res.get_seq_id()) == ca);
+	CHECK(s.get_atom_by_label("CA", res.get_asym_id(), res.get_compound_id(), res.get_seq_id()) == n);
+
+	CHECK_THROWS_AS(s.get_atom_by_label("XX", res.get_asym_id(), res.get_compound_id(), res.get_seq_id()), std::out_of_range);
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("spatial_index_1")
+{
+	const std::filesystem::path example(gTestDir / ".." / "examples" / "1cbs.cif.gz");
+	cif::file file(example.string());
+
+	cif::mm::structure s(file);
+	auto &atoms = s.atoms();
+
+	auto brute_force = [&](cif::point p, float radius, const cif::mm::structure::atom_filter &filter = {})
+	{
+		std::vector<std::pair<float, cif::mm::atom>> near;
+		for (auto &a : atoms)
+		{
+			auto d = cif::distance(a.get_location(), p);
+			if (d <= radius and (not filter or filter(a)))
+				near.emplace_back(d, a);
+		}
+		std::stable_sort(near.begin(), near.end(), [](auto &a, auto &b) { return a.first < b.first; });
+
+		std::vector<cif::mm::atom> result;
+		for (auto &[d, a] : near)
+			result.push_back(a);
+		return result;
+	};
+
+	auto is_oxygen = [](const cif::mm::atom &a) { return a.get_type() == cif::O; };
+
+	for (size_t i = 0; i < atoms.size(); i += 97)
+	{
+		auto p = atoms[i].get_location() + cif::point{ 0.5f, -0.25f, 0.75f };
+
+		CHECK(s.get_atoms_near(p, 6.0f) == brute_force(p, 6.0f));
+		CHECK(s.get_atoms_near(p, 8.0f, is_oxygen) == brute_force(p, 8.0f, is_oxygen));
+
+		auto nearest = s.get_nearest_atoms(p, 5);
+		auto expected = brute_force(p, 1000.0f);
+		expected.resize(5);
+		CHECK(nearest == expected);
+
+		CHECK(s.get_atom_by_position(p) == expected.front());
+	}
+
+	// a point far away still finds the nearest atom
+	cif::point far{ 1000, 1000, 1000 };
+	CHECK(s.get_atom_by_position(far) == brute_force(far, 1e6f).front());
+	CHECK(s.get_nearest_atoms(far, atoms.size() + 10).size() == atoms.size());
+
+	// the index follows moved atoms
+	auto a = atoms[10];
+	cif::point p = atoms[500].get_location() + cif::point{ 0.1f, 0.1f, 0.1f };
+	s.move_atom(a, p);
+	CHECK(s.get_atom_by_position(p) == a);
+
+	s.move_atom(a, far);
+	CHECK(s.get_atom_by_position(far) == a);
+
+	cif::point t{ 10, 20, 30 };
+	s.translate(t);
+	CHECK(s.get_atom_by_position(far + t) == a);
+	CHECK(s.get_atoms_near(p + t, 0.5f).front() == atoms[500]);
+}
+
+TEST_CASE("spatial_index_2")
+{
+	const std::filesystem::path example(gTestDir / ".." / "examples" / "1cbs.cif.gz");
+	cif::file file(example.string());
+
+	cif::mm::structure s(file);
+
+	// build the spatial index
+	CHECK_FALSE(s.get_atoms_near({ 0, 0, 0 }, 100).empty());
+
+	// atoms moved directly are still found by the spatial queries
+	auto a = s.get_atom_by_id("11");
+	auto p = a.get_location();
+	a.set_location({ 500, 500, 500 });
+	CHECK(s.get_atom_by_position({ 500, 500, 500 }) == a);
+	CHECK(s.get_atom_by_position_and_type({ 500, 500, 500 }, a.get_label_atom_id(), a.get_label_comp_id()) == a);
+	CHECK(s.get_atoms_near({ 500, 500, 500 }, 1) == std::vector<cif::mm::atom>{ a });
+	CHECK(s.get_nearest_atoms({ 499, 499, 499 }, 1) == std::vector<cif::mm::atom>{ a });
+
+	auto near = s.get_atoms_near(p, 0.5f);
+	CHECK(std::find(near.begin(), near.end(), a) == near.end());
+
+	// and so are atoms moved using move_atom afterwards
+	s.move_atom(a, p);
+	near = s.get_atoms_near(p, 0.5f);
+	CHECK(std::find(near.begin(), near.end(), a) != near.end());
+	CHECK(s.get_atoms_near({ 500, 500, 500 }, 1).empty());
+	CHECK(s.get_atom_by_position(p) == a);
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("oper_expression_1")
+{
+	using expr_t = std::vector<std::vector<std::string>>;
+
+	CHECK(cif::mm::parse_oper_expression("1") == expr_t{ { "1" } });
+	CHECK(cif::mm::parse_oper_expression("1,2,5-7") == expr_t{ { "1" }, { "2" }, { "5" }, { "6" }, { "7" } });
+	CHECK(cif::mm::parse_oper_expression("(1-3)") == expr_t{ { "1" }, { "2" }, { "3" } });
+	CHECK(cif::mm::parse_oper_expression("(1-2)(3,X0)") == expr_t{ { "1", "3" }, { "1", "X0" }, { "2", "3" }, { "2", "X0" } });
+	CHECK(cif::mm::parse_oper_expression("(1-60)(61-88)").size() == 60 * 28);
+
+	CHECK_THROWS(cif::mm::parse_oper_expression(""));
+	CHECK_THROWS(cif::mm::parse_oper_expression("(1-2"));
+	CHECK_THROWS(cif::mm::parse_oper_expression("3-1"));
+	CHECK_THROWS(cif::mm::parse_oper_expression("1,,2"));
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("assembly_1")
+{
+	using namespace cif::literals;
+
+	cif::file file(gTestDir / "1juh.cif.gz");
+	auto &db = file.front();
+
+	auto ops = cif::mm::get_assembly_operations(db, "2");
+	REQUIRE(ops.size() == 2);
+	CHECK(ops[0].m_name == "1");
+	CHECK(ops[0].m_identity);
+	CHECK(ops[1].m_name == "2");
+	CHECK_FALSE(ops[1].m_identity);
+	CHECK(ops[1].m_asym_ids.front() == "D");
+
+	CHECK_THROWS(cif::mm::get_assembly_operations(db, "3"));
+
+	auto assembly = cif::mm::create_assembly(db, "2");
+	auto &atom_site = assembly["atom_site"];
+
+	size_t expected = 0;
+	for (auto &op : ops)
+	{
+		for (auto &asym_id : op.m_asym_ids)
+			expected += db["atom_site"].count("label_asym_id"_key == asym_id);
+	}
+	CHECK(atom_site.size() == expected);
+
+	CHECK(atom_site.count("label_asym_id"_key == "A") == 0);
+	CHECK(atom_site.count("label_asym_id"_key == "B") == db["atom_site"].count("label_asym_id"_key == "B"));
+	CHECK(atom_site.count("label_asym_id"_key == "D") == 0);
+	CHECK(atom_site.count("label_asym_id"_key == "D-2") == db["atom_site"].count("label_asym_id"_key == "D"));
+	CHECK(assembly["struct_asym"].exists("id"_key == "D-2"));
+
+	// Operator 2 is -x+1,y+1/2,-z
+	auto src = db["atom_site"].find_first("label_asym_id"_key == "D");
+	auto dst = atom_site.find_first("label_asym_id"_key == "D-2");
+	REQUIRE(src["label_atom_id"].as<std::string>() == dst["label_atom_id"].as<std::string>());
+	CHECK_THAT(dst["Cartn_x"].as<float>(), Catch::Matchers::WithinAbs(108.55f - src["Cartn_x"].as<float>(), 0.002f));
+	CHECK_THAT(dst["Cartn_y"].as<float>(), Catch::Matchers::WithinAbs(src["Cartn_y"].as<float>() + 27.89f, 0.002f));
+	CHECK_THAT(dst["Cartn_z"].as<float>(), Catch::Matchers::WithinAbs(-src["Cartn_z"].as<float>(), 0.002f));
+
+	// The parallel version produces the same result
+	auto assembly2 = cif::mm::create_assembly(db, "2", cif::parallel_policy{ 4 });
+	CHECK(assembly2.hash() == assembly.hash());
+
+	// And the result can be loaded as a structure
+	cif::mm::structure s(assembly);
+	CHECK(s.atoms().size() == expected);
+	CHECK(s.has_atom_id("1"));
+}
+
+TEST_CASE("assembly_2")
+{
+	using namespace cif::literals;
+
+	// 4wvp assembly 2 consists of three copies, ops 2 and 3 rotate around z
+	cif::file f(gTestDir / "4wvp.cif.gz");
+	auto &db = f.front();
+
+	auto assembly = cif::mm::create_assembly(db, "2");
+
+	auto &atom_site = assembly["atom_site"];
+	auto &aniso = assembly["atom_site_anisotrop"];
+	CHECK(aniso.size() == 3 * db["atom_site_anisotrop"].size());
+
+	// each anisotrop row matches its atom
+	for (auto r : aniso)
+	{
+		auto a = atom_site.find1("id"_key == r["id"].as<std::string>());
+		REQUIRE(a);
+		CHECK(a["label_atom_id"].as<std::string>() == r["pdbx_label_atom_id"].as<std::string>());
+		CHECK(a["label_asym_id"].as<std::string>() == r["pdbx_label_asym_id"].as<std::string>());
+	}
+
+	// the tensors of the copies are rotated, the trace remains the same
+	auto src = db["atom_site_anisotrop"].front();
+	auto dst = aniso.find1("pdbx_label_asym_id"_key == src["pdbx_label_asym_id"].as<std::string>() + "-2" and
+		"pdbx_label_atom_id"_key == src["pdbx_label_atom_id"].as<std::string>() and
+		"pdbx_label_seq_id"_key == src["pdbx_label_seq_id"].as<int>());
+	REQUIRE(dst);
+
+	auto trace = [](cif::row_handle r)
+	{
+		return r["U[1][1]"].as<float>() + r["U[2][2]"].as<float>() + r["U[3][3]"].as<float>();
+	};
+
+	CHECK_THAT(trace(dst), Catch::Matchers::WithinAbs(trace(src), 0.0003f));
+	CHECK(dst["U[3][3]"].as<std::string>() == src["U[3][3]"].as<std::string>());
+	CHECK(dst["U[1][1]"].as<std::string>() != src["U[1][1]"].as<std::string>());
+
+	// connections are copied for each operation
+	CHECK(assembly["struct_conn"].size() == 3 * db["struct_conn"].size());
+	CHECK(assembly["struct_conn"].count("id"_key == db["struct_conn"].front()["id"].as<std::string>() + "-2") == 1);
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("coordinate_buffer_1")
+{
+	using namespace cif::literals;
+
+	cif::file f(gTestDir / ".." / "examples" / "1cbs.cif.gz");
+	auto &db = f.front();
+	cif::mm::structure s(db);
+
+	auto &atom_site = db["atom_site"];
+	auto a1 = s.get_atom_by_id("1");
+	auto a2 = s.get_atom_by_id("2");
+	auto p1 = a1.get_location();
+	auto x1 = atom_site.find1<std::string>("id"_key == "1", "Cartn_x");
+
+	auto locations = s.get_locations();
+	REQUIRE(locations.size() == s.atoms().size());
+	CHECK(locations[0] == p1);
+
+	// Changing the array does not change the atoms
+	locations[0].m_x += 1;
+	locations[1] = { 1, 2, 3 };
+	CHECK(a1.get_location() == p1);
+	CHECK(atom_site.find1<std::string>("id"_key == "1", "Cartn_x") == x1);
+
+	// Until it is written back
+	s.set_locations(locations);
+
+	CHECK(a1.get_location() == cif::point{ p1.m_x + 1, p1.m_y, p1.m_z });
+	CHECK(a2.get_location() == cif::point{ 1, 2, 3 });
+	CHECK_THAT(atom_site.find1<float>("id"_key == "1", "Cartn_x"), Catch::Matchers::WithinAbs(p1.m_x + 1, 0.001f));
+	CHECK(atom_site.find1<std::string>("id"_key == "2", "Cartn_x") == "1.000");
+
+	CHECK(s.get_atom_by_position({ 1, 2, 3 }) == a2);
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("ensemble_1")
+{
+	using namespace cif::literals;
+
+	cif::file f(gTestDir / ".." / "examples" / "1cbs.cif.gz");
+	auto &db = f.front();
+	auto &atom_site = db["atom_site"];
+
+	// Turn the file into an ensemble of three models, model 2 is shifted
+	// by 1 Å along x and model 3 is a copy of model 1
+	std::vector<cif::row_initializer> copies;
+	size_t next_id = atom_site.size() + 1;
+
+	for (int model_nr : { 2, 3 })
+	{
+		for (auto r : atom_site)
+		{
+			cif::row_initializer ri(r);
+			ri.set_value("id", std::to_string(next_id++));
+			ri.set_value("pdbx_PDB_model_num", std::to_string(model_nr));
+			if (model_nr == 2)
+				ri.set_value("Cartn_x", cif::format("%.3f", r["Cartn_x"].as<float>() + 1).str());
+			copies.emplace_back(std::move(ri));
+		}
+	}
+
+	for (auto &ri : copies)
+		atom_site.emplace(std::move(ri));
+
+	cif::mm::ensemble e(db);
+
+	REQUIRE(e.size() == 3);
+	CHECK(e.get_model_numbers() == std::vector<size_t>{ 1, 2, 3 });
+
+	auto &s = e.get_structure();
+	CHECK(s.atoms().size() * 3 == atom_site.size());
+
+	auto f0 = e.get_frame(0);
+	auto f1 = e.get_frame(1);
+	REQUIRE(f0.size() == s.atoms().size());
+	CHECK(f0[0] == s.atoms()[0].get_location());
+	CHECK_THAT(f1[0].m_x, Catch::Matchers::WithinAbs(f0[0].m_x + 1, 0.001f));
+
+	CHECK_THAT(e.rmsd(0, 1), Catch::Matchers::WithinAbs(1.0, 0.001));
+	CHECK_THAT(e.rmsd(0, 2), Catch::Matchers::WithinAbs(0.0, 0.001));
+	CHECK_THAT(e.rmsd(0, 1, [](const cif::mm::atom &a) { return a.get_label_atom_id() == "CA"; }),
+		Catch::Matchers::WithinAbs(1.0, 0.001));
+
+	// Two frames at x and one at x + 1, the average is x + 1/3
+	auto fluctuations = e.get_fluctuations();
+	REQUIRE(fluctuations.size() == s.atoms().size());
+	const float expected = std::sqrt(2.0f) / 3;
+	for (auto rmsf : fluctuations)
+		CHECK_THAT(rmsf, Catch::Matchers::WithinAbs(expected, 0.001f));
+
+	auto &res = s.get_residue("A", 1, "");
+	CHECK_THAT(e.get_fluctuation(res), Catch::Matchers::WithinAbs(expected, 0.001f));
+	CHECK(e.get_atom_index(s.atoms()[10]) == 10);
+
+	auto &res2 = s.get_residue("A", 2, "");
+	auto per_residue = e.get_fluctuations({ &res, &res2 });
+	REQUIRE(per_residue.size() == 2);
+	CHECK_THAT(per_residue[0], Catch::Matchers::WithinAbs(expected, 0.001f));
+	CHECK_THAT(per_residue[1], Catch::Matchers::WithinAbs(expected, 0.001f));
+
+	// A model lacking atoms is an error
+	atom_site.erase("id"_key == std::to_string(next_id - 1));
+	CHECK_THROWS_AS(cif::mm::ensemble(db), std::runtime_error);
+}
+
+TEST_CASE("ensemble_2")
+{
+	cif::file f(gTestDir / ".." / "examples" / "1cbs.cif.gz");
+	auto &db = f.front();
+	auto &atom_site = db["atom_site"];
+
+	// Model numbering does not have to start at 1
+	std::vector<cif::row_initializer> copies;
+	size_t next_id = atom_site.size() + 1;
+
+	for (auto r : atom_site)
+	{
+		r.assign("pdbx_PDB_model_num", "0", false, false);
+
+		cif::row_initializer ri(r);
+		ri.set_value("id", std::to_string(next_id++));
+		ri.set_value("pdbx_PDB_model_num", "5");
+		copies.emplace_back(std::move(ri));
+	}
+
+	for (auto &ri : copies)
+		atom_site.emplace(std::move(ri));
+
+	cif::mm::ensemble e(db);
+
+	REQUIRE(e.size() == 2);
+	CHECK(e.get_model_numbers() == std::vector<size_t>{ 0, 5 });
+	CHECK(e.get_structure().atoms().size() * 2 == atom_site.size());
+	CHECK_THAT(e.rmsd(0, 1), Catch::Matchers::WithinAbs(0.0, 0.001));
+}
@@ -576,3 +576,125 @@ TEST_CASE("volume_3bwh_1, *utf::tolerance(0.1f)")
 	REQUIRE_THAT(c.get_cell().get_volume(), Catch::Matchers::WithinRel(741009.625f, 0.01f));
 }
 
+
+// --------------------------------------------------------------------
+
+TEST_CASE("symmetry_contacts_1")
+{
+	cif::file f(gTestDir / "4wvp.cif.gz");
+
+	auto &db = f.front();
+
+	cif::crystal c(db);
+	cif::mm::structure s(db);
+
+	auto &atoms = s.atoms();
+	const float kMaxDistance = 4.0f;
+
+	std::vector<cif::point> locations;
+	for (auto &a : atoms)
+		locations.push_back(a.get_location());
+
+	auto contacts = c.find_symmetry_contacts(locations, kMaxDistance);
+	REQUIRE(not contacts.empty());
+
+	for (auto &contact : contacts)
+	{
+		CHECK(not contact.m_symop.is_identity());
+		CHECK(contact.m_distance <= kMaxDistance);
+
+		auto p = c.symmetry_copy(locations[contact.m_b], contact.m_symop);
+		CHECK(cif::distance(p, contact.m_location) < 0.01f);
+		CHECK(std::abs(cif::distance(locations[contact.m_a], p) - contact.m_distance) < 0.01f);
+	}
+
+	// Compare with a brute force search for a subset of the atoms
+	const size_t kStep = 25;
+
+	std::set<std::tuple<size_t, size_t, std::string>> expected, found;
+
+	for (size_t b = 0; b < atoms.size(); b += kStep)
+	{
+		for (size_t i = 1; i <= c.get_spacegroup().size(); ++i)
+		{
+			for (int tx = -3; tx <= 3; ++tx)
+				for (int ty = -3; ty <= 3; ++ty)
+					for (int tz = -3; tz <= 3; ++tz)
+					{
+						cif::sym_op symop(i, 5 + tx, 5 + ty, 5 + tz);
+						if (symop.is_identity())
+							continue;
+
+						auto p = c.symmetry_copy(locations[b], symop);
+						for (auto &a : s.get_atoms_near(p, kMaxDistance))
+						{
+							auto ai = std::find(atoms.begin(), atoms.end(), a) - atoms.begin();
+							expected.emplace(ai, b, symop.string());
+						}
+					}
+		}
+	}
+
+	for (auto &contact : contacts)
+	{
+		if (contact.m_b % kStep == 0)
+			found.emplace(contact.m_a, contact.m_b, contact.m_symop.string());
+	}
+
+	CHECK(found == expected);
+
+	// And the structure level interface
+	auto pairs = s.get_symmetry_contacts(c, kMaxDistance);
+	REQUIRE(pairs.size() == contacts.size());
+	for (auto &[a, b] : pairs)
+	{
+		CHECK(not a.is_symmetry_copy());
+		CHECK(b.is_symmetry_copy());
+		CHECK(cif::distance(a.get_location(), b.get_location()) <= kMaxDistance + 0.01f);
+	}
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("symmetry_batch_1")
+{
+	cif::file f(gTestDir / "4wvp.cif.gz");
+
+	auto &db = f.front();
+
+	cif::crystal c(db);
+	cif::mm::structure s(db);
+
+	std::vector<cif::point> locations;
+	std::vector<float> x, y, z;
+	for (auto &a : s.atoms())
+	{
+		auto p = a.get_location();
+		locations.push_back(p);
+		x.push_back(p.m_x);
+		y.push_back(p.m_y);
+		z.push_back(p.m_z);
+	}
+
+	for (const char *op : { "1_555", "1_654", "2_565", "3_445", "4_556", "6_655" })
+	{
+		cif::sym_op symop(op);
+
+		auto copies = c.symmetry_copy(locations, symop);
+		REQUIRE(copies.size() == locations.size());
+
+		auto sx = x, sy = y, sz = z;
+		c.get_spacegroup()(sx, sy, sz, c.get_cell(), symop);
+
+		for (size_t i = 0; i < locations.size(); ++i)
+		{
+			auto p = c.symmetry_copy(locations[i], symop);
+			CHECK(cif::distance(p, copies[i]) < 0.001f);
+			CHECK(cif::distance(p, cif::point{ sx[i], sy[i], sz[i] }) < 0.001f);
+		}
+	}
+
+	std::vector<float> w(1);
+	CHECK_THROWS_AS(c.get_spacegroup()(x, y, w, c.get_cell(), cif::sym_op{}), std::invalid_argument);
+	CHECK_THROWS_AS(c.symmetry_copy(locations, cif::sym_op(7)), std::out_of_range);
+}
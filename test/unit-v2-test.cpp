@@ -32,7 +32,9 @@
 
 #include "cif++/dictionary_parser.hpp"
 
+#include <random>
 #include <stdexcept>
+#include <thread>
 
 // --------------------------------------------------------------------
 
@@ -3468,3 +3470,942 @@ TEST_CASE("compound_not_found_test_1")
 	auto cmp = cif::compound_factory::instance().create("&&&");
 	REQUIRE(cmp == nullptr);
 }
+
+// --------------------------------------------------------------------
+
+TEST_CASE("db_directory_1")
+{
+	cif::datablock db("test");
+
+	auto &cat1 = db["Cat_1"];
+	auto &cat2 = db["cat_2"];
+
+	CHECK(&db["cat_1"] == &cat1);
+	CHECK(db.get("CAT_2") == &cat2);
+	CHECK(db.get("cat_3") == nullptr);
+
+	// emplace moves an existing category to the front, references remain valid
+	auto [i, is_new] = db.emplace("CAT_2");
+	CHECK_FALSE(is_new);
+	CHECK(&*i == &cat2);
+	CHECK(&db.front() == &cat2);
+	CHECK(db.get("cat_1") == &cat1);
+
+	std::tie(i, is_new) = db.emplace("cat_3");
+	CHECK(is_new);
+	CHECK(db.get("Cat_3") == &*i);
+
+	// removing categories keeps the directory in sync
+	db.erase(std::find_if(db.begin(), db.end(), [](const cif::category &cat) { return cat.name() == "cat_2"; }));
+	CHECK(db.get("cat_2") == nullptr);
+	CHECK(db.get("cat_1") == &cat1);
+
+	// as does adding categories using the std::list interface
+	db.emplace_back("cat_4");
+	CHECK(db.get("cat_4") == &db.back());
+
+	// copies get their own directory
+	cif::datablock db2(db);
+	CHECK(db2.get("cat_1") != nullptr);
+	CHECK(db2.get("cat_1") != &cat1);
+	CHECK(db2.get("cat_4") == &db2.back());
+
+	const cif::datablock &cdb = db2;
+	CHECK(cdb["cat_3"].name() == "cat_3");
+	CHECK(cdb["cat_5"].empty());
+	CHECK(db2.get("cat_5") == nullptr);
+
+	db2.clear();
+	CHECK(db2.get("cat_1") == nullptr);
+}
+
+TEST_CASE("db_directory_2")
+{
+	cif::datablock db("test");
+
+	db["cat_1"];
+	db["cat_2"];
+	CHECK(db.get("cat_1") != nullptr);
+
+	// remove one and add another, the size stays the same
+	db.remove_if([](const cif::category &cat) { return cat.name() == "cat_1"; });
+	db.emplace_back("cat_3");
+	CHECK(db.get("cat_1") == nullptr);
+	CHECK(db.get("cat_3") == &db.back());
+
+	// the const lookup does not update the directory but is still correct
+	db.emplace_back("cat_4");
+	const cif::datablock &cdb = db;
+	CHECK(cdb.get("cat_4") == &db.back());
+	CHECK(cdb.get("cat_2") == &db.front());
+	CHECK(cdb.get("cat_5") == nullptr);
+
+	// splicing takes categories away from the other datablock
+	cif::datablock db2("test2");
+	db2["cat_5"];
+	CHECK(db2.get("cat_5") != nullptr);
+	db.splice(db.end(), db2, db2.begin());
+	db2.emplace_back("cat_6");
+	CHECK(db2.get("cat_5") == nullptr);
+	CHECK(db2.get("cat_6") == &db2.back());
+	CHECK(db.get("cat_5") == &db.back());
+
+	db.resize(1);
+	db.emplace_back("cat_7");
+	CHECK(db.get("cat_2") == &db.front());
+	CHECK(db.get("cat_3") == nullptr);
+	CHECK(db.get("cat_7") == &db.back());
+
+	// renaming a category by assignment, the new name must be found
+	const auto n = db.size();
+	db.front() = cif::category("cat_8");
+	CHECK(cdb.get("cat_8") == &db.front());
+	CHECK(&db["cat_8"] == &db.front());
+	CHECK(db.size() == n);
+	CHECK(db.get("cat_2") == nullptr);
+	CHECK(cdb.get("cat_2") == nullptr);
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("column_ref_1")
+{
+	cif::category c("test");
+
+	c.emplace({ { "id", 1 }, { "name", "aap" }, { "value", 1.0f } });
+	c.emplace({ { "id", 2 }, { "name", "noot" }, { "value", 2.0f } });
+	c.emplace({ { "id", 3 }, { "name", "mies" }, { "value", 3.0f } });
+
+	const cif::column_ref kID("ID"), kName("name"), kValue("Value");
+
+	CHECK(c.get_column_ix(kID) == 0);
+	CHECK(c.get_column_ix(kValue) == 2);
+
+	int n = 0;
+	for (auto r : c)
+	{
+		++n;
+		CHECK(r[kID].as<int>() == n);
+		CHECK(r.get<int>(kID) == n);
+
+		const auto &[id, name] = r.get<int, std::string>(kID, kName);
+		CHECK(id == n);
+		CHECK(name == r["name"].as<std::string>());
+	}
+
+	n = 0;
+	for (const auto &[id, value] : c.rows<int, float>(kID, kValue))
+	{
+		++n;
+		CHECK(id == n);
+		CHECK(value == n);
+	}
+
+	// mixing names and references
+	for (const auto &[id, name] : c.find<int, std::string>(cif::key("id") == 2, "id", kName))
+	{
+		CHECK(id == 2);
+		CHECK(name == "noot");
+	}
+
+	// the same reference used for another category
+	cif::category c2("test2");
+	c2.emplace({ { "value", 42 }, { "id", 1 } });
+
+	CHECK(c2.get_column_ix(kID) == 1);
+	CHECK(c2.front()[kValue].as<int>() == 42);
+	CHECK(c.front()[kValue].as<int>() == 1);
+
+	// a non-existing column is added when assigning
+	const cif::column_ref kExtra("extra");
+	CHECK_FALSE(c.has_column("extra"));
+	CHECK(c.front()[kExtra].empty());
+	c.front()[kExtra] = "x";
+	CHECK(c.get_column_ix(kExtra) == 3);
+	CHECK(c.front()["extra"].as<std::string>() == "x");
+
+	// a copied category has a column list of its own
+	cif::category c3(c2);
+	CHECK(c3.front()[kID].as<int>() == 1);
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("find_parallel_1")
+{
+	cif::category c("test");
+
+	for (int i = 0; i < 50000; ++i)
+		c.emplace({ { "id", i }, { "mod", i % 7 }, { "name", "n-" + std::to_string(i) } });
+
+	const cif::parallel_policy four_threads{ 4 };
+
+	auto rows = c.find(four_threads, cif::key("mod") == 3);
+	CHECK(rows.size() == c.count(cif::key("mod") == 3));
+
+	// the results should be in row order
+	size_t n = 0;
+	for (auto rh : c.find(cif::key("mod") == 3))
+	{
+		REQUIRE(n < rows.size());
+		CHECK(rows[n++] == rh);
+	}
+	CHECK(n == rows.size());
+
+	CHECK(c.count(cif::parallel, cif::key("mod") == 3) == rows.size());
+	CHECK(c.count(four_threads, cif::key("mod") == 8) == 0);
+
+	CHECK(c.exists(four_threads, cif::key("id") == 49999));
+	CHECK_FALSE(c.exists(four_threads, cif::key("id") == 50000));
+
+	auto ids = c.find<int>(four_threads, cif::key("name") == "n-12345" or cif::key("id") == 42, "id");
+	CHECK(ids == std::vector<int>{ 42, 12345 });
+
+	auto values = c.find<int, std::string>(four_threads, cif::key("id") < 3, "mod", cif::column_ref("name"));
+	REQUIRE(values.size() == 3);
+	CHECK(std::get<0>(values[2]) == 2);
+	CHECK(std::get<1>(values[2]) == "n-2");
+
+	CHECK(c.find(cif::parallel, cif::condition()).empty());
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("order_by_key_1")
+{
+	cif::file f;
+	f.load_dictionary("mmcif_pdbx.dic");
+	f.emplace("TEST");
+
+	auto &db = f.front();
+	auto &pdbx_poly_seq_scheme = db["pdbx_poly_seq_scheme"];
+
+	// insert in reverse order, so the index order differs from the row order
+	for (std::string asym_id : { "B", "A" })
+	{
+		for (int seq_id = 100; seq_id > 0; --seq_id)
+		{
+			pdbx_poly_seq_scheme.emplace({
+				{ "asym_id", asym_id },
+				{ "entity_id", 1 },
+				{ "seq_id", seq_id },
+				{ "mon_id", "ALA" },
+				{ "ndb_seq_num", seq_id },
+				{ "pdb_seq_num", seq_id },
+				{ "pdb_mon_id", "ALA" },
+				{ "pdb_strand_id", asym_id },
+				{ "hetero", "n" } });
+		}
+	}
+
+	using namespace cif::literals;
+
+	auto window = [](int lower, int upper)
+	{
+		return "asym_id"_key == "A" and "entity_id"_key == 1 and "seq_id"_key >= lower and "seq_id"_key < upper;
+	};
+
+	auto rows = pdbx_poly_seq_scheme.find(cif::order_by_key, window(10, 50));
+	REQUIRE(rows.size() == 40);
+
+	int seq_id = 10;
+	for (auto rh : rows)
+	{
+		CHECK(rh["asym_id"].as<std::string>() == "A");
+		CHECK(rh["seq_id"].as<int>() == seq_id++);
+	}
+
+	CHECK(pdbx_poly_seq_scheme.count(window(10, 50)) == 40);
+	CHECK(pdbx_poly_seq_scheme.count(window(95, 200)) == 6);
+	CHECK(pdbx_poly_seq_scheme.count("seq_id"_key > 10 and "seq_id"_key <= 20) == 20);
+	CHECK(pdbx_poly_seq_scheme.exists(window(100, 101)));
+	CHECK_FALSE(pdbx_poly_seq_scheme.exists(window(101, 200)));
+
+	// conditions that cannot be resolved by the index
+	std::vector<int> seq_ids;
+	for (auto seq_id : pdbx_poly_seq_scheme.find<int>(cif::order_by_key, "asym_id"_key == "B" and "seq_id"_key > 97, "seq_id"))
+		seq_ids.push_back(seq_id);
+	CHECK(seq_ids == std::vector<int>{ 98, 99, 100 });
+
+	std::vector<std::tuple<std::string, int>> all;
+	for (const auto &[asym_id, seq_id] : pdbx_poly_seq_scheme.find<std::string, int>(cif::order_by_key, cif::all(), "asym_id", "seq_id"))
+		all.emplace_back(asym_id, seq_id);
+	REQUIRE(all.size() == 200);
+	CHECK(all.front() == std::make_tuple(std::string{ "A" }, 1));
+	CHECK(all.back() == std::make_tuple(std::string{ "B" }, 100));
+
+	// the plain find uses the index as well when the condition constrains the key
+	seq_id = 10;
+	for (auto rh : pdbx_poly_seq_scheme.find(window(10, 50)))
+		CHECK(rh["seq_id"].as<int>() == seq_id++);
+	CHECK(seq_id == 50);
+
+	CHECK(pdbx_poly_seq_scheme.find1(window(42, 43))["seq_id"].as<int>() == 42);
+	CHECK(pdbx_poly_seq_scheme.find_first(window(42, 50))["seq_id"].as<int>() == 42);
+	CHECK(pdbx_poly_seq_scheme.find(window(101, 200)).empty());
+	CHECK(pdbx_poly_seq_scheme.find<int>(window(10, 50) and "pdb_seq_num"_key > 45, "pdb_seq_num").size() == 4);
+
+	// starting at a position does not use the index
+	CHECK(pdbx_poly_seq_scheme.find(std::next(pdbx_poly_seq_scheme.begin(), 100), window(10, 50)).size() == 40);
+
+	cif::category no_index("no_index");
+	no_index.emplace({ { "id", 1 } });
+	CHECK_THROWS_AS(no_index.find(cif::order_by_key, "id"_key == 1), std::logic_error);
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("pattern_1")
+{
+	using namespace cif::literals;
+
+	struct
+	{
+		const char *rx;
+		bool simple;
+	} patterns[] = {
+		{ "ALA", true },
+		{ "[A-Z]{3}[0-9]+", true },
+		{ "^-?[0-9]+$", true },
+		{ "H[A-Z]?\\d*", true },
+		{ "a.*z", true },
+		{ "[^0-9]+x", true },
+		{ "[\\w\\-]{1,3}", true },
+		{ "(ab)+", false },
+		{ "ALA|GLY", false },
+		{ "(a)\\1", false }
+	};
+
+	const char *texts[] = { "", "ALA", "ala", "GLY", "ALA12", "ALA1x", "-12", "12", "12-",
+		"H", "HA", "HA12", "H12", "az", "abcz", "a\nz", "abab", "aa", "x", "abx", "1x", "w-_", "w-_a" };
+
+	for (auto &p : patterns)
+	{
+		cif::pattern pat(p.rx);
+		std::regex rx(p.rx);
+
+		CHECK(pat.is_simple() == p.simple);
+		for (auto text : texts)
+			CHECK(pat.match(text) == std::regex_match(text, rx));
+
+		cif::pattern ipat(p.rx, true);
+		std::regex irx(p.rx, std::regex::icase);
+
+		for (auto text : texts)
+			CHECK(ipat.match(text) == std::regex_match(text, irx));
+	}
+
+	CHECK(cif::pattern("[^a]", true).match("A") == false);
+
+	// POSIX extended, as used in the dictionaries
+	cif::pattern ext("[][ \\t_(),.;:\"&<>/\\{}'`~!@#$%?+=*A-Za-z0-9|^-]*", false, cif::pattern::syntax::extended);
+	CHECK(ext.is_simple());
+	CHECK(ext.match("a b\\c[d]"));
+	CHECK_FALSE(ext.match("a\nb"));
+
+	CHECK_FALSE(cif::pattern("[[:digit:]]+", false, cif::pattern::syntax::extended).is_simple());
+	CHECK(cif::pattern("[[:digit:]]+", false, cif::pattern::syntax::extended).match("123"));
+
+	// and in conditions
+	auto f = R"(data_TEST
+loop_
+_test.id
+_test.name
+1 aap
+2 noot
+3 mies
+)"_cf;
+
+	auto &test = f.front()["test"];
+
+	CHECK(test.count("name"_key == cif::pattern("[mn].*")) == 2);
+	CHECK(test.count("name"_key == std::regex("[mn].*")) == 2);
+	CHECK(test.count("name"_key == cif::pattern("AAP", true)) == 1);
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("type_validator_1")
+{
+	auto &validator = cif::validator_factory::instance()["mmcif_pdbx.dic"];
+
+	for (auto type : { "float", "int", "code", "ucode", "line", "text", "name", "yyyy-mm-dd", "symop", "atcode", "uchar3" })
+		CHECK(validator.get_validator_for_type(type) != nullptr);
+
+	auto float_tv = validator.get_validator_for_type("float");
+	for (auto v : { "1", "-1", "1.", ".5", "-.5", "1.5(3)", "1.5e10", "1.5E-3", "1.5(3)e+2", "10" })
+	{
+		INFO(v);
+		CHECK(float_tv->match(v));
+	}
+
+	for (auto v : { "+1", "1e", ".", "-", "1.5(", "1.5()", "(3)", "abc", "1.5 ", "--1" })
+	{
+		INFO(v);
+		CHECK_FALSE(float_tv->match(v));
+	}
+
+	auto int_tv = validator.get_validator_for_type("int");
+	CHECK(int_tv->match("+12"));
+	CHECK_FALSE(int_tv->match("1.2"));
+
+	auto line_tv = validator.get_validator_for_type("line");
+	CHECK(line_tv->match("a b\tc\\d[e]"));
+	CHECK_FALSE(line_tv->match("a\nb"));
+
+	auto symop_tv = validator.get_validator_for_type("symop");
+	CHECK(symop_tv->match("1_555"));
+	CHECK(symop_tv->match("192"));
+	CHECK_FALSE(symop_tv->match("193"));
+
+	// enumerations are case insensitive
+	auto cv = validator.get_validator_for_category("atom_site");
+	REQUIRE(cv != nullptr);
+	auto iv = cv->get_validator_for_item("group_PDB");
+	REQUIRE(iv != nullptr);
+
+	CHECK_NOTHROW((*iv)("ATOM"));
+	CHECK_NOTHROW((*iv)("hetatm"));
+	CHECK_THROWS_AS((*iv)("ATOMS"), cif::validation_error);
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("incremental_validation_1")
+{
+	using namespace cif::literals;
+
+	auto f = R"(data_TEST
+loop_
+_entity.id
+_entity.type
+1 polymer
+2 water
+
+loop_
+_struct_asym.id
+_struct_asym.entity_id
+A 1
+B 2
+)"_cf;
+
+	f.load_dictionary("mmcif_pdbx.dic");
+
+	auto &db = f.front();
+	auto &entity = db["entity"];
+	auto &struct_asym = db["struct_asym"];
+
+	CHECK(f.is_valid());
+	CHECK(f.is_valid(cif::incremental));
+
+	// an invalid value is found by the incremental validation, and
+	// keeps being reported until it is fixed
+	entity.front().assign("type", "bogus", false, false);
+	CHECK_FALSE(entity.is_valid(cif::incremental));
+	CHECK_FALSE(db.is_valid(cif::incremental));
+
+	entity.front().assign("type", "polymer", false, false);
+	CHECK(entity.is_valid(cif::incremental));
+
+	// new rows are checked
+	entity.emplace({ { "id", 3 }, { "type", "water" } });
+	CHECK(entity.is_valid(cif::incremental));
+
+	// broken links
+	struct_asym.back().assign("entity_id", "4", false);
+	CHECK_FALSE(struct_asym.validate_links(cif::incremental));
+	CHECK_FALSE(struct_asym.validate_links(cif::incremental));
+
+	struct_asym.back().assign("entity_id", "3", false);
+	CHECK(struct_asym.validate_links(cif::incremental));
+	CHECK(f.is_valid(cif::incremental));
+
+	// a full validation agrees
+	CHECK(f.is_valid());
+
+	// erasing a row forgets about it
+	entity.front().assign("type", "bogus", false, false);
+	entity.erase(entity.begin());
+	CHECK(entity.is_valid(cif::incremental));
+}
+
+TEST_CASE("incremental_validation_2")
+{
+	using namespace cif::literals;
+
+	auto f = R"(data_TEST
+loop_
+_entity.id
+_entity.type
+1 polymer
+2 water
+
+loop_
+_struct_asym.id
+_struct_asym.entity_id
+A 1
+B 2
+)"_cf;
+
+	f.load_dictionary("mmcif_pdbx.dic");
+
+	auto &db = f.front();
+	auto &entity = db["entity"];
+	auto &struct_asym = db["struct_asym"];
+
+	CHECK(f.is_valid());
+	CHECK(struct_asym.validate_links(cif::incremental));
+
+	// changing a parent key without updating the children orphans them,
+	// only the child category has rows that fail
+	entity.front().assign("id", "3", false);
+	CHECK(entity.validate_links(cif::incremental));
+	CHECK_FALSE(struct_asym.validate_links(cif::incremental));
+
+	entity.front().assign("id", "1", false);
+	CHECK(struct_asym.validate_links(cif::incremental));
+
+	// clearing the parent is noticed by the child
+	entity.clear();
+	CHECK_FALSE(struct_asym.validate_links(cif::incremental));
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("parallel_validation_1")
+{
+	cif::file f;
+	f.load_dictionary("mmcif_pdbx.dic");
+
+	f.emplace("TEST");
+	auto &db = f.front();
+	db.set_validator(f.get_validator());
+
+	auto &entity = db["entity"];
+	entity.emplace({ { "id", 1 }, { "type", "polymer" } });
+
+	auto &entity_poly_seq = db["entity_poly_seq"];
+	for (int i = 1; i <= 20000; ++i)
+		entity_poly_seq.emplace({ { "entity_id", 1 }, { "num", i }, { "mon_id", "ALA" }, { "hetero", "n" } });
+
+	CHECK(db.is_valid(cif::parallel_policy{ 4 }));
+
+	// introduce some errors and check they are reported in the same order
+	int n = 0;
+	for (auto r : entity_poly_seq)
+	{
+		++n;
+		if (n == 10 or n == 7001 or n == 15000 or n == 19999)
+			r.assign("hetero", "maybe", false, false);
+		if (n == 12000)
+			r.assign("mon_id", "A LA", false, false);
+	}
+	entity.front().assign("type", "bogus", false, false);
+
+	std::vector<std::pair<std::string, bool>> serial, parallel;
+
+	{
+		cif::detail::report_collector collector;
+		CHECK_FALSE(db.is_valid());
+		serial = std::move(collector.m_reports);
+	}
+
+	{
+		cif::detail::report_collector collector;
+		CHECK_FALSE(db.is_valid(cif::parallel_policy{ 4 }));
+		parallel = std::move(collector.m_reports);
+	}
+
+	CHECK(serial.size() == 6);
+	CHECK(serial == parallel);
+
+	// the failing rows are validated again incrementally
+	CHECK_FALSE(entity_poly_seq.is_valid(cif::incremental));
+	CHECK_FALSE(f.is_valid(cif::parallel));
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("validator_cache_1")
+{
+	auto &validator = cif::validator_factory::instance()["mmcif_pdbx.dic"];
+
+	std::stringstream s1;
+	validator.save_binary(s1);
+
+	auto copy = cif::validator::load_binary(s1);
+	CHECK(copy.name() == validator.name());
+	CHECK(copy.version() == validator.version());
+
+	// writing the copy results in exactly the same data
+	std::stringstream s2;
+	copy.save_binary(s2);
+	CHECK(s1.str() == s2.str());
+
+	auto cv = copy.get_validator_for_category("atom_site");
+	REQUIRE(cv != nullptr);
+	CHECK(cv->m_keys == std::vector<std::string>{ "id" });
+
+	auto iv = cv->get_validator_for_item("group_PDB");
+	REQUIRE(iv != nullptr);
+	REQUIRE(iv->m_type != nullptr);
+	CHECK(iv->m_category == cv);
+	CHECK(iv->m_type == copy.get_validator_for_type(iv->m_type->m_name));
+	CHECK_NOTHROW((*iv)("HETATM"));
+	CHECK_THROWS_AS((*iv)("ATOMS"), cif::validation_error);
+
+	CHECK(copy.get_validator_for_type("float")->match("1.5e3"));
+	CHECK(copy.get_links_for_child("atom_site").size() == validator.get_links_for_child("atom_site").size());
+
+	std::istringstream garbage("not a validator");
+	CHECK_THROWS(cif::validator::load_binary(garbage));
+
+	// the cache in the factory
+	auto dir = std::filesystem::temp_directory_path() / "cifpp-validator-cache-test";
+	std::filesystem::remove_all(dir);
+
+	auto &factory = cif::validator_factory::instance();
+	factory.set_cache_directory(dir);
+
+	auto data = cif::load_resource("mmcif_pdbx.dic");
+	REQUIRE(data);
+	auto &v1 = factory.construct_validator("cache_test.dic", *data);
+
+	CHECK(std::distance(std::filesystem::directory_iterator(dir), std::filesystem::directory_iterator{}) == 1);
+
+	data = cif::load_resource("mmcif_pdbx.dic");
+	auto &v2 = factory.construct_validator("cache_test.dic", *data);
+
+	factory.set_cache_directory({});
+	std::filesystem::remove_all(dir);
+
+	std::stringstream s3, s4;
+	v1.save_binary(s3);
+	v2.save_binary(s4);
+	CHECK(s3.str() == s4.str());
+	CHECK(s3.str() == s1.str());
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("validator_factory_1")
+{
+	cif::add_file_resource("single_flight_test.dic", gTestDir / ".." / "rsrc" / "mmcif_ddl.dic");
+
+	auto &factory = cif::validator_factory::instance();
+
+	const size_t N = 8;
+	std::vector<const cif::validator *> result(N);
+	std::vector<std::thread> t;
+
+	for (size_t i = 0; i < N; ++i)
+		t.emplace_back([&factory, &result, i]() { result[i] = &factory["single_flight_test.dic"]; });
+
+	for (auto &ti : t)
+		ti.join();
+
+	for (size_t i = 1; i < N; ++i)
+		CHECK(result[i] == result[0]);
+
+	// once loaded, the name without extension and a different case work too
+	CHECK(&factory["single_flight_test.dic"] == result[0]);
+	CHECK(&factory["SINGLE_FLIGHT_TEST"] == result[0]);
+
+	// failures are reported to all waiting threads and are not remembered
+	CHECK_THROWS(factory["no_such_dictionary.dic"]);
+	CHECK_THROWS(factory["no_such_dictionary.dic"]);
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("write_unaligned_1")
+{
+	const std::vector<std::string> values{
+		"aap",
+		"it's",
+		"say \"hi\"",
+		"both ' and \" ",
+		"line 1\nline 2",
+		"loop_",
+		std::string(200, 'x'),
+		"?"
+	};
+
+	cif::datablock db("TEST");
+	auto &test = db["test"];
+
+	int id = 0;
+	for (auto &v : values)
+		test.emplace({ { "id", ++id }, { "value", v } });
+
+	for (bool aligned : { true, false })
+	{
+		std::stringstream s;
+		if (aligned)
+			db.write(s);
+		else
+			db.write(s, cif::unaligned);
+
+		cif::file f(s);
+		REQUIRE(f.size() == 1);
+		REQUIRE(f.front().get("test") != nullptr);
+
+		auto &test2 = f.front()["test"];
+		REQUIRE(test2.size() == values.size());
+
+		auto vi = values.begin();
+		for (const auto &[id2, value] : test2.rows<int, std::string>("id", "value"))
+		{
+			CHECK(id2 == vi - values.begin() + 1);
+			CHECK(value == (*vi == "?" ? "" : *vi));
+			++vi;
+		}
+	}
+
+	// no padding in unaligned output
+	std::stringstream s;
+	test.write(s, cif::unaligned);
+	CHECK(s.str().find("1 aap \n") != std::string::npos);
+	CHECK(s.str().find("  ") == std::string::npos);
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("parallel_write_1")
+{
+	cif::datablock db("TEST");
+
+	auto &small = db["small"];
+	small.emplace({ { "id", 1 }, { "name", "aap" } });
+
+	auto &large = db["large"];
+	for (int i = 0; i < 40000; ++i)
+	{
+		// make the widest value appear in one of the last rows only
+		large.emplace({ { "id", i },
+			{ "name", i == 39999 ? "a much longer name than all others" : (i % 3 ? "noot" : "it's mies") },
+			{ "text", i % 1000 ? "x" : "line 1\nline 2" } });
+	}
+
+	auto &other = db["other"];
+	for (int i = 0; i < 10; ++i)
+		other.emplace({ { "id", i }, { "value", i * 1.5 } });
+
+	std::stringstream s1, s2, s3, s4;
+
+	db.write(s1);
+	db.write(s2, cif::parallel_policy{ 4 });
+	CHECK(s1.str() == s2.str());
+
+	db.write(s3, cif::unaligned);
+	db.write(s4, cif::parallel_policy{ 3 }, cif::unaligned);
+	CHECK(s3.str() == s4.str());
+
+	CHECK(s1.str() != s3.str());
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("category_writer_1")
+{
+	cif::category cat("test");
+
+	for (int i = 0; i < 20; ++i)
+	{
+		cat.emplace({ { "id", i },
+			{ "name", i % 2 ? "aap" : "it's" },
+			{ "x", i * 1.25 },
+			{ "flag", i % 3 == 0 } });
+	}
+
+	// the widths category::write calculates, the longest value plus one
+	std::stringstream s1, s2;
+	cat.write(s1);
+
+	{
+		cif::category_writer w(s2, "test", { { "id", 3 }, { "name", 5 }, { "x", 6 }, { "flag", 2 } });
+
+		for (int i = 0; i < 20; ++i)
+			w.write_row(i, i % 2 ? "aap" : "it's", i * 1.25, i % 3 == 0);
+
+		CHECK(w.size() == 20);
+	}
+
+	CHECK(s1.str() == s2.str());
+
+	// unaligned
+	std::stringstream s3, s4;
+	cat.write(s3, cif::unaligned);
+
+	cif::category_writer w(s4, "test", { "id", "name", "x", "flag" });
+
+	for (int i = 0; i < 20; ++i)
+		w.write_row(std::to_string(i), std::optional<std::string>{ i % 2 ? "aap" : "it's" }, i * 1.25, i % 3 == 0);
+
+	CHECK_THROWS(w.write_row(1, 2));
+
+	w.finish();
+
+	CHECK(s3.str() == s4.str());
+}
+
+TEST_CASE("category_writer_2")
+{
+	// a single row is written without a loop_, just like category::write does
+	cif::category cat("test");
+	cat.emplace({ { "id", 1 }, { "name", "it's" }, { "x", 1.25 } });
+
+	std::stringstream s1, s2;
+	cat.write(s1);
+
+	{
+		cif::category_writer w(s2, "test", { { "id", 2 }, { "name", 7 }, { "x", 5 } });
+		w.write_row(1, "it's", 1.25);
+	}
+
+	CHECK(s1.str() == s2.str());
+
+	std::stringstream s3, s4;
+	cat.write(s3, cif::unaligned);
+
+	cif::category_writer w(s4, "test", { "id", "name", "x" });
+	w.write_row(1, "it's", 1.25);
+	w.finish();
+
+	CHECK(s3.str() == s4.str());
+
+	// writing rows after finish would corrupt the output
+	CHECK_THROWS_AS(w.write_row(2, "aap", 2.5), std::runtime_error);
+	CHECK(s3.str() == s4.str());
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("to_chars_fixed_1")
+{
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<double> dist(-1000, 1000);
+
+	std::vector<double> values{ 0, -0.0, 0.0005, -0.0005, 0.0625, 1.0005, 2.5, 999.9995, -0.0001, 123456.789, 1e12, -1e-12,
+		std::numeric_limits<double>::infinity(), std::numeric_limits<double>::quiet_NaN() };
+
+	for (int i = 0; i < 10000; ++i)
+		values.push_back(dist(rng));
+
+	for (int i = 0; i < 1000; ++i)
+		values.push_back(std::round(dist(rng) * 1000) / 1000 + 0.0005);
+
+	for (int precision : { 0, 1, 2, 3, 6, 9, 12 })
+	{
+		for (double v : values)
+		{
+			char b1[64], b2[64];
+
+			auto r = cif::to_chars_fixed(b1, b1 + sizeof(b1), v, precision);
+			REQUIRE(r.ec == std::errc());
+
+			snprintf(b2, sizeof(b2), "%.*f", precision, v);
+
+			CHECK(std::string(b1, r.ptr) == b2);
+		}
+	}
+
+	char small[4];
+	CHECK(cif::to_chars_fixed(small, small + sizeof(small), 12.345, 3).ec == std::errc::value_too_large);
+
+	CHECK(cif::item("x", 1.0005f, 3).value() == "1.000");
+	CHECK(cif::item("x", -12.3456, 2).value() == "-12.35");
+}
+
+// --------------------------------------------------------------------
+
+TEST_CASE("hash_1")
+{
+	auto f1 = R"(data_TEST
+loop_
+_test.id
+_test.name
+1 aap
+2 noot
+3 mies
+#
+_other.id 1
+)"_cf;
+
+	auto f2 = R"(data_TEST
+_other.id 1
+#
+loop_
+_test.name
+_test.id
+mies 3
+aap 1
+noot 2
+)"_cf;
+
+	auto &db1 = f1.front();
+	auto &db2 = f2.front();
+
+	auto &test1 = db1["test"];
+	auto &test2 = db2["test"];
+
+	// order of rows, columns and categories does not matter
+	CHECK(test1.hash() == test2.hash());
+	CHECK(db1.hash() == db2.hash());
+	CHECK(test1.hash() != db1["other"].hash());
+
+	// the hash is updated with each modification
+	auto h = test1.hash();
+
+	test1.front()["name"] = "wim";
+	CHECK(test1.hash() != h);
+	test1.front()["name"] = "aap";
+	CHECK(test1.hash() == h);
+
+	test1.emplace({ { "id", 4 }, { "name", "zus" } });
+	CHECK(test1.hash() != h);
+	CHECK(db1.hash() != db2.hash());
+
+	test1.erase(cif::key("id") == 4);
+	CHECK(test1.hash() == h);
+	CHECK(db1.hash() == db2.hash());
+
+	// values in different rows must not cancel out
+	cif::category a("x"), b("x");
+	a.emplace({ { "a", 1 }, { "b", 1 } });
+	a.emplace({ { "a", 2 }, { "b", 2 } });
+	b.emplace({ { "a", 1 }, { "b", 2 } });
+	b.emplace({ { "a", 2 }, { "b", 1 } });
+	CHECK(a.hash() != b.hash());
+
+	// incremental and full calculation agree
+	auto copy = test1;
+	CHECK(copy.hash() == test1.hash());
+
+	test1.clear();
+	CHECK(test1.hash() == cif::category("test").hash());
+}
+
+TEST_CASE("hash_2")
+{
+	// concurrent calls on a const category all see the same hash
+	cif::category cat("test");
+	for (int i = 0; i < 10000; ++i)
+		cat.emplace({ { "id", i }, { "name", "aap" } });
+
+	const cif::category &ccat = cat;
+
+	std::vector<uint64_t> hashes(4);
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < hashes.size(); ++t)
+		threads.emplace_back([&ccat, &hashes, t]() { hashes[t] = ccat.hash(); });
+
+	for (auto &t : threads)
+		t.join();
+
+	for (auto h : hashes)
+		CHECK(h == hashes.front());
+
+	cif::category copy(cat);
+	CHECK(copy.hash() == hashes.front());
+}